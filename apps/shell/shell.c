@@ -9,6 +9,15 @@
 #include "libc/string.h"
 #include "libc/stdio.h"
 #include "kernel/memory.h"
+#include "kernel/slab.h"
+#include "kernel/pmm.h"
+#include "kernel/heap_profile.h"
+#include "kernel/scheduler.h"
+#include "kernel/smp.h"
+#include "kernel/timer.h"
+#include "kernel/fpu.h"
+#include "kernel/mutex.h"
+#include "kernel/futex.h"
 
 #define MAX_HISTORY 20
 #define MAX_COMMAND_LEN 256
@@ -27,7 +36,7 @@ void shell_init(shell_output_t output_func) {
 
 static void shell_cmd_help(int argc, char** argv) {
     (void)argc; (void)argv;
-    shell_out("Available commands: help, clear, ls, cat, echo, exit");
+    shell_out("Available commands: help, clear, ls, cat, echo, slabinfo, vmbench, heapprof, cpus, ps, fpustat, lockstat, exit");
 }
 
 static void shell_cmd_ls(int argc, char** argv) {
@@ -53,6 +62,141 @@ static void shell_cmd_echo(int argc, char** argv) {
     shell_out("\n");
 }
 
+static void shell_cmd_slabinfo(int argc, char** argv) {
+    (void)argc; (void)argv;
+    // Also mirrored to the kernel log / serial
+    kmem_cache_dump_stats();
+
+    pmm_zero_stats_t zero;
+    if (pmm_get_zero_stats(&zero)) {
+        char line[128];
+        snprintf(line, sizeof(line), "zero pool: %u frames, %u hits, %u misses, "
+                 "%u frames zeroed idle, %u inline",
+                 zero.pooled_frames, zero.hits, zero.misses,
+                 zero.frames_zeroed_idle, zero.frames_zeroed_inline);
+        shell_out(line);
+    }
+    shell_out("Slab cache statistics written to the kernel log.");
+}
+
+static void shell_cmd_vmbench(int argc, char** argv) {
+    (void)argc; (void)argv;
+    vmm_benchmark_ranges();
+    shell_out("Page mapping benchmark written to the kernel log.");
+}
+
+static void shell_cmd_heapprof(int argc, char** argv) {
+    (void)argc; (void)argv;
+#ifdef CONFIG_HEAP_PROFILE
+    heap_profile_dump();
+    shell_out("Heap profile written to the kernel log.");
+#else
+    memory_stats_t stats;
+    if (memory_get_stats(&stats) != MEMORY_SUCCESS) {
+        shell_out("Heap not initialized.");
+        return;
+    }
+    char line[128];
+    snprintf(line, sizeof(line), "heap: %u B used, %u B peak, fragmentation %u%% "
+             "(rebuild with HEAP_PROFILE=1 for call sites)",
+             (uint32_t)stats.current_usage, (uint32_t)stats.peak_usage,
+             stats.fragmentation_ratio);
+    shell_out(line);
+#endif
+
+    memory_realloc_stats_t realloc_stats;
+    if (memory_get_realloc_stats(&realloc_stats)) {
+        char summary[96];
+        snprintf(summary, sizeof(summary), "realloc: %u in place, %u remapped, %u copied",
+                 realloc_stats.in_place, realloc_stats.remaps, realloc_stats.copies);
+        shell_out(summary);
+    }
+}
+
+static void shell_cmd_cpus(int argc, char** argv) {
+    (void)argc; (void)argv;
+    char line[128];
+    for (uint32_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        scheduler_cpu_stats_t stats;
+        if (!scheduler_get_cpu_stats(cpu, &stats)) {
+            continue;
+        }
+        timer_idle_stats_t idle = {0};
+        timer_get_idle_stats(cpu, &idle);
+        snprintf(line, sizeof(line), "CPU%u (APIC %u): %s, %u ready (%u fair), %u switches, %u stolen, %u RT throttles",
+                 cpu, smp_cpu_apic_id(cpu), stats.idle ? "idle" : "busy",
+                 stats.ready, stats.fair_ready, stats.switches, stats.steals, stats.rt_throttled);
+        shell_out(line);
+        snprintf(line, sizeof(line), "  tickless: %u idle periods, %u ticks skipped%s",
+                 idle.oneshots, idle.ticks_skipped, idle.tickless ? " (tick stopped)" : "");
+        shell_out(line);
+    }
+}
+
+static void shell_cmd_ps(int argc, char** argv) {
+    (void)argc; (void)argv;
+    static const char* const states[] = {"ready", "running", "blocked", "terminated"};
+    char line[128];
+    for (uint32_t pid = 1; pid < PROCESS_PID_MAX; pid++) {
+        process_info_t info;
+        if (!process_get_info(pid, &info)) {
+            continue;
+        }
+        uint32_t latency_avg = info.wakeups ? info.wake_latency_total / info.wakeups : 0;
+        snprintf(line, sizeof(line), "%u %s: %s on CPU%u, %u wakeups, latency avg %u max %u ticks",
+                 pid, info.name, states[info.state], info.cpu,
+                 info.wakeups, latency_avg, info.wake_latency_max);
+        shell_out(line);
+    }
+}
+
+static void shell_cmd_fpustat(int argc, char** argv) {
+    (void)argc; (void)argv;
+    fpu_stats_t fpu;
+    if (!fpu_get_stats(&fpu)) {
+        shell_out("FPU not initialized.");
+        return;
+    }
+    char line[128];
+    snprintf(line, sizeof(line), "FPU: %u traps, %u restores, %u reused, %u saves",
+             fpu.traps, fpu.restores, fpu.reuses, fpu.saves);
+    shell_out(line);
+}
+
+static void shell_cmd_lockstat(int argc, char** argv) {
+    (void)argc; (void)argv;
+    char line[128];
+    for (uint32_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        spinlock_stats_t lock;
+        if (scheduler_get_lock_stats(cpu, &lock)) {
+            snprintf(line, sizeof(line), "CPU%u rq lock: %u/%u contended, %u kcycles spinning, longest hold %u kcycles",
+                     cpu, lock.contended, lock.acquisitions, (uint32_t)(lock.spin_cycles / 1000),
+                     (uint32_t)(lock.hold_max / 1000));
+            shell_out(line);
+        }
+    }
+
+    mutex_stats_t mutexes;
+    if (mutex_get_stats(&mutexes)) {
+        snprintf(line, sizeof(line), "Mutex: %u contended, %u boosts, chain %u, worst wait %u ticks",
+                 mutexes.contended, mutexes.boosts, mutexes.chain_max, mutexes.wait_max);
+        shell_out(line);
+    }
+    mutex_class_t cls;
+    for (uint32_t i = 0; mutex_get_class(i, &cls); i++) {
+        snprintf(line, sizeof(line), "  %s: spin %u, %u/%u spins acquired, %u timed out, %u owner off-CPU",
+                 cls.name, cls.spin_budget, cls.spin_hits, cls.spins, cls.spin_timeouts, cls.owner_off_cpu);
+        shell_out(line);
+    }
+
+    futex_stats_t futex;
+    if (futex_get_stats(&futex)) {
+        snprintf(line, sizeof(line), "Futex: %u waits, %u refused, %u wakes",
+                 futex.waits, futex.mismatches, futex.wakes);
+        shell_out(line);
+    }
+}
+
 typedef void (*shell_cmd_handler_t)(int argc, char** argv);
 
 typedef struct {
@@ -64,6 +208,13 @@ static shell_command_t commands[] = {
     {"help", shell_cmd_help},
     {"ls", shell_cmd_ls},
     {"echo", shell_cmd_echo},
+    {"slabinfo", shell_cmd_slabinfo},
+    {"vmbench", shell_cmd_vmbench},
+    {"heapprof", shell_cmd_heapprof},
+    {"cpus", shell_cmd_cpus},
+    {"ps", shell_cmd_ps},
+    {"fpustat", shell_cmd_fpustat},
+    {"lockstat", shell_cmd_lockstat},
     {NULL, NULL}
 };
 
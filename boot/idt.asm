@@ -145,4 +145,19 @@ idt_load:
                                                                                                                                                                                                                                     idtp:
                                                                                                                                                                                                                                         dw 2048
                                                                                                                                                                                                                                             dd 0
-                                                                                                                                                                                                                                            
\ No newline at end of file
+                                                                                                                                                                                                                                            
+; Inter-processor interrupts (APIC vectors above the PIC range). Dispatched
+; through isr_handler so no PIC EOI is sent; handlers ack the local APIC.
+section .text
+global ipi252, ipi253
+
+%macro IPI 1
+ipi%1:
+    cli
+    push dword 0
+    push dword %1
+    jmp isr_common_stub
+%endmacro
+
+IPI 252
+IPI 253
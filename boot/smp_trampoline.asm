@@ -0,0 +1,75 @@
+;;; Maya OS AP Startup Trampoline
+;;; Copied to TRAMPOLINE_BASE by smp_init() and entered in real mode by the
+;;; STARTUP IPI. Switches to protected mode with a flat GDT, enables paging
+;;; with the kernel page directory and calls smp_ap_main(cpu) on the AP's
+;;; own stack. Every address is rebased, since the code runs from the copy.
+;;; Author: AmanNagtodeOfficial
+
+TRAMPOLINE_BASE     equ 0x8000
+%define REL(label)  (TRAMPOLINE_BASE + (label) - smp_trampoline_start)
+
+; Offsets into smp_boot_params_t (kernel/smp.c)
+PARAM_CR3           equ 0
+PARAM_CR4           equ 4
+PARAM_STACK         equ 8
+PARAM_ENTRY         equ 12
+PARAM_CPU           equ 16
+
+section .rodata
+global smp_trampoline_start
+global smp_trampoline_params
+global smp_trampoline_end
+
+[BITS 16]
+smp_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    lgdt [REL(tramp_gdt_ptr)]
+    mov eax, cr0
+    or eax, 1                   ; PE
+    mov cr0, eax
+    jmp dword 0x08:REL(tramp_protected)
+
+[BITS 32]
+tramp_protected:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    mov ebx, REL(smp_trampoline_params)
+    mov eax, [ebx + PARAM_CR4]  ; PSE, matching the BSP
+    mov cr4, eax
+    mov eax, [ebx + PARAM_CR3]
+    mov cr3, eax
+    mov eax, cr0
+    or eax, 0x80000000          ; PG
+    mov cr0, eax
+
+    mov esp, [ebx + PARAM_STACK]
+    push dword [ebx + PARAM_CPU]
+    mov eax, [ebx + PARAM_ENTRY]
+    call eax
+
+.halt:
+    cli
+    hlt
+    jmp .halt
+
+align 8
+tramp_gdt:
+    dq 0
+    dq 0x00CF9A000000FFFF       ; Flat 32-bit code
+    dq 0x00CF92000000FFFF       ; Flat 32-bit data
+tramp_gdt_ptr:
+    dw tramp_gdt_ptr - tramp_gdt - 1
+    dd REL(tramp_gdt)
+
+align 4
+smp_trampoline_params:
+    times 5 dd 0
+smp_trampoline_end:
@@ -0,0 +1,60 @@
+;;; Maya OS Context Switch
+;;; switch_to() saves the callee-saved integer registers, segment registers
+;;; and EFLAGS of the running task on its own kernel stack, stores the stack
+;;; pointer and resumes the next task from the stack pointer it saved. The
+;;; caller-saved registers are already preserved by the C calling convention.
+;;; FPU/SSE state is not touched here; see kernel/fpu.c.
+;;; Author: AmanNagtodeOfficial
+
+[BITS 32]
+section .text
+
+global switch_to
+global switch_to_new_task
+extern process_finish_switch
+
+; Layout of a saved context, lowest address first (process_push_switch_frame
+; in kernel/process.c builds the same frame for tasks that never ran)
+;   gs, fs, es, ds, edi, esi, ebx, ebp, eflags, return address
+
+; void switch_to(void *prev_esp, uint32_t next_esp)
+switch_to:
+    mov eax, [esp + 4]          ; prev_esp
+    mov edx, [esp + 8]          ; next_esp
+
+    pushfd
+    push ebp
+    push ebx
+    push esi
+    push edi
+    push ds
+    push es
+    push fs
+    push gs
+
+    mov [eax], esp
+    mov esp, edx
+
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    popfd
+    ret
+
+; First return of a new or forked task: finish the switch as
+; process_switch() would, then unwind the struct registers frame below
+; exactly like isr_common_stub does
+switch_to_new_task:
+    call process_finish_switch
+    pop gs
+    pop fs
+    pop es
+    pop ds
+    popa
+    add esp, 8
+    iret
@@ -112,7 +112,8 @@ bool fat32_init(uint8_t drive) {
 
     // Read FAT table
     uint32_t fat_sectors = fat32_fs.boot_sector->sectors_per_fat_32;
-    fat32_fs.fat_table = kmalloc(fat_sectors * 512);
+    // The FAT can be megabytes; keep it out of the small-object heap
+    fat32_fs.fat_table = vmalloc(fat_sectors * 512);
     if (!fat32_fs.fat_table) {
         kfree(fat32_fs.boot_sector);
         kfree(cluster_buffer);
@@ -121,7 +122,7 @@ bool fat32_init(uint8_t drive) {
 
     if (!ata_read_sectors(drive, fat32_fs.boot_sector->reserved_sectors,
                          fat_sectors, fat32_fs.fat_table)) {
-        kfree(fat32_fs.fat_table);
+        vfree(fat32_fs.fat_table);
         kfree(fat32_fs.boot_sector);
         kfree(cluster_buffer);
         return false;
@@ -270,7 +271,7 @@ void fat32_cleanup(void) {
         kfree(fat32_fs.boot_sector);
     }
     if (fat32_fs.fat_table) {
-        kfree(fat32_fs.fat_table);
+        vfree(fat32_fs.fat_table);
     }
     if (cluster_buffer) {
         kfree(cluster_buffer);
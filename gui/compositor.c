@@ -16,8 +16,7 @@ static uint32_t screen_w, screen_h;
 void compositor_init(void) {
     screen_w = graphics_get_width();
     screen_h = graphics_get_height();
-    back_buffer = kmalloc(screen_w * screen_h * sizeof(uint32_t));
-    memset(back_buffer, 0, screen_w * screen_h * sizeof(uint32_t));
+    back_buffer = vzalloc(screen_w * screen_h * sizeof(uint32_t));
 }
 
 void compositor_begin_frame(void) {
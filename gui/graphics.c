@@ -9,6 +9,7 @@
 #include "libc/string.h"
 
 #define VBE_LINEAR_FRAMEBUFFER 0xE0000000
+#define VBE_LFB_MAP_UNIT 0x400000
 #define DEFAULT_FONT_HEIGHT 16
 #define DEFAULT_FONT_WIDTH 8
 
@@ -34,12 +35,17 @@ bool graphics_init(void) {
 
     // Initialize VBE mode
     // This would typically be done by the bootloader
-    graphics_state.framebuffer = (uint32_t*)VBE_LINEAR_FRAMEBUFFER;
     graphics_state.width = SCREEN_WIDTH;
     graphics_state.height = SCREEN_HEIGHT;
     graphics_state.pitch = SCREEN_WIDTH * 4;
     graphics_state.bpp = 32;
 
+    // Map the LFB in whole 4 MB units so it is covered by large pages
+    // (the VBE aperture is at least that big and aligned)
+    uint32_t fb_size = graphics_state.pitch * graphics_state.height;
+    fb_size = (fb_size + VBE_LFB_MAP_UNIT - 1) & ~(VBE_LFB_MAP_UNIT - 1);
+    graphics_state.framebuffer = memory_map_physical(VBE_LINEAR_FRAMEBUFFER, fb_size);
+
     // Validate framebuffer
     if (!graphics_state.framebuffer) {
         return false;
@@ -89,17 +89,14 @@ window_t* window_create(const char* title, int x, int y, int width, int height)
     window->min_y = TITLE_BUTTON_MARGIN;
     window->min_x = window->max_x - TITLE_BUTTON_SIZE - TITLE_BUTTON_MARGIN;
 
-    // Create window buffer
-    window->buffer = kmalloc(width * height * sizeof(uint32_t));
+    // Create window buffer, already cleared, outside the small-object heap
+    window->buffer = vzalloc(width * height * sizeof(uint32_t));
     if (!window->buffer) {
         kfree(window);
         wm.window_count--;
         return NULL;
     }
 
-    // Clear window buffer
-    memset(window->buffer, 0, width * height * sizeof(uint32_t));
-
     // Add to window list
     wm.windows[window->id] = window;
     window_focus(window);
@@ -132,7 +129,7 @@ void window_destroy(window_t* window) {
 
     // Free resources
     if (window->buffer) {
-        kfree(window->buffer);
+        vfree(window->buffer);
     }
     kfree(window);
 }
@@ -324,14 +321,12 @@ void window_resize(window_t* window, int width, int height) {
         return;
     }
 
-    uint32_t* new_buffer = kmalloc(width * height * sizeof(uint32_t));
+    uint32_t* new_buffer = vzalloc(width * height * sizeof(uint32_t));
     if (!new_buffer) return;
 
-    memset(new_buffer, 0, width * height * sizeof(uint32_t));
-    
     if (window->buffer) {
         // Copy old contents if possible (simplified for now)
-        kfree(window->buffer);
+        vfree(window->buffer);
     }
 
     window->buffer = new_buffer;
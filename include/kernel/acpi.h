@@ -0,0 +1,32 @@
+/**
+ * Maya OS ACPI Implementation
+ * RSDP/RSDT discovery and table lookup.
+ * Author: AmanNagtodeOfficial
+ */
+#ifndef KERNEL_ACPI_H
+#define KERNEL_ACPI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Common header of every ACPI system description table */
+typedef struct {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed)) acpi_header_t;
+
+bool  acpi_init(void);
+void  acpi_enable(void);
+void  acpi_shutdown(void);
+void *acpi_get_table(const char *signature);
+bool  acpi_is_initialized(void);
+
+#endif /* KERNEL_ACPI_H */
@@ -0,0 +1,31 @@
+/**
+ * Maya OS Advanced Programmable Interrupt Controller (APIC) Driver
+ * Local APIC, IPIs and the per-CPU timer.
+ * Author: AmanNagtodeOfficial
+ */
+#ifndef KERNEL_APIC_H
+#define KERNEL_APIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define APIC_MAX_CPUS 16
+
+bool     apic_init(void);
+void     apic_init_ap(void);
+void     apic_eoi(void);
+void     apic_send_ipi(uint32_t apic_id, uint32_t vector);
+void     apic_send_ipi_all_but_self(uint32_t vector);
+void     apic_send_init(uint32_t apic_id);
+void     apic_send_startup(uint32_t apic_id, uint8_t page);
+uint32_t apic_get_id(void);
+uint32_t apic_get_bsp_id(void);
+uint32_t apic_get_cpu_count(void);
+uint32_t apic_get_cpu_apic_id(uint32_t index);
+bool     apic_is_bsp(void);
+void     apic_set_timer(uint32_t vector, uint32_t initial_count, bool periodic);
+uint32_t apic_get_timer_count(void);
+void     apic_stop_timer(void);
+bool     apic_is_initialized(void);
+
+#endif /* KERNEL_APIC_H */
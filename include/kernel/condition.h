@@ -0,0 +1,26 @@
+/**
+ * Maya OS Condition Variable
+ * Waits with a mutex held; waiters sleep on a wait queue.
+ * Author: AmanNagtodeOfficial
+ */
+#ifndef KERNEL_CONDITION_H
+#define KERNEL_CONDITION_H
+
+#include <stdbool.h>
+#include "kernel/mutex.h"
+#include "kernel/wait_queue.h"
+
+typedef struct {
+    wait_queue_t waiters;
+} condition_t;
+
+void condition_init(condition_t *cond);
+
+/* Release `mutex`, sleep until signalled and retake it; recheck in a loop */
+void condition_wait(condition_t *cond, mutex_t *mutex);
+void condition_signal(condition_t *cond);
+void condition_broadcast(condition_t *cond);
+void condition_destroy(condition_t *cond);
+bool condition_has_waiters(condition_t *cond);
+
+#endif /* KERNEL_CONDITION_H */
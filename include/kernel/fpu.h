@@ -0,0 +1,40 @@
+/**
+ * Maya OS FPU/SSE Context Management
+ * Lazy switching: CR0.TS is set on every context switch and a task's
+ * FXSAVE area is only loaded when it executes an FPU/SSE instruction.
+ * Author: AmanNagtodeOfficial
+ */
+#ifndef KERNEL_FPU_H
+#define KERNEL_FPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "kernel/process.h"
+
+#define FPU_STATE_SIZE  512   /* FXSAVE area, must be 16-byte aligned */
+
+typedef struct {
+    uint32_t traps;      /* #NM faults taken                           */
+    uint32_t restores;   /* FXRSTOR from memory                        */
+    uint32_t saves;      /* FXSAVE at switch-out of an FPU user        */
+    uint32_t reuses;     /* Registers still held the task's own state  */
+} fpu_stats_t;
+
+bool fpu_init(void);
+void fpu_init_ap(void);
+
+/**
+ * Called by process_switch() before leaving `prev`. Saves its registers
+ * only if it used the FPU this time slice, then arms the #NM trap.
+ */
+void fpu_switch(process_t *prev);
+
+/* Give a forked child its own copy of the parent's FPU state */
+bool fpu_fork(process_t *parent, process_t *child);
+
+/* Drop a dying task's state so no CPU keeps it as the register owner */
+void fpu_release(process_t *process);
+
+bool fpu_get_stats(fpu_stats_t *stats);
+
+#endif /* KERNEL_FPU_H */
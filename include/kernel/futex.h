@@ -0,0 +1,40 @@
+/**
+ * Maya OS Futex
+ * Wait/wake on a 32-bit word in user memory, so user-space locks only
+ * enter the kernel when they are contended (see libc/sync.c).
+ * Author: AmanNagtodeOfficial
+ */
+#ifndef KERNEL_FUTEX_H
+#define KERNEL_FUTEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* int 0x80 numbers, registered by syscall_init_defaults() */
+#define SYS_FUTEX_WAIT   8   /* (uint32_t *addr, uint32_t expected)  */
+#define SYS_FUTEX_WAKE   9   /* (uint32_t *addr, uint32_t count)     */
+
+#define FUTEX_WAKE_ALL   0xFFFFFFFF
+
+typedef struct {
+    uint32_t waits;      /* Tasks that went to sleep              */
+    uint32_t mismatches; /* Waits refused, the word had changed   */
+    uint32_t wakes;      /* Tasks woken                           */
+} futex_stats_t;
+
+bool futex_init(void);
+
+/**
+ * Sleep until futex_wake() on `addr`, unless it no longer holds
+ * `expected`; the check and the sleep are atomic against wakers.
+ * Returns 0 once woken, -1 if the value differed or `addr` is invalid.
+ * Callers recheck their condition either way.
+ */
+int futex_wait(volatile uint32_t *addr, uint32_t expected);
+
+/* Wake up to `count` tasks waiting on `addr`; returns how many */
+uint32_t futex_wake(volatile uint32_t *addr, uint32_t count);
+
+bool futex_get_stats(futex_stats_t *stats);
+
+#endif /* KERNEL_FUTEX_H */
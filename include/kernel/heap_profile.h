@@ -0,0 +1,54 @@
+/**
+ * Maya OS Heap Profiler
+ * Optional allocation-site accounting for the kernel heap
+ * (build with HEAP_PROFILE=1).
+ * Author: AmanNagtodeOfficial
+ */
+#ifndef KERNEL_HEAP_PROFILE_H
+#define KERNEL_HEAP_PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "kernel/memory.h"
+
+#define HEAP_PROFILE_SITES      256     /* Distinct call sites tracked     */
+#define HEAP_PROFILE_TRACKED    16384   /* Live allocations tracked        */
+#define HEAP_PROFILE_LIFETIMES  8       /* <1, <4, <16 ... <4096, more ms  */
+#define HEAP_PROFILE_TOP        24      /* Sites listed by the dump        */
+
+typedef struct {
+    uintptr_t caller;                   /* Return address of the allocation */
+    uint32_t  allocs;
+    uint32_t  frees;
+    uint64_t  bytes;                    /* Requested bytes, cumulative      */
+    uint32_t  live_count;
+    uint32_t  live_bytes;
+    uint32_t  peak_live_bytes;
+    uint32_t  lifetime[HEAP_PROFILE_LIFETIMES];
+} heap_profile_site_t;
+
+#ifdef CONFIG_HEAP_PROFILE
+
+void heap_profile_record_alloc(void *ptr, size_t size, void *caller);
+void heap_profile_record_free(void *ptr);
+bool heap_profile_fill_stats(memory_stats_t *stats);
+bool heap_profile_get_site(uint32_t index, heap_profile_site_t *site);
+void heap_profile_dump(void);
+
+#else
+
+static inline void heap_profile_record_alloc(void *ptr, size_t size, void *caller) {
+    (void)ptr; (void)size; (void)caller;
+}
+static inline void heap_profile_record_free(void *ptr) { (void)ptr; }
+static inline bool heap_profile_fill_stats(memory_stats_t *stats) { (void)stats; return false; }
+static inline bool heap_profile_get_site(uint32_t index, heap_profile_site_t *site) {
+    (void)index; (void)site;
+    return false;
+}
+static inline void heap_profile_dump(void) { }
+
+#endif /* CONFIG_HEAP_PROFILE */
+
+#endif /* KERNEL_HEAP_PROFILE_H */
@@ -30,6 +30,7 @@ struct registers {
                                             // Function prototypes
                                             void idt_init(void);
                                             void idt_install(void);
+                                            void idt_reload(void);
                                             void idt_set_gate(uint8_t num, uint32_t base, uint16_t sel, uint8_t flags);
 
                                             void isr_handler(struct registers *regs);
@@ -38,6 +39,10 @@ struct registers {
                                             typedef void (*isr_t)(struct registers *);
                                             void register_interrupt_handler(uint8_t n, isr_t handler);
 
+                                            // Local interrupt masking (returns/accepts saved EFLAGS)
+                                            uint32_t interrupt_disable(void);
+                                            void interrupt_restore(uint32_t flags);
+
                                             // PIC functions
                                             void pic_init(void);
                                             void pic_send_eoi(uint8_t irq);
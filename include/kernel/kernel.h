@@ -40,6 +40,8 @@ struct multiboot_info {
                                                                                     uint8_t inb(uint16_t port);
                                                                                     void outw(uint16_t port, uint16_t value);
                                                                                     uint16_t inw(uint16_t port);
+                                                                                    uint64_t rdmsr(uint32_t msr);
+                                                                                    void wrmsr(uint32_t msr, uint64_t value);
 
                                                                                     // Debug functions
                                                                                     void debug_print(const char *message);
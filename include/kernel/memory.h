@@ -248,6 +248,71 @@ memory_error_t memory_unlock(void *ptr, size_t size);
  */
 const char *memory_strerror(memory_error_t error);
 
+/* Per-CPU magazine counters for the small-object kmalloc path */
+typedef struct {
+    uint32_t alloc_hits;
+    uint32_t alloc_misses;
+    uint32_t free_hits;
+    uint32_t free_misses;
+} heap_magazine_stats_t;
+
+/* memory_realloc() outcomes */
+typedef struct {
+    uint32_t in_place;   /* Resized without moving (spare capacity, merge, vmalloc grow) */
+    uint32_t remaps;     /* vmalloc areas moved by rewriting PTEs, no copy */
+    uint32_t copies;     /* Fell back to allocate, copy, free */
+} memory_realloc_stats_t;
+
+/* Kernel heap and paging primitives (kernel/memory.c) */
+bool  heap_init(void);
+bool  vmm_init(void);
+bool  page_map(uint32_t virtual_addr, uint32_t physical_addr);
+void* kmalloc(size_t size);
+void* kzalloc(size_t size);
+void* kmalloc_aligned(size_t size);
+void  kfree(void* ptr);
+bool  kmalloc_get_cpu_stats(uint32_t cpu, heap_magazine_stats_t* stats);
+void  kmalloc_dump_cpu_stats(void);
+bool  memory_get_realloc_stats(memory_realloc_stats_t* stats);
+uint32_t get_total_memory(void);
+uint32_t get_used_memory(void);
+bool  is_mmu_initialized(void);
+bool  memory_validate_user_buffer(const void *ptr, size_t len);
+bool  memory_validate_user_string(const char *str);
+
+/* Virtually contiguous kernel buffers backed by scattered frames */
+void* vmalloc(size_t size);
+void* vzalloc(size_t size);
+void  vfree(void* ptr);
+bool  is_vmalloc_addr(const void* ptr);
+uint32_t vmalloc_get_used(void);
+
+/* Kernel range mappings; flags are MEMORY_FLAG_*, one TLB flush per call */
+bool  vmm_map_range(uint32_t virtual_addr, uint32_t physical_addr, uint32_t size,
+                    uint32_t flags);
+bool  vmm_unmap_range(uint32_t virtual_addr, uint32_t size);
+bool  vmm_protect_range(uint32_t virtual_addr, uint32_t size, uint32_t flags);
+void  vmm_benchmark_ranges(void);
+
+/* Copy-on-write / demand-zero fault counters */
+typedef struct {
+    uint32_t cow_copies;
+    uint32_t cow_reuses;
+    uint32_t zero_fills;
+    uint32_t zero_maps;
+} vmm_fault_stats_t;
+
+/* User address spaces (kernel/memory.c) */
+uint32_t* vmm_get_kernel_directory(void);
+uint32_t* vmm_clone_address_space(uint32_t* source);
+void  vmm_destroy_address_space(uint32_t* directory);
+void  vmm_switch_address_space(uint32_t* directory);
+bool  vmm_map_anonymous(uint32_t virtual_addr, uint32_t size, bool writable);
+uint32_t vmm_alloc_anonymous(uint32_t* cursor, uint32_t size, bool writable);
+bool  vmm_handle_page_fault(uint32_t fault_addr, uint32_t error_code);
+bool  vmm_fault_in(uint32_t virtual_addr);
+bool  vmm_get_fault_stats(vmm_fault_stats_t* stats);
+
 void* memory_alloc_dma(size_t size, size_t alignment);
 void  memory_free_dma(void* ptr);
 uintptr_t memory_get_physical(void* virt_addr);
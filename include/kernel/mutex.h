@@ -0,0 +1,71 @@
+/**
+ * Maya OS Mutex
+ * Adaptive sleeping lock with priority inheritance: a locker spins while
+ * the owner is running on another CPU and blocks otherwise; while a task
+ * waits, the owner runs at least at the waiter's scheduler rank, through
+ * chains of owners that are themselves waiting.
+ * Author: AmanNagtodeOfficial
+ */
+#ifndef KERNEL_MUTEX_H
+#define KERNEL_MUTEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "kernel/process.h"
+
+#define MUTEX_CLASS_MAX      16
+#define MUTEX_SPIN_DEFAULT   2000    /* pause iterations */
+
+struct mutex_waiter;
+
+/*
+ * Mutexes guarding similar critical sections share a class, which holds
+ * the spin budget and counts how spinning pays off. A budget of 0 always
+ * blocks at once.
+ */
+typedef struct mutex_class {
+    const char *name;
+    uint32_t spin_budget;     /* Spin iterations before blocking        */
+    uint32_t spins;           /* Contended acquisitions that spun       */
+    uint32_t spin_hits;       /* ... and got the mutex without blocking */
+    uint32_t spin_timeouts;   /* Budget ran out, the owner still ran    */
+    uint32_t owner_off_cpu;   /* Blocked at once, owner was not running */
+    bool registered;
+} mutex_class_t;
+
+#define MUTEX_CLASS_INIT(class_name) \
+    { .name = (class_name), .spin_budget = MUTEX_SPIN_DEFAULT }
+
+typedef struct mutex {
+    volatile uint32_t state;        /* Owner's address | flags, 0 when free */
+    struct mutex_waiter *waiters;   /* Highest rank first, FIFO within one  */
+    struct mutex *pi_next;          /* Owner's pi_held list, while contended */
+    uint32_t wait_max;              /* Longest wait to acquire it, ticks    */
+    mutex_class_t *cls;
+} mutex_t;
+
+typedef struct {
+    uint32_t contended;   /* Acquisitions that had to block            */
+    uint32_t boosts;      /* Owners whose rank was raised by a waiter  */
+    uint32_t chain_max;   /* Longest owner chain a loan travelled      */
+    uint32_t wait_max;    /* Longest wait on any mutex, ticks          */
+} mutex_stats_t;
+
+/* mutex_init() puts a mutex in the default "mutex" class */
+void mutex_init(mutex_t *mutex);
+void mutex_init_class(mutex_t *mutex, mutex_class_t *cls);
+void mutex_class_set_spin(mutex_class_t *cls, uint32_t spin_budget);
+void mutex_lock(mutex_t *mutex);
+bool mutex_try_lock(mutex_t *mutex);
+void mutex_unlock(mutex_t *mutex);
+
+/* Hand every contended mutex the caller holds to its top waiter; for exit */
+void mutex_unlock_all(void);
+bool mutex_is_locked(mutex_t *mutex);
+process_t *mutex_get_owner(mutex_t *mutex);
+bool mutex_get_stats(mutex_stats_t *stats);
+
+/* Snapshot of the index'th class that has been used, for tuning */
+bool mutex_get_class(uint32_t index, mutex_class_t *cls);
+
+#endif /* KERNEL_MUTEX_H */
@@ -0,0 +1,67 @@
+/**
+ * Maya OS Physical Memory Manager
+ * Buddy-system page frame allocator.
+ * Author: AmanNagtodeOfficial
+ */
+#ifndef KERNEL_PMM_H
+#define KERNEL_PMM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "kernel/kernel.h"
+
+#define PMM_FRAME_SIZE   4096
+#define PMM_FRAME_SHIFT  12
+#define PMM_MAX_ORDER    10   /* Largest block: 2^10 frames = 4 MB */
+
+/* Frame descriptor flags */
+#define PAGE_FLAG_FREE      (1u << 0)  /* Head of a free buddy block  */
+#define PAGE_FLAG_RESERVED  (1u << 1)  /* Not managed by the allocator */
+#define PAGE_FLAG_DIRECT    (1u << 2)  /* Whole block owned by kmalloc   */
+#define PAGE_FLAG_ZEROED    (1u << 3)  /* Head of a pre-zeroed free block */
+
+/* One descriptor per physical frame */
+typedef struct page {
+    struct page *next;
+    struct page *prev;
+    uint32_t     flags;
+    uint32_t     order;
+    uint32_t     refcount;  /* Mappings sharing this frame (COW) */
+} page_t;
+
+typedef struct {
+    uint32_t total_frames;
+    uint32_t free_frames;
+    uint32_t free_blocks[PMM_MAX_ORDER + 1];
+} pmm_stats_t;
+
+typedef struct {
+    uint32_t hits;                  /* Zeroed requests served from the pool */
+    uint32_t misses;                /* Zeroed requests that cleared inline  */
+    uint32_t frames_zeroed_idle;
+    uint32_t frames_zeroed_inline;
+    uint32_t pooled_frames;
+} pmm_zero_stats_t;
+
+bool      pmm_init(struct multiboot_info *mbi);
+uintptr_t pmm_alloc_pages(uint32_t order);
+void      pmm_free_pages(uintptr_t addr, uint32_t order);
+uintptr_t pmm_alloc_zeroed_pages(uint32_t order);
+bool      pmm_zero_pool_refill(uint32_t budget);
+bool      pmm_get_zero_stats(pmm_zero_stats_t *stats);
+uintptr_t pmm_alloc_frame(void);
+void      pmm_free_frame(uintptr_t addr);
+void      pmm_frame_ref(uintptr_t addr);
+bool      pmm_frame_unref(uintptr_t addr);
+uint32_t  pmm_frame_refcount(uintptr_t addr);
+uint32_t  pmm_get_free_count(uint32_t order);
+bool      pmm_get_stats(pmm_stats_t *stats);
+page_t   *pmm_frame_to_page(uintptr_t addr);
+uintptr_t pmm_page_to_frame(const page_t *page);
+uint32_t  pmm_order_for_size(size_t size);
+uint32_t  pmm_get_total_memory(void);
+uint32_t  pmm_get_free_memory(void);
+bool      pmm_is_initialized(void);
+
+#endif /* KERNEL_PMM_H */
@@ -2,8 +2,14 @@
 #define PROCESS_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #define MAX_PROCESSES 256
+#define PROCESS_NAME_MAX 256
+#define PROCESS_NOT_SLEEPING 0xFFFF
+#define PROCESS_PID_MAX 4096     /* pids run 1 .. PROCESS_PID_MAX - 1 */
+
+#define SYS_MAP_ANON 10          /* (uint32_t size, bool writable) -> address or 0 */
 
 typedef enum {
     PROCESS_STATE_READY,
@@ -14,39 +20,97 @@ typedef enum {
 
 #include "fs/file.h"
 
+typedef void (*process_entry_t)(void);
+
 typedef struct process {
     uint32_t pid;
     process_state_t state;
-    uint32_t esp;
+    uint32_t esp;              /* Kernel stack pointer saved by switch_to */
     uint32_t ebp;
     uint32_t eip;
-    uint32_t page_directory;
+    uint32_t page_directory;   /* Physical address of the page directory */
+    uint32_t anon_next;        /* Where the next anonymous mapping goes, 0 before the first */
+    process_entry_t entry;
+    uint8_t *stack;            /* Kernel stack base */
     
     // Scheduling fields
     uint8_t priority;
+    uint8_t policy;            /* SCHED_POLICY_* (kernel/scheduler.h) */
+    uint8_t base_priority;     /* Own settings; priority/policy above may */
+    uint8_t base_policy;       /* be raised by priority inheritance       */
+    uint8_t pi_rank;           /* Inherited scheduler rank, 0 if none     */
     uint32_t quantum_remaining;
     uint32_t total_runtime;
-    uint32_t last_run;
+    uint32_t last_run;         /* Tick runtime was last charged at     */
+    uint32_t exec_start;       /* Tick it was last picked to run       */
+    uint64_t vruntime;         /* Weighted runtime, fair class         */
+    uint16_t fair_slot;        /* Fair heap slot, valid while on_rq    */
+    uint32_t wake_tick;        /* Tick of the last wakeup               */
+    bool wake_timed;           /* Its latency is still to be recorded   */
+    uint32_t wakeups;
+    uint32_t wake_latency_total;
+    uint32_t wake_latency_max;
+    struct process *rq_next;   /* Run queue links, valid while on_rq */
+    struct process *rq_prev;
+    bool on_rq;
+    bool on_cpu;               /* Its stack is in use by some CPU */
+    uint8_t cpu;               /* Run queue it is on or last ran from */
+    bool wake_pending;         /* Woken while still running            */
+    volatile bool waiting;     /* Has a wait entry on its stack linked */
+    volatile bool killed;      /* Leaves its wait, exits at next switch */
+    bool zombie;               /* On the reap list, under pm.lock      */
+    uint16_t sleep_slot;       /* Sleep queue slot, or PROCESS_NOT_SLEEPING */
+
+    // Priority inheritance (see kernel/mutex.c)
+    struct mutex *pi_blocked_on;  /* Mutex it is waiting for           */
+    struct mutex *pi_held;        /* Mutexes it owns that have waiters */
+
+    // FPU/SSE state, allocated on first use (see kernel/fpu.c)
+    uint8_t *fpu_state;
+    uint8_t fpu_cpu;           /* CPU whose registers hold it, or 0xFF */
     
     // Filesystem and Security
     fd_table_t fd_table;
     uint32_t caps;
     
+    struct process *parent;
     struct process *next;
-    char name[256];
+    char name[PROCESS_NAME_MAX];
 } __attribute__((packed)) process_t;
 
+/* Copy of a process's fields, safe to use after it is freed */
+typedef struct {
+    uint32_t pid;
+    char name[PROCESS_NAME_MAX];
+    process_state_t state;
+    uint8_t cpu;
+    uint32_t wakeups;
+    uint32_t wake_latency_total;  /* Ticks, summed over wakeups */
+    uint32_t wake_latency_max;
+} process_info_t;
+
 // Process management
-void process_init(void);
-uint32_t process_create(void (*entry_point)(void), const char *name);
-void process_kill(uint32_t pid);
-void process_switch(void);
+bool process_init(void);
+process_t *process_create(const char *name, process_entry_t entry);
+process_t *process_fork(process_t *parent);
+uint32_t process_map_anonymous(uint32_t size, bool writable);
+void process_destroy(process_t *process);
+bool process_kill(uint32_t pid);
+void process_exit(void) __attribute__((noreturn));
+void process_reap_zombies(void);
+process_t *process_get_by_pid(uint32_t pid);
+bool process_get_info(uint32_t pid, process_info_t *info);
+void process_schedule(void);
+void process_switch(process_t *next);
+void process_finish_switch(void);
+void process_set_current(process_t *process);
+void process_block(process_t *process);
+void process_wake(process_t *process);
 struct process *process_get_current(void);
+uint32_t process_get_count(void);
+bool process_is_initialized(void);
 void schedule(void);
 
-// System calls
-void syscall_init(void);
-
 #endif
 
 
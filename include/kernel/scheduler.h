@@ -0,0 +1,108 @@
+/**
+ * Maya OS Task Scheduler
+ * Per-CPU run queues with two classes: real-time FIFO/RR queues indexed
+ * by a priority bitmap, and a fair class ordered by weighted virtual
+ * runtime. Idle CPUs steal from busy ones.
+ * Author: AmanNagtodeOfficial
+ */
+#ifndef KERNEL_SCHEDULER_H
+#define KERNEL_SCHEDULER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "kernel/process.h"
+#include "kernel/spinlock.h"
+
+#define SCHED_PRIORITY_LEVELS 32   /* Priorities above 31 run at 31 */
+
+/* Scheduling classes; real-time tasks run before fair ones */
+#define SCHED_POLICY_FAIR   0   /* Default: CPU share weighted by priority  */
+#define SCHED_POLICY_FIFO   1   /* Real-time, runs until it blocks or yields */
+#define SCHED_POLICY_RR     2   /* Real-time, round robin within a priority */
+
+/* Real-time priorities, higher runs first; a bad task gets runtime/period */
+#define SCHED_RT_PRIORITY_MIN     0
+#define SCHED_RT_PRIORITY_MAX     (SCHED_PRIORITY_LEVELS - 1)
+#define SCHED_RT_RUNTIME_DEFAULT  950    /* ticks */
+#define SCHED_RT_PERIOD_DEFAULT   1000   /* ticks */
+
+/*
+ * One ordering over both classes for priority inheritance: fair priorities
+ * rank 1..32 and real-time ones 33..64, so any real-time task outranks any
+ * fair one. Rank 0 means nothing is inherited.
+ */
+#define SCHED_RANK_RT_BASE  SCHED_PRIORITY_LEVELS
+
+static inline uint8_t scheduler_rank(uint8_t policy, uint8_t priority) {
+    uint8_t level = priority < SCHED_PRIORITY_LEVELS ? priority : SCHED_PRIORITY_LEVELS - 1;
+    return (uint8_t)(level + 1 + (policy == SCHED_POLICY_FAIR ? 0 : SCHED_RANK_RT_BASE));
+}
+
+typedef struct {
+    uint32_t ready;      /* Tasks queued on this CPU        */
+    uint32_t fair_ready; /* Of those, in the fair class     */
+    uint32_t rt_throttled; /* Real-time budget exhaustions  */
+    uint32_t switches;
+    uint32_t steals;     /* Tasks taken from other CPUs     */
+    bool     idle;       /* Running its idle task right now */
+} scheduler_cpu_stats_t;
+
+/* Ticks from scheduler_wake() until the task ran */
+typedef struct {
+    uint32_t wakeups;
+    uint32_t latency_avg;
+    uint32_t latency_max;
+} scheduler_task_stats_t;
+
+bool       scheduler_init(void);
+bool       scheduler_init_cpu(uint32_t cpu);
+void       scheduler_run_idle(void) __attribute__((noreturn));
+bool       scheduler_add_task(process_t *process, uint8_t priority);
+
+/**
+ * Kill a task. One that no CPU runs, that waits on nothing and owns no
+ * contended mutex is terminated at once and true returned: the caller
+ * frees it. Any other is marked killed and woken; it unwinds its wait,
+ * hands its mutexes on and terminates itself at its next switch.
+ */
+bool       scheduler_remove_task(process_t *process);
+void       scheduler_switch_task(void);
+bool       scheduler_set_policy(process_t *process, uint8_t policy, uint8_t priority);
+
+/**
+ * Lend a task a scheduler rank, or withdraw it with 0. The task runs at
+ * the higher of its own policy/priority and the rank; a real-time rank
+ * runs it as FIFO. Used by mutexes for priority inheritance.
+ */
+void       scheduler_set_pi_rank(process_t *process, uint8_t rank);
+
+/**
+ * Move a kernel thread into the real-time class (SCHED_POLICY_FIFO or
+ * SCHED_POLICY_RR), e.g. audio refill or frame composition, so it preempts
+ * fair tasks as soon as it wakes.
+ */
+bool       scheduler_promote_rt(process_t *process, uint8_t policy, uint8_t priority);
+bool       scheduler_set_rt_bandwidth(uint32_t runtime, uint32_t period);
+bool       scheduler_get_task_stats(process_t *process, scheduler_task_stats_t *stats);
+
+/**
+ * Take a task off the run queue until scheduler_wake(). Blocking the
+ * current task switches away immediately, unless it was woken since it
+ * cleared wake_pending; callers recheck their condition in a loop.
+ * Returns false once the task is killed: it no longer sleeps, and a
+ * caller with a wait entry linked must unlink it and process_exit().
+ */
+bool       scheduler_block(process_t *process);
+void       scheduler_wake(process_t *process);
+
+process_t *scheduler_get_current_process(void);
+uint32_t   scheduler_get_task_count(void);
+uint32_t   scheduler_get_ready_count(void);
+uint32_t   scheduler_get_total_switches(void);
+bool       scheduler_get_cpu_stats(uint32_t cpu, scheduler_cpu_stats_t *stats);
+
+/* Run-queue lock contention; false unless built with SPINLOCK_STATS=1 */
+bool       scheduler_get_lock_stats(uint32_t cpu, spinlock_stats_t *stats);
+bool       scheduler_is_initialized(void);
+
+#endif /* KERNEL_SCHEDULER_H */
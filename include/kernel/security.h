@@ -22,6 +22,7 @@ bool     sec_grant_cap(uint32_t pid, uint32_t caps);
 bool     sec_check_cap(uint32_t pid, uint32_t cap);
 bool     sec_revoke_cap(uint32_t pid, uint32_t caps);
 uint32_t sec_get_caps(uint32_t pid);
+void     sec_release(uint32_t pid);
 bool     sec_is_initialized(void);
 
 #endif /* KERNEL_SECURITY_H */
@@ -0,0 +1,27 @@
+/**
+ * Maya OS Semaphore
+ * Counting semaphore; waiters sleep on a wait queue.
+ * Author: AmanNagtodeOfficial
+ */
+#ifndef KERNEL_SEMAPHORE_H
+#define KERNEL_SEMAPHORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "kernel/spinlock.h"
+#include "kernel/wait_queue.h"
+
+typedef struct {
+    int32_t value;
+    spinlock_t lock;          /* Guards value */
+    wait_queue_t waiters;
+} semaphore_t;
+
+void    semaphore_init(semaphore_t *sem, int32_t value);
+void    semaphore_wait(semaphore_t *sem);
+bool    semaphore_try_wait(semaphore_t *sem);
+void    semaphore_signal(semaphore_t *sem);
+int32_t semaphore_get_value(semaphore_t *sem);
+void    semaphore_destroy(semaphore_t *sem);
+
+#endif /* KERNEL_SEMAPHORE_H */
@@ -0,0 +1,44 @@
+/**
+ * Maya OS Slab Allocator
+ * Object caches for hot fixed-size kernel structures.
+ * Author: AmanNagtodeOfficial
+ */
+#ifndef KERNEL_SLAB_H
+#define KERNEL_SLAB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define KMEM_CACHE_NAME_MAX 32
+#define KMEM_MAX_CACHES     32
+#define KMEM_CACHE_LINE     64
+
+typedef void (*kmem_ctor_t)(void *obj);
+
+typedef struct kmem_cache kmem_cache_t;
+
+typedef struct {
+    const char *name;
+    uint32_t    object_size;
+    uint32_t    objects_per_slab;
+    uint32_t    hits;           /* Served from an existing partial slab */
+    uint32_t    misses;         /* Needed a fresh slab                  */
+    uint32_t    slabs;          /* Slabs currently owned by the cache   */
+    uint32_t    active_objects;
+} kmem_cache_stats_t;
+
+/**
+ * Create an object cache. Objects are handed out in the state the
+ * constructor left them and must be returned to kmem_cache_free() in
+ * that same state, so the constructor only runs when a slab is built.
+ */
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align,
+                                kmem_ctor_t ctor);
+void         *kmem_cache_alloc(kmem_cache_t *cache);
+void          kmem_cache_free(kmem_cache_t *cache, void *obj);
+void          kmem_cache_destroy(kmem_cache_t *cache);
+bool          kmem_cache_get_stats(kmem_cache_t *cache, kmem_cache_stats_t *stats);
+void          kmem_cache_dump_stats(void);
+
+#endif /* KERNEL_SLAB_H */
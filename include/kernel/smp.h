@@ -0,0 +1,35 @@
+/**
+ * Maya OS Symmetric Multiprocessing
+ * Application processor bring-up, per-CPU descriptors and IPIs.
+ * Author: AmanNagtodeOfficial
+ */
+#ifndef KERNEL_SMP_H
+#define KERNEL_SMP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "kernel/apic.h"
+
+#define SMP_MAX_CPUS        APIC_MAX_CPUS
+#define SMP_RESCHED_VECTOR  0xFC   /* Run the scheduler on the target CPU */
+#define SMP_TLB_VECTOR      0xFD   /* Invalidate a kernel address range   */
+
+/**
+ * Start every enabled processor listed in the MADT. Each AP gets its own
+ * GDT/TSS, local APIC timer, idle task and run queue before it is counted.
+ */
+bool     smp_init(void);
+
+/* Index of the calling CPU; the BSP is 0, also before smp_init() */
+uint32_t smp_cpu_index(void);
+uint32_t smp_cpu_count(void);
+uint32_t smp_cpu_apic_id(uint32_t cpu);
+void     smp_set_kernel_stack(uint32_t esp0);
+
+/* Kick a CPU into its scheduler, e.g. after queueing work on it */
+void     smp_send_reschedule(uint32_t cpu);
+
+/* Invalidate [start, last] on every other CPU and wait for them */
+void     smp_tlb_shootdown(uint32_t start, uint32_t last);
+
+#endif /* KERNEL_SMP_H */
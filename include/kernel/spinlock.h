@@ -0,0 +1,56 @@
+/**
+ * Maya OS Spinlocks
+ * Fair FIFO spinlocks that disable interrupts while held. Locks default
+ * to ticket locks; heavily contended ones can be made MCS queue locks,
+ * where each waiter spins on its own cache line. Per-lock contention
+ * statistics are kept when built with SPINLOCK_STATS=1.
+ * Author: AmanNagtodeOfficial
+ */
+#ifndef KERNEL_SPINLOCK_H
+#define KERNEL_SPINLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define SPINLOCK_TICKET  0
+#define SPINLOCK_MCS     1
+
+struct spinlock_mcs_node;
+
+typedef struct {
+    uint32_t acquisitions;
+    uint32_t contended;      /* Had to wait for another CPU        */
+    uint64_t spin_cycles;    /* TSC cycles spent waiting, in total */
+    uint64_t hold_max;       /* Longest hold, TSC cycles           */
+} spinlock_stats_t;
+
+/* Zero-initialised is an unlocked ticket lock */
+typedef struct {
+    volatile uint16_t owner;                  /* Ticket now being served  */
+    volatile uint16_t next;                   /* Next ticket to hand out  */
+    struct spinlock_mcs_node *volatile tail;  /* Last MCS waiter or holder */
+    struct spinlock_mcs_node *holder;         /* MCS node of the holder    */
+    uint8_t mode;                             /* SPINLOCK_TICKET or _MCS  */
+    int cpu;                                  /* Holding CPU, or -1       */
+    uint32_t interrupt_flags;                 /* Saved by the holder      */
+#ifdef CONFIG_SPINLOCK_STATS
+    uint64_t hold_start;
+    spinlock_stats_t stats;
+#endif
+} spinlock_t;
+
+void spinlock_init(spinlock_t *lock);
+
+/* For locks many CPUs fight over: waiters queue instead of sharing a line */
+void spinlock_init_mcs(spinlock_t *lock);
+
+void spinlock_acquire(spinlock_t *lock);
+bool spinlock_try_acquire(spinlock_t *lock);
+void spinlock_release(spinlock_t *lock);
+bool spinlock_is_locked(spinlock_t *lock);
+int  spinlock_get_cpu(spinlock_t *lock);
+
+/* False unless built with SPINLOCK_STATS=1 */
+bool spinlock_get_stats(spinlock_t *lock, spinlock_stats_t *stats);
+
+#endif /* KERNEL_SPINLOCK_H */
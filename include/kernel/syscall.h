@@ -0,0 +1,26 @@
+/**
+ * Maya OS System Call Handler
+ * Registration and dispatch of int 0x80 system calls.
+ * Author: AmanNagtodeOfficial
+ */
+#ifndef KERNEL_SYSCALL_H
+#define KERNEL_SYSCALL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "kernel/interrupts.h"
+
+typedef uint32_t (*syscall_handler_t)(uint32_t args[], uint32_t arg_count);
+
+bool        syscall_init(void);
+void        syscall_init_defaults(void);
+bool        syscall_register(uint32_t num, syscall_handler_t handler,
+                             const char* name, uint32_t arg_count);
+const char* syscall_get_name(uint32_t num);
+uint32_t    syscall_get_count(void);
+bool        syscall_is_initialized(void);
+
+/* Trap frame of the system call being serviced (NULL outside one) */
+struct registers* syscall_get_frame(void);
+
+#endif /* KERNEL_SYSCALL_H */
@@ -2,9 +2,54 @@
 #define TIMER_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
-void timer_init(uint32_t frequency);
+#define TIMER_NO_DEADLINE 0xFFFFFFFF
+
+/* Runs from every CPU's timer interrupt with the current tick count */
+typedef void (*timer_callback_t)(uint32_t tick_count);
+
+/* Absolute tick of a source's next timeout, or TIMER_NO_DEADLINE */
+typedef uint32_t (*timer_deadline_fn_t)(void);
+typedef void (*timer_expire_fn_t)(void);
+
+typedef struct {
+    uint32_t oneshots;       /* Idle periods spent with the tick stopped */
+    uint32_t ticks_skipped;  /* Periodic ticks those periods replaced    */
+    bool     tickless;
+} timer_idle_stats_t;
+
+struct process;
+
+bool timer_init(void);
+void timer_init_ap(void);
+void timer_set_callback(timer_callback_t callback);
+
+/* Start the task deadline sources expire in; needs the scheduler */
+bool timer_start_worker(void);
+
+/*
+ * Block the calling task on the sleep queue, a min-heap keyed by wake
+ * tick; the timer interrupt only looks at its top. Boot code waits in hlt.
+ */
+void timer_sleep(uint32_t milliseconds);
+void timer_cancel_sleep(struct process *process);
+
+/*
+ * Tickless idle: stop the periodic tick and arm a one-shot for the nearest
+ * deadline, then restart it once the CPU has work. Interrupts must be off.
+ */
+void timer_idle_enter(void);
+void timer_idle_exit(void);
+
+/*
+ * Wake tickless CPUs for this source. Once due, expire() runs in the timer
+ * worker task, so it may allocate and block.
+ */
+bool timer_register_deadline(timer_deadline_fn_t next, timer_expire_fn_t expire);
+bool timer_get_idle_stats(uint32_t cpu, timer_idle_stats_t *stats);
 uint32_t timer_get_tick(void);
+uint32_t timer_get_ticks(void);
 void timer_wait(uint32_t ticks);
 void sleep(uint32_t ms);
 
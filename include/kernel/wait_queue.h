@@ -0,0 +1,62 @@
+/**
+ * Maya OS Wait Queues
+ * A list of blocked tasks. Entries are embedded in the waiter's stack
+ * frame, so waiting never allocates; woken tasks go back on a run queue.
+ * Author: AmanNagtodeOfficial
+ */
+#ifndef KERNEL_WAIT_QUEUE_H
+#define KERNEL_WAIT_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "kernel/process.h"
+#include "kernel/spinlock.h"
+
+#define WAIT_QUEUE_ALL 0xFFFFFFFF
+
+struct wait_queue;
+
+typedef struct wait_entry {
+    process_t *process;
+    struct wait_queue *wq;          /* Queue it was last prepared on */
+    volatile bool queued;           /* Cleared by the waker as it dequeues */
+    struct wait_entry *next;
+    struct wait_entry *prev;
+} wait_entry_t;
+
+typedef struct wait_queue {
+    spinlock_t lock;
+    wait_entry_t *head;             /* Woken oldest first */
+    wait_entry_t *tail;
+} wait_queue_t;
+
+void wait_queue_init(wait_queue_t *wq);
+
+/* Bind `entry` to the calling task; it may then be queued repeatedly */
+void wait_entry_init(wait_entry_t *entry);
+
+/**
+ * Queue `entry` before checking the condition waited for; a wake that
+ * comes after this point is never lost. Then wait_queue_sleep(), or
+ * wait_queue_finish() if the condition turned out to hold already.
+ * A task killed in wait_queue_sleep() leaves the queue and exits there.
+ */
+void wait_queue_prepare(wait_queue_t *wq, wait_entry_t *entry);
+void wait_queue_sleep(wait_entry_t *entry);
+void wait_queue_finish(wait_queue_t *wq, wait_entry_t *entry);
+
+/**
+ * Sleep once with the caller's `lock` dropped and retake it. The caller
+ * holds `lock` across its condition check and in every waker, and
+ * rechecks the condition in a loop.
+ */
+void wait_queue_sleep_locked(wait_queue_t *wq, spinlock_t *lock);
+
+/* Dequeue and wake up to `count` waiters; returns how many */
+uint32_t wait_queue_wake(wait_queue_t *wq, uint32_t count);
+#define wait_queue_wake_one(wq) wait_queue_wake((wq), 1)
+#define wait_queue_wake_all(wq) wait_queue_wake((wq), WAIT_QUEUE_ALL)
+
+bool wait_queue_empty(wait_queue_t *wq);
+
+#endif /* KERNEL_WAIT_QUEUE_H */
@@ -0,0 +1,33 @@
+#ifndef SYNC_H
+#define SYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * User-space mutex and condition variable on the futex system calls.
+ * Uncontended lock/unlock never enter the kernel. Both are plain words:
+ * zero-initialise them or use the initializers.
+ */
+typedef struct {
+    volatile uint32_t state;   /* 0 free, 1 locked, 2 locked with waiters */
+} sync_mutex_t;
+
+typedef struct {
+    volatile uint32_t seq;     /* Bumped by every signal/broadcast */
+} sync_cond_t;
+
+#define SYNC_MUTEX_INIT { 0 }
+#define SYNC_COND_INIT  { 0 }
+
+void sync_mutex_init(sync_mutex_t *mutex);
+void sync_mutex_lock(sync_mutex_t *mutex);
+bool sync_mutex_trylock(sync_mutex_t *mutex);
+void sync_mutex_unlock(sync_mutex_t *mutex);
+
+void sync_cond_init(sync_cond_t *cond);
+void sync_cond_wait(sync_cond_t *cond, sync_mutex_t *mutex);
+void sync_cond_signal(sync_cond_t *cond);
+void sync_cond_broadcast(sync_cond_t *cond);
+
+#endif
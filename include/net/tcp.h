@@ -29,6 +29,7 @@ bool tcp_connect(tcp_socket_t* socket, uint32_t ip, uint16_t port);
 void tcp_close(tcp_socket_t* socket);
 bool tcp_send(tcp_socket_t* socket, const void* data, size_t length);
 void tcp_handle_packet(uint32_t src_ip, const void* packet, size_t length);
+void tcp_periodic_check(void);
 bool tcp_is_initialized(void);
 
 #endif
@@ -5,6 +5,7 @@
  */
 
 #include "kernel/acpi.h"
+#include "kernel/kernel.h"
 #include "kernel/memory.h"
 #include "libc/string.h"
 
@@ -22,18 +23,6 @@ typedef struct {
     uint32_t rsdt_address;
 } __attribute__((packed)) acpi_rsdp_t;
 
-typedef struct {
-    char signature[4];
-    uint32_t length;
-    uint8_t revision;
-    uint8_t checksum;
-    char oem_id[6];
-    char oem_table_id[8];
-    uint32_t oem_revision;
-    uint32_t creator_id;
-    uint32_t creator_revision;
-} __attribute__((packed)) acpi_header_t;
-
 typedef struct {
     acpi_header_t header;
     uint32_t tables[];
@@ -5,6 +5,7 @@
  */
 
 #include "kernel/apic.h"
+#include "kernel/kernel.h"
 #include "kernel/memory.h"
 #include "kernel/acpi.h"
 #include "libc/string.h"
@@ -32,6 +33,13 @@
 #define APIC_REG_TIMER_COUNT 0x390
 #define APIC_REG_TIMER_DIV 0x3E0
 
+#define APIC_ICR_INIT        0x00000500
+#define APIC_ICR_STARTUP     0x00000600
+#define APIC_ICR_PENDING     0x00001000  /* Delivery status: send pending */
+#define APIC_ICR_ASSERT      0x00004000
+#define APIC_ICR_LEVEL       0x00008000
+#define APIC_ICR_ALL_BUT_SELF 0x000C0000
+
 typedef struct {
     acpi_header_t header;
     uint32_t local_apic_addr;
@@ -62,6 +70,8 @@ static struct {
     void* apic_base;
     void* ioapic_base;
     uint32_t bsp_apic_id;
+    uint8_t cpu_apic_ids[APIC_MAX_CPUS];  /* Enabled processors from the MADT */
+    uint32_t cpu_count;
     bool initialized;
 } apic_state;
 
@@ -83,6 +93,32 @@ static void ioapic_write(uint32_t reg, uint32_t value) {
     *(volatile uint32_t*)((uintptr_t)apic_state.ioapic_base + 0x10) = value;
 }
 
+// Software-enable this CPU's local APIC with every LVT entry masked
+static void apic_enable_local(void) {
+    uint64_t msr = rdmsr(APIC_BASE_MSR);
+    msr |= APIC_BASE_MSR_ENABLE;
+    wrmsr(APIC_BASE_MSR, msr);
+
+    // Configure Spurious Interrupt Vector Register
+    apic_write(APIC_REG_SVR, APIC_SPURIOUS_VECTOR | 0x100);
+
+    // Disable all LVT entries
+    apic_write(APIC_REG_LVT_TIMER, 0x10000);
+    apic_write(APIC_REG_LVT_THERMAL, 0x10000);
+    apic_write(APIC_REG_LVT_PERF, 0x10000);
+    apic_write(APIC_REG_LVT_LINT0, 0x10000);
+    apic_write(APIC_REG_LVT_LINT1, 0x10000);
+    apic_write(APIC_REG_LVT_ERROR, 0x10000);
+    apic_write(APIC_REG_TPR, 0);
+}
+
+// Wait for the previous IPI to leave the ICR
+static void apic_wait_icr(void) {
+    while (apic_read(APIC_REG_ICR_LOW) & APIC_ICR_PENDING) {
+        __asm__ volatile("pause");
+    }
+}
+
 bool apic_init(void) {
     if (apic_state.initialized) {
         return true;
@@ -110,10 +146,8 @@ bool apic_init(void) {
         switch (header->type) {
             case 0: { // Local APIC
                 madt_lapic_entry_t* lapic = (madt_lapic_entry_t*)entry;
-                if (lapic->flags & 1) { // Processor enabled
-                    if (lapic->acpi_processor_id == 0) {
-                        apic_state.bsp_apic_id = lapic->apic_id;
-                    }
+                if ((lapic->flags & 1) && apic_state.cpu_count < APIC_MAX_CPUS) { // Processor enabled
+                    apic_state.cpu_apic_ids[apic_state.cpu_count++] = lapic->apic_id;
                 }
                 break;
             }
@@ -128,26 +162,26 @@ bool apic_init(void) {
         entry += header->length;
     }
 
-    // Enable APIC
-    uint64_t msr = rdmsr(APIC_BASE_MSR);
-    msr |= APIC_BASE_MSR_ENABLE;
-    wrmsr(APIC_BASE_MSR, msr);
-
-    // Configure Spurious Interrupt Vector Register
-    apic_write(APIC_REG_SVR, APIC_SPURIOUS_VECTOR | 0x100);
+    apic_enable_local();
 
-    // Disable all LVT entries
-    apic_write(APIC_REG_LVT_TIMER, 0x10000);
-    apic_write(APIC_REG_LVT_THERMAL, 0x10000);
-    apic_write(APIC_REG_LVT_PERF, 0x10000);
-    apic_write(APIC_REG_LVT_LINT0, 0x10000);
-    apic_write(APIC_REG_LVT_LINT1, 0x10000);
-    apic_write(APIC_REG_LVT_ERROR, 0x10000);
+    // apic_init() runs on the boot processor
+    apic_state.bsp_apic_id = (apic_read(APIC_REG_ID) >> 24) & 0xFF;
 
     apic_state.initialized = true;
     return true;
 }
 
+/**
+ * apic_init_ap – Enable the calling application processor's local APIC.
+ * The MMIO window is at the same physical address on every CPU.
+ */
+void apic_init_ap(void) {
+    if (!apic_state.initialized) {
+        return;
+    }
+    apic_enable_local();
+}
+
 void apic_eoi(void) {
     if (!apic_state.initialized) {
         return;
@@ -160,10 +194,44 @@ void apic_send_ipi(uint32_t apic_id, uint32_t vector) {
         return;
     }
 
+    apic_wait_icr();
     apic_write(APIC_REG_ICR_HIGH, apic_id << 24);
     apic_write(APIC_REG_ICR_LOW, vector);
 }
 
+// Fixed-delivery IPI to every CPU except the sender
+void apic_send_ipi_all_but_self(uint32_t vector) {
+    if (!apic_state.initialized) {
+        return;
+    }
+
+    apic_wait_icr();
+    apic_write(APIC_REG_ICR_LOW, APIC_ICR_ALL_BUT_SELF | vector);
+}
+
+void apic_send_init(uint32_t apic_id) {
+    if (!apic_state.initialized) {
+        return;
+    }
+
+    apic_wait_icr();
+    apic_write(APIC_REG_ICR_HIGH, apic_id << 24);
+    apic_write(APIC_REG_ICR_LOW, APIC_ICR_INIT | APIC_ICR_LEVEL | APIC_ICR_ASSERT);
+    apic_wait_icr();
+}
+
+// Start an AP in real mode at physical address page << 12
+void apic_send_startup(uint32_t apic_id, uint8_t page) {
+    if (!apic_state.initialized) {
+        return;
+    }
+
+    apic_wait_icr();
+    apic_write(APIC_REG_ICR_HIGH, apic_id << 24);
+    apic_write(APIC_REG_ICR_LOW, APIC_ICR_STARTUP | page);
+    apic_wait_icr();
+}
+
 uint32_t apic_get_id(void) {
     if (!apic_state.initialized) {
         return 0;
@@ -208,6 +276,18 @@ void apic_stop_timer(void) {
     apic_write(APIC_REG_TIMER_INIT, 0);
 }
 
+uint32_t apic_get_cpu_count(void) {
+    return apic_state.cpu_count;
+}
+
+uint32_t apic_get_cpu_apic_id(uint32_t index) {
+    return index < apic_state.cpu_count ? apic_state.cpu_apic_ids[index] : 0xFF;
+}
+
+uint32_t apic_get_bsp_id(void) {
+    return apic_state.bsp_apic_id;
+}
+
 bool apic_is_initialized(void) {
     return apic_state.initialized;
 }
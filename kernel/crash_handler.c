@@ -7,6 +7,7 @@
 #include "kernel/crash_handler.h"
 #include "kernel/logging.h"
 #include "kernel/interrupts.h"
+#include "kernel/memory.h"
 #include "drivers/vga.h"
 #include "drivers/serial.h"
 #include "libc/stdio.h"
@@ -42,6 +43,12 @@ static void fault_general_protection(struct regs *r) {
 static void fault_page_fault(struct regs *r) {
     uint32_t cr2;
     __asm__ volatile("mov %%cr2, %0" : "=r"(cr2));
+
+    /* Copy-on-write and demand-zero faults are part of normal operation */
+    if (vmm_handle_page_fault(cr2, r->err_code)) {
+        return;
+    }
+
     char msg[64];
     snprintf(msg, sizeof(msg), "Page Fault at CR2=%08x (error=%08x)", cr2, r->err_code);
     crash_dump(r, msg);
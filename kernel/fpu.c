@@ -0,0 +1,207 @@
+/**
+ * Maya OS FPU/SSE Context Management
+ * Author: AmanNagtodeOfficial
+ *
+ * Every context switch sets CR0.TS, so the first FPU, MMX or SSE
+ * instruction a task executes raises #NM. The handler loads that task's
+ * FXSAVE area, or skips the load when this CPU's registers still hold it,
+ * and clears TS. A task only pays for FXSAVE when it is switched out after
+ * using the FPU in that slice; tasks that never touch it pay nothing.
+ *
+ * Interrupt handlers must not use FPU/SSE instructions: they would run on
+ * the interrupted task's registers.
+ */
+
+#include "kernel/fpu.h"
+#include "kernel/smp.h"
+#include "kernel/slab.h"
+#include "kernel/interrupts.h"
+#include "kernel/logging.h"
+#include "libc/string.h"
+
+#define FPU_VECTOR          7        /* #NM, device not available */
+#define FPU_NO_CPU          0xFF     /* Registers of no CPU hold the task's state */
+#define FPU_MXCSR_DEFAULT   0x1F80   /* All SIMD exceptions masked */
+
+#define CR0_MP              (1u << 1)
+#define CR0_EM              (1u << 2)
+#define CR0_TS              (1u << 3)
+#define CR0_NE              (1u << 5)
+#define CR4_OSFXSR          (1u << 9)
+#define CR4_OSXMMEXCPT      (1u << 10)
+#define CPUID_EDX_FXSR      (1u << 24)
+
+static struct {
+    kmem_cache_t* cache;                  // FXSAVE areas, 16-byte aligned
+    process_t* owner[SMP_MAX_CPUS];       // Task whose state each CPU last loaded
+    uint8_t initial[FPU_STATE_SIZE] __attribute__((aligned(16)));
+    fpu_stats_t stats;
+    bool initialized;
+} fpu_state;
+
+/* ─── low level ────────────────────────────────────────────────── */
+
+static inline uint32_t read_cr0(void) {
+    uint32_t cr0;
+    __asm__ volatile("mov %%cr0, %0" : "=r"(cr0));
+    return cr0;
+}
+
+static inline void write_cr0(uint32_t cr0) {
+    __asm__ volatile("mov %0, %%cr0" : : "r"(cr0));
+}
+
+static inline void fxsave(void* area) {
+    __asm__ volatile("fxsave (%0)" : : "r"(area) : "memory");
+}
+
+static inline void fxrstor(const void* area) {
+    __asm__ volatile("fxrstor (%0)" : : "r"(area) : "memory");
+}
+
+// Enable FXSAVE/SSE on the calling CPU and arm the first #NM
+static void fpu_setup_cpu(void) {
+    uint32_t cr4;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_OSFXSR | CR4_OSXMMEXCPT;
+    __asm__ volatile("mov %0, %%cr4" : : "r"(cr4));
+
+    write_cr0((read_cr0() & ~CR0_EM) | CR0_MP | CR0_NE | CR0_TS);
+}
+
+/* ─── #NM handler ──────────────────────────────────────────────── */
+
+static void fpu_trap(struct registers* r) {
+    (void)r;
+    uint32_t cpu = smp_cpu_index();
+    process_t* current = process_get_current();
+
+    __asm__ volatile("clts");
+    __sync_fetch_and_add(&fpu_state.stats.traps, 1);
+
+    // Boot code before the first task has no state to preserve
+    if (!current) {
+        return;
+    }
+
+    // First FPU use: start from a clean FNINIT image
+    if (!current->fpu_state) {
+        current->fpu_state = kmem_cache_alloc(fpu_state.cache);
+        if (!current->fpu_state) {
+            KLOG_E("FPU: no save area for pid %u", current->pid);
+            __asm__ volatile("fninit");
+            return;
+        }
+        memcpy(current->fpu_state, fpu_state.initial, FPU_STATE_SIZE);
+        current->fpu_cpu = FPU_NO_CPU;
+    }
+
+    if (fpu_state.owner[cpu] == current && current->fpu_cpu == cpu) {
+        __sync_fetch_and_add(&fpu_state.stats.reuses, 1);
+    } else {
+        fxrstor(current->fpu_state);
+        __sync_fetch_and_add(&fpu_state.stats.restores, 1);
+    }
+
+    fpu_state.owner[cpu] = current;
+    current->fpu_cpu = (uint8_t)cpu;
+}
+
+/* ─── public API ───────────────────────────────────────────────── */
+
+bool fpu_init(void) {
+    if (fpu_state.initialized) {
+        return true;
+    }
+
+    uint32_t eax = 1, ebx, ecx, edx;
+    __asm__ volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    if (!(edx & CPUID_EDX_FXSR)) {
+        KLOG_W("FPU: FXSAVE not supported, FPU state is not switched");
+        return false;
+    }
+
+    fpu_state.cache = kmem_cache_create("fpu_state", FPU_STATE_SIZE, 16, NULL);
+    if (!fpu_state.cache) {
+        return false;
+    }
+
+    // Capture the power-on register image every task starts from
+    uint32_t mxcsr = FPU_MXCSR_DEFAULT;
+    fpu_setup_cpu();
+    __asm__ volatile("clts; fninit; ldmxcsr %0" : : "m"(mxcsr));
+    fxsave(fpu_state.initial);
+    write_cr0(read_cr0() | CR0_TS);
+
+    register_interrupt_handler(FPU_VECTOR, fpu_trap);
+
+    fpu_state.initialized = true;
+    return true;
+}
+
+void fpu_init_ap(void) {
+    if (fpu_state.initialized) {
+        fpu_setup_cpu();
+    }
+}
+
+void fpu_switch(process_t* prev) {
+    if (!fpu_state.initialized) {
+        return;
+    }
+
+    // TS is only ever clear after prev took #NM in this slice
+    uint32_t cr0 = read_cr0();
+    if (cr0 & CR0_TS) {
+        return;
+    }
+    if (prev && prev->fpu_state) {
+        fxsave(prev->fpu_state);
+        __sync_fetch_and_add(&fpu_state.stats.saves, 1);
+    }
+    write_cr0(cr0 | CR0_TS);
+}
+
+bool fpu_fork(process_t* parent, process_t* child) {
+    child->fpu_state = NULL;
+    child->fpu_cpu = FPU_NO_CPU;
+    if (!fpu_state.initialized || !parent->fpu_state) {
+        return true;
+    }
+
+    child->fpu_state = kmem_cache_alloc(fpu_state.cache);
+    if (!child->fpu_state) {
+        return false;
+    }
+
+    // The parent's live registers are newer than its save area
+    if (!(read_cr0() & CR0_TS)) {
+        fxsave(parent->fpu_state);
+    }
+    memcpy(child->fpu_state, parent->fpu_state, FPU_STATE_SIZE);
+    return true;
+}
+
+void fpu_release(process_t* process) {
+    if (!fpu_state.initialized || !process) {
+        return;
+    }
+
+    for (uint32_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        if (fpu_state.owner[cpu] == process) {
+            fpu_state.owner[cpu] = NULL;
+        }
+    }
+    if (process->fpu_state) {
+        kmem_cache_free(fpu_state.cache, process->fpu_state);
+        process->fpu_state = NULL;
+    }
+}
+
+bool fpu_get_stats(fpu_stats_t* stats) {
+    if (!fpu_state.initialized || !stats) {
+        return false;
+    }
+    *stats = fpu_state.stats;
+    return true;
+}
@@ -0,0 +1,188 @@
+/**
+ * Maya OS Futex
+ * Author: AmanNagtodeOfficial
+ *
+ * Waiters are keyed on (address space, user address) and hashed into a
+ * fixed table of buckets, each with its own lock, so unrelated locks do
+ * not contend in the kernel and nothing is allocated per futex. A waiter
+ * entry lives on the sleeping task's kernel stack. futex_wait() reads the
+ * word under the bucket lock, which futex_wake() also takes, so a wake
+ * that follows the user-space store cannot slip in before the sleep.
+ */
+
+#include "kernel/futex.h"
+#include "kernel/process.h"
+#include "kernel/scheduler.h"
+#include "kernel/spinlock.h"
+#include "kernel/memory.h"
+#include "kernel/logging.h"
+
+#define FUTEX_HASH_BITS  6
+#define FUTEX_BUCKETS    (1u << FUTEX_HASH_BITS)
+
+typedef struct futex_waiter {
+    process_t* process;
+    uint32_t space;                  // Page directory of the waiter
+    uint32_t addr;
+    volatile bool queued;            // Cleared by the waker
+    struct futex_waiter* next;
+} futex_waiter_t;
+
+typedef struct {
+    spinlock_t lock;
+    futex_waiter_t* head;            // FIFO: wakes go to the oldest waiter
+    futex_waiter_t* tail;
+} futex_bucket_t;
+
+static struct {
+    futex_bucket_t buckets[FUTEX_BUCKETS];
+    futex_stats_t stats;
+    bool initialized;
+} futex_state;
+
+static inline futex_bucket_t* futex_bucket(uint32_t space, uint32_t addr) {
+    uint32_t key = (addr >> 2) ^ (space >> 12);
+    return &futex_state.buckets[(key * 2654435761u) >> (32 - FUTEX_HASH_BITS)];
+}
+
+// The word must be a whole, aligned user word in the caller's space
+static bool futex_key(volatile uint32_t* addr, uint32_t* space) {
+    process_t* current = process_get_current();
+    if (!current || ((uint32_t)addr & 3) ||
+        !memory_validate_user_buffer((const void*)addr, sizeof(uint32_t))) {
+        return false;
+    }
+    *space = current->page_directory;
+    return true;
+}
+
+bool futex_init(void) {
+    if (futex_state.initialized) {
+        return true;
+    }
+
+    for (uint32_t i = 0; i < FUTEX_BUCKETS; i++) {
+        spinlock_init(&futex_state.buckets[i].lock);
+        futex_state.buckets[i].head = NULL;
+        futex_state.buckets[i].tail = NULL;
+    }
+
+    futex_state.initialized = true;
+    KLOG_I("Futex: %u wait buckets", FUTEX_BUCKETS);
+    return true;
+}
+
+// Caller holds bucket->lock; `prev` is the waiter before it, or NULL
+static void futex_unlink(futex_bucket_t* bucket, futex_waiter_t* prev, futex_waiter_t* waiter) {
+    if (prev) {
+        prev->next = waiter->next;
+    } else {
+        bucket->head = waiter->next;
+    }
+    if (bucket->tail == waiter) {
+        bucket->tail = prev;
+    }
+}
+
+// A killed waiter leaves its bucket, unless a waker already took it out
+static void futex_cancel(futex_bucket_t* bucket, futex_waiter_t* waiter) {
+    spinlock_acquire(&bucket->lock);
+    if (waiter->queued) {
+        futex_waiter_t* prev = NULL;
+        for (futex_waiter_t* it = bucket->head; it != waiter; it = it->next) {
+            prev = it;
+        }
+        futex_unlink(bucket, prev, waiter);
+        waiter->queued = false;
+    }
+    waiter->process->waiting = false;
+    spinlock_release(&bucket->lock);
+}
+
+int futex_wait(volatile uint32_t* addr, uint32_t expected) {
+    uint32_t space;
+    if (!futex_state.initialized || !futex_key(addr, &space)) {
+        return -1;
+    }
+    // The word is read under the bucket lock, where a page fault must not happen
+    if (!vmm_fault_in((uint32_t)addr)) {
+        return -1;
+    }
+
+    process_t* current = process_get_current();
+    futex_waiter_t waiter = {
+        .process = current, .space = space, .addr = (uint32_t)addr,
+        .queued = true, .next = NULL,
+    };
+    futex_bucket_t* bucket = futex_bucket(space, (uint32_t)addr);
+
+    spinlock_acquire(&bucket->lock);
+    if (*addr != expected) {
+        spinlock_release(&bucket->lock);
+        __sync_fetch_and_add(&futex_state.stats.mismatches, 1);
+        return -1;
+    }
+    if (bucket->tail) {
+        bucket->tail->next = &waiter;
+    } else {
+        bucket->head = &waiter;
+    }
+    bucket->tail = &waiter;
+    current->waiting = true;
+    current->wake_pending = false;
+    spinlock_release(&bucket->lock);
+
+    __sync_fetch_and_add(&futex_state.stats.waits, 1);
+    while (waiter.queued) {
+        if (!scheduler_block(current)) {
+            futex_cancel(bucket, &waiter);
+            process_exit();
+        }
+    }
+    current->waiting = false;
+    return 0;
+}
+
+uint32_t futex_wake(volatile uint32_t* addr, uint32_t count) {
+    uint32_t space;
+    if (!futex_state.initialized || !count || !futex_key(addr, &space)) {
+        return 0;
+    }
+
+    futex_bucket_t* bucket = futex_bucket(space, (uint32_t)addr);
+    uint32_t woken = 0;
+
+    spinlock_acquire(&bucket->lock);
+    futex_waiter_t* prev = NULL;
+    futex_waiter_t* waiter = bucket->head;
+    while (waiter && woken < count) {
+        futex_waiter_t* next = waiter->next;
+        if (waiter->space != space || waiter->addr != (uint32_t)addr) {
+            prev = waiter;
+            waiter = next;
+            continue;
+        }
+
+        futex_unlink(bucket, prev, waiter);
+
+        // The entry is on the waiter's stack: done with it once it is unqueued
+        process_t* process = waiter->process;
+        __sync_synchronize();
+        waiter->queued = false;
+        scheduler_wake(process);
+        woken++;
+        waiter = next;
+    }
+    spinlock_release(&bucket->lock);
+
+    __sync_fetch_and_add(&futex_state.stats.wakes, woken);
+    return woken;
+}
+
+bool futex_get_stats(futex_stats_t* stats) {
+    if (!futex_state.initialized || !stats) {
+        return false;
+    }
+    *stats = futex_state.stats;
+    return true;
+}
@@ -0,0 +1,260 @@
+/**
+ * Maya OS Heap Profiler
+ * Per-call-site allocation accounting, compiled in with HEAP_PROFILE=1.
+ * Author: AmanNagtodeOfficial
+ */
+
+#include "kernel/heap_profile.h"
+
+#ifdef CONFIG_HEAP_PROFILE
+
+#include "kernel/spinlock.h"
+#include "kernel/timer.h"
+#include "kernel/logging.h"
+#include "libc/string.h"
+
+#define TRACKED_MASK   (HEAP_PROFILE_TRACKED - 1)
+#define SITES_MASK     (HEAP_PROFILE_SITES - 1)
+#define SITE_OVERFLOW  (HEAP_PROFILE_SITES - 1)   /* Catch-all once the table fills */
+
+/* One live allocation, kept in an open-addressed table keyed by pointer */
+typedef struct {
+    uintptr_t ptr;
+    uint32_t  size;
+    uint32_t  site;
+    uint32_t  tick;
+} tracked_alloc_t;
+
+static struct {
+    heap_profile_site_t sites[HEAP_PROFILE_SITES];
+    uint32_t            site_count;
+    tracked_alloc_t     live[HEAP_PROFILE_TRACKED];
+    uint32_t            live_count;
+    uint32_t            untracked;      /* Allocations dropped: table full */
+    uint64_t            untracked_bytes;
+    uint64_t            total_allocated;
+    uint64_t            total_freed;
+    uint32_t            allocation_count;
+    uint32_t            free_count;
+    uint32_t            current_usage;
+    uint32_t            peak_usage;
+    spinlock_t          lock;
+} prof;
+
+static inline uint32_t hash_ptr(uintptr_t value) {
+    return (uint32_t)(value >> 3) * 2654435761u;
+}
+
+static inline uint32_t live_home(uintptr_t ptr) {
+    return hash_ptr(ptr) & TRACKED_MASK;
+}
+
+static uint32_t lifetime_bucket(uint32_t ms) {
+    if (ms == 0) {
+        return 0;
+    }
+    uint32_t bucket = 1 + (31 - __builtin_clz(ms)) / 2;
+    return bucket < HEAP_PROFILE_LIFETIMES ? bucket : HEAP_PROFILE_LIFETIMES - 1;
+}
+
+/* Site slot for a caller; the last slot absorbs everything once full */
+static uint32_t site_lookup(uintptr_t caller) {
+    uint32_t slot = hash_ptr(caller) & SITES_MASK;
+    for (uint32_t probe = 0; probe < SITE_OVERFLOW; probe++) {
+        if (slot == SITE_OVERFLOW) {
+            slot = 0;
+        }
+        heap_profile_site_t *site = &prof.sites[slot];
+        if (site->caller == caller) {
+            return slot;
+        }
+        if (site->caller == 0 && site->allocs == 0) {
+            site->caller = caller;
+            prof.site_count++;
+            return slot;
+        }
+        slot++;
+    }
+    return SITE_OVERFLOW;
+}
+
+/* Remove one live entry, shifting later probes back (no tombstones) */
+static void live_remove(uint32_t slot) {
+    uint32_t hole = slot;
+    uint32_t next = slot;
+    for (;;) {
+        next = (next + 1) & TRACKED_MASK;
+        if (!prof.live[next].ptr) {
+            break;
+        }
+        uint32_t home = live_home(prof.live[next].ptr);
+        bool stays = (hole <= next) ? (hole < home && home <= next)
+                                    : (hole < home || home <= next);
+        if (!stays) {
+            prof.live[hole] = prof.live[next];
+            hole = next;
+        }
+    }
+    prof.live[hole].ptr = 0;
+    prof.live_count--;
+}
+
+/* ─── hooks called by kernel/memory.c ──────────────────────────── */
+
+void heap_profile_record_alloc(void *ptr, size_t size, void *caller) {
+    if (!ptr) {
+        return;
+    }
+
+    spinlock_acquire(&prof.lock);
+
+    uint32_t index = site_lookup((uintptr_t)caller);
+    heap_profile_site_t *site = &prof.sites[index];
+    site->allocs++;
+    site->bytes += size;
+    prof.total_allocated += size;
+    prof.allocation_count++;
+
+    /* Keep the table at most 3/4 full so probe chains stay short. Live
+       figures only cover tracked allocations: a free can only take back
+       what it finds here. */
+    if (prof.live_count < HEAP_PROFILE_TRACKED / 4 * 3) {
+        uint32_t slot = live_home((uintptr_t)ptr);
+        while (prof.live[slot].ptr) {
+            slot = (slot + 1) & TRACKED_MASK;
+        }
+        prof.live[slot].ptr  = (uintptr_t)ptr;
+        prof.live[slot].size = (uint32_t)size;
+        prof.live[slot].site = index;
+        prof.live[slot].tick = timer_get_ticks();
+        prof.live_count++;
+
+        site->live_count++;
+        site->live_bytes += (uint32_t)size;
+        if (site->live_bytes > site->peak_live_bytes) {
+            site->peak_live_bytes = site->live_bytes;
+        }
+        prof.current_usage += (uint32_t)size;
+        if (prof.current_usage > prof.peak_usage) {
+            prof.peak_usage = prof.current_usage;
+        }
+    } else {
+        prof.untracked++;
+        prof.untracked_bytes += size;
+    }
+
+    spinlock_release(&prof.lock);
+}
+
+void heap_profile_record_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    spinlock_acquire(&prof.lock);
+
+    uint32_t slot = live_home((uintptr_t)ptr);
+    while (prof.live[slot].ptr && prof.live[slot].ptr != (uintptr_t)ptr) {
+        slot = (slot + 1) & TRACKED_MASK;
+    }
+
+    if (prof.live[slot].ptr) {
+        tracked_alloc_t *entry = &prof.live[slot];
+        heap_profile_site_t *site = &prof.sites[entry->site];
+        site->frees++;
+        site->live_count--;
+        site->live_bytes -= entry->size;
+        site->lifetime[lifetime_bucket(timer_get_ticks() - entry->tick)]++;
+
+        prof.total_freed += entry->size;
+        prof.free_count++;
+        prof.current_usage -= entry->size;
+        live_remove(slot);
+    }
+
+    spinlock_release(&prof.lock);
+}
+
+/* ─── reporting ────────────────────────────────────────────────── */
+
+bool heap_profile_fill_stats(memory_stats_t *stats) {
+    if (!stats) {
+        return false;
+    }
+
+    spinlock_acquire(&prof.lock);
+    stats->total_allocated  = (size_t)prof.total_allocated;
+    stats->total_freed      = (size_t)prof.total_freed;
+    stats->current_usage    = prof.current_usage;
+    stats->peak_usage       = prof.peak_usage;
+    stats->allocation_count = prof.allocation_count;
+    stats->free_count       = prof.free_count;
+    spinlock_release(&prof.lock);
+    return true;
+}
+
+bool heap_profile_get_site(uint32_t index, heap_profile_site_t *site) {
+    if (index >= HEAP_PROFILE_SITES || !site || prof.sites[index].allocs == 0) {
+        return false;
+    }
+    spinlock_acquire(&prof.lock);
+    *site = prof.sites[index];
+    spinlock_release(&prof.lock);
+    return true;
+}
+
+/**
+ * heap_profile_dump – Log the heaviest allocation sites by bytes over the
+ * kernel log (serial). Resolve caller addresses against the kernel image
+ * with addr2line or nm.
+ */
+void heap_profile_dump(void) {
+    memory_stats_t stats;
+    memset(&stats, 0, sizeof(stats));
+    memory_get_stats(&stats);
+
+    KLOG_I("heap profile: %u allocs, %u frees, %u B live, %u B peak, "
+           "fragmentation %u%%, %u sites, %u untracked (%u KB)",
+           (uint32_t)stats.allocation_count, (uint32_t)stats.free_count,
+           (uint32_t)stats.current_usage, (uint32_t)stats.peak_usage,
+           stats.fragmentation_ratio, prof.site_count, prof.untracked,
+           (uint32_t)(prof.untracked_bytes / 1024));
+    KLOG_I("%-10s %8s %8s %10s %8s %10s  lifetime <1/4/16/64/256/1k/4k/more ms",
+           "caller", "allocs", "frees", "KB total", "live", "live B");
+
+    /* Repeated max selection; the site table is small and this is rare */
+    bool shown[HEAP_PROFILE_SITES];
+    memset(shown, 0, sizeof(shown));
+
+    for (uint32_t rank = 0; rank < HEAP_PROFILE_TOP; rank++) {
+        heap_profile_site_t site;
+        uint32_t best = HEAP_PROFILE_SITES;
+        uint64_t best_bytes = 0;
+
+        spinlock_acquire(&prof.lock);
+        for (uint32_t i = 0; i < HEAP_PROFILE_SITES; i++) {
+            if (!shown[i] && prof.sites[i].allocs && prof.sites[i].bytes >= best_bytes) {
+                best = i;
+                best_bytes = prof.sites[i].bytes;
+            }
+        }
+        if (best < HEAP_PROFILE_SITES) {
+            site = prof.sites[best];
+        }
+        spinlock_release(&prof.lock);
+
+        if (best == HEAP_PROFILE_SITES) {
+            break;
+        }
+        shown[best] = true;
+
+        const uint32_t *h = site.lifetime;
+        KLOG_I("%08x%s %8u %8u %10u %8u %10u  %u/%u/%u/%u/%u/%u/%u/%u",
+               (uint32_t)site.caller, best == SITE_OVERFLOW ? "+" : " ",
+               site.allocs, site.frees, (uint32_t)(site.bytes >> 10),
+               site.live_count, site.live_bytes,
+               h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7]);
+    }
+}
+
+#endif /* CONFIG_HEAP_PROFILE */
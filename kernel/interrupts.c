@@ -5,7 +5,7 @@
  */
 
 #include "kernel/interrupts.h"
-#include "kernel/io.h"
+#include "kernel/kernel.h"
 #include "kernel/logging.h"
 #include "libc/stdio.h"
 #include "libc/string.h"
@@ -108,6 +108,11 @@ bool idt_install(void) {
     return true;
 }
 
+// Load the shared IDT on an application processor
+void idt_reload(void) {
+    __asm__ volatile("lidt %0" : : "m"(idtp));
+}
+
 void idt_init(void) {
     idt_install();
 }
@@ -167,3 +172,17 @@ void disable_interrupts(void) {
     __asm__ volatile ("cli");
 }
 
+uint32_t interrupt_disable(void) {
+    uint32_t flags;
+    __asm__ volatile ("pushf\n\t"
+                      "pop %0\n\t"
+                      "cli"
+                      : "=r"(flags) : : "memory");
+    return flags;
+}
+
+void interrupt_restore(uint32_t flags) {
+    if (flags & 0x200) {
+        __asm__ volatile ("sti" : : : "memory");
+    }
+}
@@ -6,9 +6,16 @@
 
 #include "kernel/kernel.h"
 #include "kernel/memory.h"
+#include "kernel/pmm.h"
 #include "kernel/interrupts.h"
 #include "kernel/timer.h"
 #include "kernel/process.h"
+#include "kernel/scheduler.h"
+#include "kernel/fpu.h"
+#include "kernel/futex.h"
+#include "kernel/acpi.h"
+#include "kernel/apic.h"
+#include "kernel/smp.h"
 #include "drivers/vga.h"
 #include "drivers/keyboard.h"
 #include "drivers/serial.h"
@@ -59,15 +66,6 @@ void kernel_main(uint32_t magic, struct multiboot_info *multiboot_info) {
     printf("Build date: %s\n", BUILD_DATE);
     printf("Copyright (c) 2025 Maya OS Project\n\n");
     
-    // Memory validation
-    uint32_t total_mb = pmm_get_total_memory() / (1024 * 1024);
-    if (total_mb < MIN_MEMORY_MB) {
-        kernel_panic("Insufficient system memory");
-    }
-    if (total_mb > (MAX_MEMORY_GB * 1024)) {
-        kernel_panic("Memory size exceeds maximum supported");
-    }
-    
     // Initialize core subsystems with error checking
     if (!gdt_install()) {
         kernel_panic("Failed to initialize GDT");
@@ -86,6 +84,15 @@ void kernel_main(uint32_t magic, struct multiboot_info *multiboot_info) {
     if (!pmm_init(multiboot_info)) {
         kernel_panic("Failed to initialize physical memory manager");
     }
+
+    // Memory validation
+    uint32_t total_mb = pmm_get_total_memory() / (1024 * 1024);
+    if (total_mb < MIN_MEMORY_MB) {
+        kernel_panic("Insufficient system memory");
+    }
+    if (total_mb > (MAX_MEMORY_GB * 1024)) {
+        kernel_panic("Memory size exceeds maximum supported");
+    }
     if (!vmm_init()) {
         kernel_panic("Failed to initialize virtual memory manager");
     }
@@ -93,9 +100,13 @@ void kernel_main(uint32_t magic, struct multiboot_info *multiboot_info) {
         kernel_panic("Failed to initialize kernel heap");
     }
     printf("Memory management initialized.\n");
-    
+
+    // The tick runs on the local APIC timer, so bring the APIC up first;
+    // without ACPI/APIC we stay uniprocessor
+    bool apic_ready = acpi_init() && apic_init();
+
     // Initialize devices
-    if (!timer_init(100)) {
+    if (!timer_init()) {
         kernel_panic("Failed to initialize system timer");
     }
     if (!keyboard_init()) {
@@ -114,6 +125,23 @@ void kernel_main(uint32_t magic, struct multiboot_info *multiboot_info) {
     if (!process_init()) {
         kernel_panic("Failed to initialize process manager");
     }
+    if (!scheduler_init()) {
+        kernel_panic("Failed to initialize scheduler");
+    }
+    if (!fpu_init()) {
+        printf("FPU: state not switched, SIMD is unsafe in tasks.\n");
+    }
+    if (!futex_init()) {
+        kernel_panic("Failed to initialize futexes");
+    }
+    if (!timer_start_worker()) {
+        kernel_panic("Failed to start the timer worker");
+    }
+
+    // Start the other CPUs
+    if (apic_ready && smp_init()) {
+        printf("SMP: %u CPUs online.\n", smp_cpu_count());
+    }
     
     // Initialize GUI system
     printf("Initializing GUI system...\n");
@@ -171,6 +199,38 @@ void kernel_panic(const char *message) {
     }
 }
 
+/* ─── port and MSR access ──────────────────────────────────────── */
+
+void outb(uint16_t port, uint8_t value) {
+    __asm__ volatile("outb %0, %1" : : "a"(value), "Nd"(port));
+}
+
+uint8_t inb(uint16_t port) {
+    uint8_t value;
+    __asm__ volatile("inb %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
+void outw(uint16_t port, uint16_t value) {
+    __asm__ volatile("outw %0, %1" : : "a"(value), "Nd"(port));
+}
+
+uint16_t inw(uint16_t port) {
+    uint16_t value;
+    __asm__ volatile("inw %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
+uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+void wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ volatile("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
 void debug_print_state(void) {
     char buf[256];
     snprintf(buf, sizeof(buf),
@@ -6,241 +6,2005 @@
 
 #include "kernel/memory.h"
 #include "kernel/interrupts.h"
+#include "kernel/pmm.h"
+#include "kernel/spinlock.h"
+#include "kernel/apic.h"
+#include "kernel/smp.h"
+#include "kernel/heap_profile.h"
+#include "kernel/slab.h"
+#include "kernel/logging.h"
 #include "libc/string.h"
 #include "libc/stdio.h"
 
 #define PAGE_SIZE 4096
-#define HEAP_START 0xD0000000
-#define HEAP_END   0xE0000000
 #define PAGE_DIRECTORY_SIZE 1024
 #define PAGE_TABLE_SIZE 1024
-#define MAX_MEMORY_BLOCKS 32768
+#define LARGE_PAGE_SIZE 0x400000
 
-typedef struct memory_block {
+/* Page directory / table entry bits */
+#define PTE_PRESENT 0x001
+#define PTE_WRITE   0x002
+#define PTE_USER    0x004
+#define PDE_LARGE   0x080   /* 4 MB page (requires CR4.PSE) */
+#define PTE_COW     0x200   /* Software bit: shared, copy on first write */
+#define PTE_ANON    0x400   /* Software bit (not present): demand-zero page */
+#define PTE_FLAGS   0xFFF
+
+/* Page fault error code bits */
+#define PF_PRESENT  0x1
+#define PF_WRITE    0x2
+
+#define CPUID_EDX_PSE 0x008
+#define CR4_PSE       0x010
+
+/* Range operations touching more pages than this reload CR3 once
+   instead of issuing one invlpg per page */
+#define VMM_FLUSH_THRESHOLD 32
+
+/* Kernel virtual range for vmalloc(); the framebuffer is mapped from its end */
+#define VMALLOC_START  0xD0000000u
+#define VMALLOC_END    0xE0000000u
+
+/* memory_realloc() moves buffers at least this large into vmalloc space */
+#define VMALLOC_REALLOC_MIN (16 * PAGE_SIZE)
+
+/* Unused kernel virtual range for vmm_benchmark_ranges() */
+#define VMM_BENCH_BASE 0xC0000000u
+#define VMM_USER_END   0xC0000000u   /* User mappings stay below the kernel ranges */
+#define VMM_BENCH_MAX  0x04000000u   /* 64 MB */
+
+/* Pending TLB invalidations of one range operation */
+typedef struct {
     uint32_t start;
-    uint32_t size;
-    bool used;
-    struct memory_block* next;
-} memory_block_t;
+    uint32_t last;
+    uint32_t pages;
+} tlb_batch_t;
+
+/*
+ * Kernel heap: segregated free lists over arenas taken from the PMM.
+ *
+ * Every block starts with an 8-byte header. Free blocks also carry their
+ * size in the last word (boundary tag) so the following block can find
+ * and merge with them in O(1). Free blocks sit in one of HEAP_BIN_COUNT
+ * bins (two per power of two, 32 B .. 4 KB) and a bitmap of non-empty
+ * bins lets kmalloc() find a fit with a single bit scan. Requests above
+ * a page, and page-aligned ones, are served by whole PMM blocks.
+ */
+#define HEAP_ALIGN        8
+#define HEAP_MIN_BLOCK    32
+#define HEAP_SMALL_MAX    PAGE_SIZE     /* Larger blocks go to the PMM */
+#define HEAP_BIN_COUNT    16
+#define HEAP_ARENA_ORDER  4             /* 64 KB arenas */
+#define HEAP_ARENA_SIZE   (PAGE_SIZE << HEAP_ARENA_ORDER)
+
+#define HEAP_MAGIC_USED   0xA110C8EDu
+#define HEAP_MAGIC_FREE   0xF4EEB10Cu
+
+/* Flags kept in the low bits of heap_block_t.size */
+#define BLOCK_USED        0x1u
+#define BLOCK_PREV_USED   0x2u
+#define BLOCK_FIRST       0x4u          /* First block of its arena */
+#define BLOCK_FLAGS       0x7u
+
+typedef struct heap_block {
+    uint32_t size;                      /* Block size incl. header | flags */
+    uint32_t magic;
+    struct heap_block* next_free;       /* Only valid while free */
+    struct heap_block* prev_free;
+} heap_block_t;
+
+#define HEAP_HEADER_SIZE  8
+
+/*
+ * Per-CPU magazines in front of the heap for blocks up to HEAP_MAG_MAX.
+ * Each CPU keeps a loaded and a previous magazine per size class and
+ * only touches the shared depot (under its lock) when both run dry or
+ * fill up, so the common kmalloc/kfree path takes no lock at all.
+ */
+#define HEAP_MAX_CPUS     16
+#define HEAP_MAG_CLASSES  9             /* Bins 0..8: 32 B .. 512 B blocks */
+#define HEAP_MAG_ROUNDS   32
+#define HEAP_MAG_BATCH    (HEAP_MAG_ROUNDS / 2)
+#define HEAP_DEPOT_MAX    8             /* Full magazines kept per class */
+#define HEAP_MAGIC_CACHED 0xCAC4EDB1u
+
+typedef struct magazine {
+    uint32_t rounds;
+    struct magazine* next;
+    void* objs[HEAP_MAG_ROUNDS];
+} magazine_t;
+
+typedef struct {
+    magazine_t* loaded[HEAP_MAG_CLASSES];
+    magazine_t* previous[HEAP_MAG_CLASSES];
+    heap_magazine_stats_t stats;
+} heap_cpu_cache_t;
+
+static struct {
+    heap_cpu_cache_t cpus[HEAP_MAX_CPUS];
+    uint8_t cpu_map[256];               /* APIC ID -> CPU slot + 1 */
+    uint32_t cpu_count;
+    magazine_t* full[HEAP_MAG_CLASSES];
+    magazine_t* empty[HEAP_MAG_CLASSES];
+    uint32_t full_count[HEAP_MAG_CLASSES];
+    spinlock_t lock;
+} depot;
+
+static uint32_t* page_directory = NULL;
+static bool mmu_initialized = false;
+static bool pse_enabled = false;
+
+/* User address spaces: shared zero frame and fault accounting */
+static struct {
+    uintptr_t zero_frame;
+    uint32_t base;           /* Anonymous memory starts above the identity map */
+    uint32_t cow_copies;     /* Write faults that had to copy a shared frame */
+    uint32_t cow_reuses;     /* Write faults on a frame nobody else maps     */
+    uint32_t zero_fills;     /* First writes to demand-zero pages            */
+    uint32_t zero_maps;      /* Reads satisfied by the shared zero frame     */
+    spinlock_t lock;
+} vmm_user;
+
+static struct {
+    heap_block_t* bins[HEAP_BIN_COUNT];
+    uint32_t bin_bitmap;
+    uint32_t arena_count;
+    uint32_t used_memory;
+    uint32_t peak_memory;
+    uint64_t total_allocated;   /* Bytes leaving the shared heap, cumulative */
+    uint64_t total_freed;
+    uint32_t allocation_count;
+    uint32_t free_count;
+    spinlock_t lock;
+    bool initialized;
+} heap;
+
+static memory_realloc_stats_t realloc_stats;
+
+/* With HEAP_PROFILE=1 every public allocation is tagged with its caller */
+#ifdef CONFIG_HEAP_PROFILE
+#define HEAP_PROFILE_ALLOC(ptr, size) \
+    heap_profile_record_alloc((ptr), (size), __builtin_return_address(0))
+#define HEAP_PROFILE_FREE(ptr) heap_profile_record_free(ptr)
+#else
+#define HEAP_PROFILE_ALLOC(ptr, size) ((void)0)
+#define HEAP_PROFILE_FREE(ptr)        ((void)0)
+#endif
+
+static bool cpu_has_pse(void) {
+    uint32_t eax = 1, ebx, ecx, edx;
+    __asm__ volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return (edx & CPUID_EDX_PSE) != 0;
+}
+
+static inline void tlb_flush_page(uint32_t virtual_addr) {
+    if (mmu_initialized) {
+        __asm__ volatile("invlpg (%0)" : : "r"(virtual_addr) : "memory");
+    }
+}
+
+static inline void tlb_flush_all(void) {
+    if (mmu_initialized) {
+        uint32_t cr3;
+        __asm__ volatile("mov %%cr3, %0\n"
+                         "mov %0, %%cr3" : "=r"(cr3) : : "memory");
+    }
+}
+
+/* ─── batched TLB invalidation ─────────────────────────────────── */
+
+/* Tell other CPUs to drop [start, last]: one IPI per batch */
+static void tlb_shootdown(uint32_t start, uint32_t last) {
+    smp_tlb_shootdown(start, last);
+}
+
+static inline void tlb_batch_add(tlb_batch_t* batch, uint32_t virt, uint32_t size) {
+    uint32_t last = virt + size - 1;
+    if (batch->pages == 0 || virt < batch->start) {
+        batch->start = virt;
+    }
+    if (batch->pages == 0 || last > batch->last) {
+        batch->last = last;
+    }
+    batch->pages += size / PAGE_SIZE;
+}
+
+/* Invalidate everything a range operation touched, once */
+static void tlb_batch_flush(tlb_batch_t* batch) {
+    if (batch->pages == 0) {
+        return;
+    }
+
+    if (batch->pages > VMM_FLUSH_THRESHOLD) {
+        tlb_flush_all();
+    } else {
+        for (uint32_t virt = batch->start; virt <= batch->last && virt >= batch->start;
+             virt += PAGE_SIZE) {
+            tlb_flush_page(virt);
+        }
+    }
+    tlb_shootdown(batch->start, batch->last);
+    batch->pages = 0;
+}
+
+/* ─── page table updates ───────────────────────────────────────── */
+
+/* Replace a 4 MB mapping by an equivalent page table so one 4 KB page in
+   it can be changed. The translations are unchanged, so no flush. */
+static uint32_t* vmm_split_large(uint32_t pd_index) {
+    uint32_t* page_table = (uint32_t*)kmalloc_aligned(PAGE_SIZE);
+    if (!page_table) {
+        return NULL;
+    }
+
+    uint32_t pde = page_directory[pd_index];
+    uint32_t base = pde & 0xFFC00000;
+    uint32_t flags = pde & (PTE_PRESENT | PTE_WRITE | PTE_USER);
+    for (uint32_t i = 0; i < PAGE_TABLE_SIZE; i++) {
+        page_table[i] = (base + i * PAGE_SIZE) | flags;
+    }
+
+    page_directory[pd_index] = (uint32_t)page_table | flags;
+    return page_table;
+}
+
+/* Page table covering an address, created or split as needed */
+static uint32_t* vmm_get_table(uint32_t virtual_addr) {
+    uint32_t pd_index = virtual_addr >> 22;
+    uint32_t pde = page_directory[pd_index];
+
+    if (!(pde & PTE_PRESENT)) {
+        uint32_t* page_table = (uint32_t*)kzalloc(PAGE_SIZE);
+        if (!page_table) {
+            return NULL;
+        }
+        page_directory[pd_index] = ((uint32_t)page_table) | PTE_PRESENT | PTE_WRITE;
+        return page_table;
+    }
+    if (pde & PDE_LARGE) {
+        return vmm_split_large(pd_index);
+    }
+    return (uint32_t*)(pde & 0xFFFFF000);
+}
+
+/* Write one PTE without invalidating it; returns false on allocation failure */
+static bool vmm_set_pte(uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags) {
+    uint32_t pde = page_directory[virtual_addr >> 22];
+    if ((pde & PTE_PRESENT) && (pde & PDE_LARGE) &&
+        (pde & 0xFFC00000) + (virtual_addr & 0x3FF000) == (physical_addr & 0xFFFFF000) &&
+        (pde & (PTE_WRITE | PTE_USER)) == (flags & (PTE_WRITE | PTE_USER))) {
+        return true; // Already covered by the large page
+    }
+
+    uint32_t* page_table = vmm_get_table(virtual_addr);
+    if (!page_table) {
+        return false;
+    }
+    page_table[(virtual_addr >> 12) & 0x3FF] = (physical_addr & 0xFFFFF000) | flags;
+    return true;
+}
+
+static bool vmm_map_page(uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags) {
+    if (!vmm_set_pte(virtual_addr, physical_addr, flags)) {
+        return false;
+    }
+    tlb_flush_page(virtual_addr);
+    return true;
+}
+
+static void vmm_map_large(uint32_t virtual_addr, uint32_t physical_addr, uint32_t flags) {
+    uint32_t pd_index = virtual_addr >> 22;
+    uint32_t old = page_directory[pd_index];
+
+    page_directory[pd_index] = (physical_addr & 0xFFC00000) | flags | PDE_LARGE;
+
+    // A page table replaced by the large mapping is no longer needed
+    if ((old & PTE_PRESENT) && !(old & PDE_LARGE)) {
+        kfree((void*)(old & 0xFFFFF000));
+    }
+}
+
+/* Map a range using 4 MB pages wherever both addresses allow it, with one
+   TLB invalidation pass at the end */
+static bool vmm_map_region(uint32_t virtual_addr, uint32_t physical_addr,
+                           uint32_t size, uint32_t flags) {
+    uint32_t virt = virtual_addr & 0xFFFFF000;
+    uint32_t phys = physical_addr & 0xFFFFF000;
+    uint32_t end  = (virtual_addr + size + PAGE_SIZE - 1) & 0xFFFFF000;
+    tlb_batch_t batch = { 0, 0, 0 };
+    bool ok = true;
+
+    while (virt < end) {
+        if (pse_enabled && !(virt & (LARGE_PAGE_SIZE - 1)) &&
+            !(phys & (LARGE_PAGE_SIZE - 1)) && end - virt >= LARGE_PAGE_SIZE) {
+            vmm_map_large(virt, phys, flags);
+            tlb_batch_add(&batch, virt, LARGE_PAGE_SIZE);
+            virt += LARGE_PAGE_SIZE;
+            phys += LARGE_PAGE_SIZE;
+            continue;
+        }
+        if (!vmm_set_pte(virt, phys, flags)) {
+            ok = false;
+            break;
+        }
+        tlb_batch_add(&batch, virt, PAGE_SIZE);
+        virt += PAGE_SIZE;
+        phys += PAGE_SIZE;
+    }
+
+    tlb_batch_flush(&batch);
+    return ok;
+}
+
+/* Translate MEMORY_FLAG_* into page table bits */
+static uint32_t vmm_pte_flags(uint32_t flags) {
+    uint32_t pte = PTE_PRESENT;
+    if (flags & MEMORY_FLAG_WRITE) {
+        pte |= PTE_WRITE;
+    }
+    if (flags & MEMORY_FLAG_USER) {
+        pte |= PTE_USER;
+    }
+    return pte;
+}
+
+/* ─── range API ────────────────────────────────────────────────── */
+
+bool vmm_map_range(uint32_t virtual_addr, uint32_t physical_addr, uint32_t size,
+                   uint32_t flags) {
+    if (!mmu_initialized || size == 0 ||
+        (virtual_addr & 0xFFF) != (physical_addr & 0xFFF)) {
+        return false;
+    }
+    return vmm_map_region(virtual_addr, physical_addr, size, vmm_pte_flags(flags));
+}
+
+/*
+ * Page tables emptied here are kept: address spaces cloned by fork()
+ * point at the same kernel page tables, so they cannot be freed safely.
+ */
+bool vmm_unmap_range(uint32_t virtual_addr, uint32_t size) {
+    if (!mmu_initialized || size == 0) {
+        return false;
+    }
+
+    uint32_t virt = virtual_addr & 0xFFFFF000;
+    uint32_t end  = (virtual_addr + size + PAGE_SIZE - 1) & 0xFFFFF000;
+    tlb_batch_t batch = { 0, 0, 0 };
+    bool ok = true;
+
+    while (virt < end) {
+        uint32_t pd_index = virt >> 22;
+        uint32_t pde = page_directory[pd_index];
+        uint32_t next_table = (virt & 0xFFC00000) + LARGE_PAGE_SIZE;
+
+        if (!(pde & PTE_PRESENT)) {
+            if (next_table == 0) break;
+            virt = next_table;
+            continue;
+        }
+        if ((pde & PDE_LARGE) && !(virt & (LARGE_PAGE_SIZE - 1)) &&
+            end - virt >= LARGE_PAGE_SIZE) {
+            page_directory[pd_index] = 0;
+            tlb_batch_add(&batch, virt, LARGE_PAGE_SIZE);
+            virt = next_table;
+            continue;
+        }
+
+        uint32_t* page_table = vmm_get_table(virt);
+        if (!page_table) {
+            ok = false;
+            break;
+        }
+        for (; virt < end && (virt & 0xFFC00000) == (pd_index << 22); virt += PAGE_SIZE) {
+            uint32_t* pte = &page_table[(virt >> 12) & 0x3FF];
+            if (*pte & PTE_PRESENT) {
+                *pte = 0;
+                tlb_batch_add(&batch, virt, PAGE_SIZE);
+            }
+        }
+        if (virt == 0) break; // Wrapped past 4 GB
+    }
+
+    tlb_batch_flush(&batch);
+    return ok;
+}
+
+bool vmm_protect_range(uint32_t virtual_addr, uint32_t size, uint32_t flags) {
+    if (!mmu_initialized || size == 0) {
+        return false;
+    }
+
+    uint32_t bits = vmm_pte_flags(flags);
+    uint32_t mask = PTE_PRESENT | PTE_WRITE | PTE_USER;
+    uint32_t virt = virtual_addr & 0xFFFFF000;
+    uint32_t end  = (virtual_addr + size + PAGE_SIZE - 1) & 0xFFFFF000;
+    tlb_batch_t batch = { 0, 0, 0 };
+    bool ok = true;
+
+    while (virt < end) {
+        uint32_t pd_index = virt >> 22;
+        uint32_t pde = page_directory[pd_index];
+        uint32_t next_table = (virt & 0xFFC00000) + LARGE_PAGE_SIZE;
+
+        if (!(pde & PTE_PRESENT)) {
+            if (next_table == 0) break;
+            virt = next_table;
+            continue;
+        }
+        if ((pde & PDE_LARGE) && !(virt & (LARGE_PAGE_SIZE - 1)) &&
+            end - virt >= LARGE_PAGE_SIZE) {
+            page_directory[pd_index] = (pde & ~mask) | bits;
+            tlb_batch_add(&batch, virt, LARGE_PAGE_SIZE);
+            virt = next_table;
+            continue;
+        }
+
+        uint32_t* page_table = vmm_get_table(virt);
+        if (!page_table) {
+            ok = false;
+            break;
+        }
+        for (; virt < end && (virt & 0xFFC00000) == (pd_index << 22); virt += PAGE_SIZE) {
+            uint32_t* pte = &page_table[(virt >> 12) & 0x3FF];
+            if ((*pte & PTE_PRESENT) && (*pte & mask) != bits) {
+                *pte = (*pte & ~mask) | bits;
+                tlb_batch_add(&batch, virt, PAGE_SIZE);
+            }
+        }
+        if (virt == 0) break; // Wrapped past 4 GB
+    }
+
+    tlb_batch_flush(&batch);
+    return ok;
+}
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/**
+ * vmm_benchmark_ranges – Compare page_map() one page at a time against
+ * vmm_map_range() for 1..64 MB regions. The physical side is offset by
+ * one page so both paths build identical 4 KB mappings; nothing is
+ * accessed through them. Results go to the kernel log.
+ */
+void vmm_benchmark_ranges(void) {
+    if (!mmu_initialized) {
+        return;
+    }
+
+    for (uint32_t pd = VMM_BENCH_BASE >> 22; pd < (VMM_BENCH_BASE + VMM_BENCH_MAX) >> 22; pd++) {
+        if (page_directory[pd] & PTE_PRESENT) {
+            KLOG_W("VMM bench: scratch range %08x is in use", VMM_BENCH_BASE);
+            return;
+        }
+    }
+
+    // Build the page tables up front so neither path pays for them
+    vmm_map_range(VMM_BENCH_BASE, PAGE_SIZE, VMM_BENCH_MAX, MEMORY_FLAG_READ);
+    vmm_unmap_range(VMM_BENCH_BASE, VMM_BENCH_MAX);
+
+    KLOG_I("%8s %14s %14s %8s", "size", "per-page cyc", "range cyc", "speedup");
+    for (uint32_t size = 0x100000; size <= VMM_BENCH_MAX; size <<= 1) {
+        uint64_t t0 = rdtsc();
+        for (uint32_t off = 0; off < size; off += PAGE_SIZE) {
+            page_map(VMM_BENCH_BASE + off, PAGE_SIZE + off);
+        }
+        uint64_t t1 = rdtsc();
+        vmm_unmap_range(VMM_BENCH_BASE, size);
+
+        uint64_t t2 = rdtsc();
+        vmm_map_range(VMM_BENCH_BASE, PAGE_SIZE, size, MEMORY_FLAG_READ | MEMORY_FLAG_WRITE);
+        uint64_t t3 = rdtsc();
+        vmm_unmap_range(VMM_BENCH_BASE, size);
+
+        uint32_t per_page = (uint32_t)(t1 - t0);
+        uint32_t ranged = (uint32_t)(t3 - t2);
+        KLOG_I("%6u MB %14u %14u %7u.%ux", size >> 20, per_page, ranged,
+               ranged ? per_page / ranged : 0,
+               ranged ? (per_page % ranged) * 10 / ranged : 0);
+    }
+
+    // Every scratch page is unmapped again; hand back the page tables too
+    // so the next run finds the range free
+    for (uint32_t pd = VMM_BENCH_BASE >> 22; pd < (VMM_BENCH_BASE + VMM_BENCH_MAX) >> 22; pd++) {
+        uint32_t pde = page_directory[pd];
+        page_directory[pd] = 0;
+        if ((pde & PTE_PRESENT) && !(pde & PDE_LARGE)) {
+            kfree((void*)(pde & 0xFFFFF000));
+        }
+    }
+    tlb_flush_all();
+}
+
+/* ─── vmalloc ──────────────────────────────────────────────────── */
+
+/*
+ * Large buffers get their own kernel virtual range backed by individual
+ * frames, so they neither fragment the byte heap nor need physically
+ * contiguous memory. Every area is followed by an unmapped guard page.
+ * The page tables for the whole range are built up front: address spaces
+ * cloned by fork() share them and see later mappings.
+ */
+
+typedef struct vm_area {
+    uint32_t start;
+    uint32_t pages;             /* Mapped pages, guard page excluded */
+    struct vm_area* next;
+} vm_area_t;
+
+static struct {
+    vm_area_t* free;            /* Unused ranges, sorted by address */
+    vm_area_t* busy;
+    kmem_cache_t* area_cache;
+    uint32_t used_pages;
+    spinlock_t lock;
+    bool initialized;
+} vmalloc_state;
+
+static inline uint32_t* vmalloc_pte(uint32_t virt) {
+    uint32_t* page_table = (uint32_t*)(page_directory[virt >> 22] & 0xFFFFF000);
+    return &page_table[(virt >> 12) & 0x3FF];
+}
+
+static bool vmalloc_init(void) {
+    spinlock_init(&vmalloc_state.lock);
+    vmalloc_state.area_cache = kmem_cache_create("vm_area", sizeof(vm_area_t), 0, NULL);
+    if (!vmalloc_state.area_cache) {
+        return false;
+    }
+
+    for (uint32_t virt = VMALLOC_START; virt < VMALLOC_END; virt += LARGE_PAGE_SIZE) {
+        if (!vmm_get_table(virt)) {
+            return false;
+        }
+    }
+
+    vm_area_t* all = kmem_cache_alloc(vmalloc_state.area_cache);
+    if (!all) {
+        return false;
+    }
+    all->start = VMALLOC_START;
+    all->pages = (VMALLOC_END - VMALLOC_START) / PAGE_SIZE;
+    all->next = NULL;
+    vmalloc_state.free = all;
+    vmalloc_state.initialized = true;
+    return true;
+}
+
+/* First-fit carve of `pages` from the free ranges; caller holds the lock */
+static uint32_t vmalloc_take_range(uint32_t pages) {
+    vm_area_t** link = &vmalloc_state.free;
+    for (vm_area_t* range = *link; range; link = &range->next, range = range->next) {
+        if (range->pages < pages) {
+            continue;
+        }
+        uint32_t start = range->start;
+        range->start += pages * PAGE_SIZE;
+        range->pages -= pages;
+        if (range->pages == 0) {
+            *link = range->next;
+            kmem_cache_free(vmalloc_state.area_cache, range);
+        }
+        return start;
+    }
+    return 0;
+}
+
+/* Return a range, merging with its neighbours; caller holds the lock */
+static void vmalloc_put_range(uint32_t start, uint32_t pages) {
+    vm_area_t* prev = NULL;
+    vm_area_t* next = vmalloc_state.free;
+    while (next && next->start < start) {
+        prev = next;
+        next = next->next;
+    }
+
+    if (prev && prev->start + prev->pages * PAGE_SIZE == start) {
+        prev->pages += pages;
+        if (next && start + pages * PAGE_SIZE == next->start) {
+            prev->pages += next->pages;
+            prev->next = next->next;
+            kmem_cache_free(vmalloc_state.area_cache, next);
+        }
+        return;
+    }
+    if (next && start + pages * PAGE_SIZE == next->start) {
+        next->start = start;
+        next->pages += pages;
+        return;
+    }
+
+    vm_area_t* range = kmem_cache_alloc(vmalloc_state.area_cache);
+    if (!range) {
+        KLOG_W("vmalloc: leaking %u pages at %08x", pages, start);
+        return;
+    }
+    range->start = start;
+    range->pages = pages;
+    range->next = next;
+    if (prev) {
+        prev->next = range;
+    } else {
+        vmalloc_state.free = range;
+    }
+}
+
+/* Unmap `pages` pages at `start` and free their frames after one flush */
+static void vmalloc_unmap(uint32_t start, uint32_t pages) {
+    tlb_batch_t batch = { 0, 0, 0 };
+    for (uint32_t i = 0; i < pages; i++) {
+        uint32_t* pte = vmalloc_pte(start + i * PAGE_SIZE);
+        if (*pte & PTE_PRESENT) {
+            *pte &= ~PTE_PRESENT; /* Keep the frame address until flushed */
+            tlb_batch_add(&batch, start + i * PAGE_SIZE, PAGE_SIZE);
+        }
+    }
+    tlb_batch_flush(&batch);
+
+    for (uint32_t i = 0; i < pages; i++) {
+        uint32_t* pte = vmalloc_pte(start + i * PAGE_SIZE);
+        if (*pte & 0xFFFFF000) {
+            pmm_free_frame(*pte & 0xFFFFF000);
+        }
+        *pte = 0;
+    }
+}
+
+static void* vmalloc_area(size_t size, bool zeroed) {
+    if (!vmalloc_state.initialized || size == 0 ||
+        size > VMALLOC_END - VMALLOC_START - PAGE_SIZE) {
+        return NULL;
+    }
+
+    uint32_t pages = (uint32_t)((size + PAGE_SIZE - 1) / PAGE_SIZE);
+    vm_area_t* area = kmem_cache_alloc(vmalloc_state.area_cache);
+    if (!area) {
+        return NULL;
+    }
+
+    spinlock_acquire(&vmalloc_state.lock);
+    uint32_t start = vmalloc_take_range(pages + 1);
+    if (!start) {
+        spinlock_release(&vmalloc_state.lock);
+        kmem_cache_free(vmalloc_state.area_cache, area);
+        KLOG_W("vmalloc: no virtual space for %u pages", pages);
+        return NULL;
+    }
+    area->start = start;
+    area->pages = pages;
+    area->next = vmalloc_state.busy;
+    vmalloc_state.busy = area;
+    vmalloc_state.used_pages += pages;
+    spinlock_release(&vmalloc_state.lock);
+
+    /* The range is ours and was flushed when last freed: map without locks or flushes */
+    for (uint32_t i = 0; i < pages; i++) {
+        uintptr_t frame = zeroed ? pmm_alloc_zeroed_pages(0) : pmm_alloc_frame();
+        if (!frame) {
+            vfree((void*)start);
+            return NULL;
+        }
+        *vmalloc_pte(start + i * PAGE_SIZE) = frame | PTE_PRESENT | PTE_WRITE;
+    }
+    return (void*)start;
+}
+
+/**
+ * vmalloc – Allocate a virtually contiguous kernel buffer from scattered
+ * frames. Use for multi-page buffers that never need to be physically
+ * contiguous (framebuffers, window surfaces, filesystem tables).
+ */
+void* vmalloc(size_t size) {
+    void* ptr = vmalloc_area(size, false);
+    HEAP_PROFILE_ALLOC(ptr, size);
+    return ptr;
+}
+
+/* vmalloc() with zeroed contents, drawn from the pre-zeroed frame pool */
+void* vzalloc(size_t size) {
+    void* ptr = vmalloc_area(size, true);
+    HEAP_PROFILE_ALLOC(ptr, size);
+    return ptr;
+}
+
+void vfree(void* ptr) {
+    if (!ptr || !is_vmalloc_addr(ptr)) {
+        return;
+    }
+
+    spinlock_acquire(&vmalloc_state.lock);
+    vm_area_t** link = &vmalloc_state.busy;
+    while (*link && (*link)->start != (uint32_t)ptr) {
+        link = &(*link)->next;
+    }
+    vm_area_t* area = *link;
+    if (!area) {
+        spinlock_release(&vmalloc_state.lock);
+        KLOG_W("vfree: %08x is not a vmalloc area", (uint32_t)ptr);
+        return;
+    }
+    *link = area->next;
+    spinlock_release(&vmalloc_state.lock);
+
+    HEAP_PROFILE_FREE(ptr);
+    vmalloc_unmap(area->start, area->pages);
+
+    spinlock_acquire(&vmalloc_state.lock);
+    vmalloc_state.used_pages -= area->pages;
+    vmalloc_put_range(area->start, area->pages + 1);
+    spinlock_release(&vmalloc_state.lock);
+    kmem_cache_free(vmalloc_state.area_cache, area);
+}
+
+/**
+ * vmalloc_resize – Resize a vmalloc area without copying its contents.
+ * Shrinking unmaps the tail. Growing extends the area in place when the
+ * virtual range past its guard page is free; otherwise the existing frames
+ * are moved to a larger range by rewriting PTEs. Returns the (possibly new)
+ * address, or NULL with the area untouched.
+ */
+static void* vmalloc_resize(void* ptr, size_t size, bool* moved) {
+    uint32_t pages = (uint32_t)((size + PAGE_SIZE - 1) / PAGE_SIZE);
+    *moved = false;
+    if (size > VMALLOC_END - VMALLOC_START - PAGE_SIZE) {
+        return NULL;
+    }
+
+    spinlock_acquire(&vmalloc_state.lock);
+    vm_area_t* area = vmalloc_state.busy;
+    while (area && area->start != (uint32_t)ptr) {
+        area = area->next;
+    }
+    if (!area) {
+        spinlock_release(&vmalloc_state.lock);
+        return NULL;
+    }
+
+    uint32_t start = area->start;
+    uint32_t old_pages = area->pages;
+    if (pages <= old_pages) {
+        area->pages = pages;
+        vmalloc_state.used_pages -= old_pages - pages;
+        spinlock_release(&vmalloc_state.lock);
+        if (pages < old_pages) {
+            /* The first dropped page becomes the new guard */
+            vmalloc_unmap(start + pages * PAGE_SIZE, old_pages - pages);
+            spinlock_acquire(&vmalloc_state.lock);
+            vmalloc_put_range(start + (pages + 1) * PAGE_SIZE, old_pages - pages);
+            spinlock_release(&vmalloc_state.lock);
+        }
+        return ptr;
+    }
+
+    uint32_t extra = pages - old_pages;
+    uint32_t beyond = start + (old_pages + 1) * PAGE_SIZE;
+
+    /* Grow in place: the old guard page turns into data */
+    vm_area_t** link = &vmalloc_state.free;
+    while (*link && (*link)->start < beyond) {
+        link = &(*link)->next;
+    }
+    vm_area_t* range = *link;
+    if (range && range->start == beyond && range->pages >= extra) {
+        range->start += extra * PAGE_SIZE;
+        range->pages -= extra;
+        if (range->pages == 0) {
+            *link = range->next;
+            kmem_cache_free(vmalloc_state.area_cache, range);
+        }
+        area->pages = pages;
+        vmalloc_state.used_pages += extra;
+        spinlock_release(&vmalloc_state.lock);
+
+        for (uint32_t i = old_pages; i < pages; i++) {
+            uintptr_t frame = pmm_alloc_frame();
+            if (!frame) {
+                vmalloc_unmap(start + old_pages * PAGE_SIZE, extra);
+                spinlock_acquire(&vmalloc_state.lock);
+                area->pages = old_pages;
+                vmalloc_state.used_pages -= extra;
+                vmalloc_put_range(beyond, extra);
+                spinlock_release(&vmalloc_state.lock);
+                return NULL;
+            }
+            *vmalloc_pte(start + i * PAGE_SIZE) = frame | PTE_PRESENT | PTE_WRITE;
+        }
+        return ptr;
+    }
+
+    /* Move: carry the frames over to a larger range, then map the rest */
+    uint32_t target = vmalloc_take_range(pages + 1);
+    spinlock_release(&vmalloc_state.lock);
+    if (!target) {
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < old_pages; i++) {
+        *vmalloc_pte(target + i * PAGE_SIZE) = *vmalloc_pte(start + i * PAGE_SIZE);
+    }
+    for (uint32_t i = old_pages; i < pages; i++) {
+        uintptr_t frame = pmm_alloc_frame();
+        if (!frame) {
+            /* The carried frames still belong to the old mapping */
+            for (uint32_t j = 0; j < old_pages; j++) {
+                *vmalloc_pte(target + j * PAGE_SIZE) = 0;
+            }
+            vmalloc_unmap(target + old_pages * PAGE_SIZE, extra);
+            spinlock_acquire(&vmalloc_state.lock);
+            vmalloc_put_range(target, pages + 1);
+            spinlock_release(&vmalloc_state.lock);
+            return NULL;
+        }
+        *vmalloc_pte(target + i * PAGE_SIZE) = frame | PTE_PRESENT | PTE_WRITE;
+    }
+
+    /* Retire the old range with one flush; its frames live on at the target */
+    tlb_batch_t batch = { 0, 0, 0 };
+    for (uint32_t i = 0; i < old_pages; i++) {
+        *vmalloc_pte(start + i * PAGE_SIZE) = 0;
+        tlb_batch_add(&batch, start + i * PAGE_SIZE, PAGE_SIZE);
+    }
+    tlb_batch_flush(&batch);
+
+    spinlock_acquire(&vmalloc_state.lock);
+    area->start = target;
+    area->pages = pages;
+    vmalloc_state.used_pages += extra;
+    vmalloc_put_range(start, old_pages + 1);
+    spinlock_release(&vmalloc_state.lock);
+
+    *moved = true;
+    return (void*)target;
+}
+
+bool is_vmalloc_addr(const void* ptr) {
+    return (uint32_t)ptr >= VMALLOC_START && (uint32_t)ptr < VMALLOC_END;
+}
+
+uint32_t vmalloc_get_used(void) {
+    return vmalloc_state.used_pages * PAGE_SIZE;
+}
+
+bool vmm_init(void) {
+    if (mmu_initialized) {
+        return true;
+    }
+
+    // Allocate page directory
+    page_directory = (uint32_t*)kzalloc(PAGE_SIZE);
+    if (!page_directory) {
+        return false;
+    }
+
+    pse_enabled = cpu_has_pse();
+    if (pse_enabled) {
+        uint32_t cr4;
+        __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+        cr4 |= CR4_PSE;
+        __asm__ volatile("mov %0, %%cr4" : : "r"(cr4));
+    }
+
+    // Identity map all of RAM (kernel image, boot data, PMM frames)
+    pmm_stats_t stats;
+    uint32_t identity_end = LARGE_PAGE_SIZE;
+    if (pmm_get_stats(&stats) && stats.total_frames * PAGE_SIZE > identity_end) {
+        identity_end = stats.total_frames * PAGE_SIZE;
+    }
+    identity_end = (identity_end + LARGE_PAGE_SIZE - 1) & ~(LARGE_PAGE_SIZE - 1);
+    if (identity_end > VMM_BENCH_BASE) {
+        identity_end = VMM_BENCH_BASE; /* The PMM never hands out frames above this */
+    }
+
+    if (!vmm_map_region(0, 0, identity_end, PTE_PRESENT | PTE_WRITE)) {
+        return false;
+    }
+
+    if (!vmalloc_init()) {
+        return false;
+    }
+
+    // Set up page directory
+    uint32_t cr0;
+    __asm__ volatile(
+        "mov %%cr0, %0"
+        : "=r"(cr0)
+    );
+    cr0 |= 0x80000000; // Enable paging
+
+    __asm__ volatile(
+        "mov %0, %%cr3\n"
+        "mov %1, %%cr0"
+        : : "r"(page_directory), "r"(cr0)
+    );
+
+    spinlock_init(&vmm_user.lock);
+    vmm_user.base = identity_end;
+    mmu_initialized = true;
+    KLOG_I("VMM: identity mapped %u MB using %s pages", identity_end >> 20,
+           pse_enabled ? "4 MB" : "4 KB");
+    return true;
+}
+
+bool page_map(uint32_t virtual_addr, uint32_t physical_addr) {
+    if (!mmu_initialized) {
+        return false;
+    }
+    return vmm_map_page(virtual_addr, physical_addr, PTE_PRESENT | PTE_WRITE);
+}
+
+/* ─── address spaces and copy-on-write ─────────────────────────── */
+
+/*
+ * Kernel page directory entries are shared by every address space, so
+ * user mappings live only in page tables whose PDE carries PTE_USER.
+ * fork() copies those page tables and marks every writable page
+ * read-only + PTE_COW in both parent and child; the page fault handler
+ * then copies a frame only when one side writes to it. Anonymous memory
+ * starts as not-present PTE_ANON entries and is backed by one shared
+ * zero frame until the first write.
+ */
+
+static inline uint32_t* vmm_active_directory(void) {
+    uint32_t cr3;
+    __asm__ volatile("mov %%cr3, %0" : "=r"(cr3));
+    return (uint32_t*)(cr3 & 0xFFFFF000);
+}
+
+/* Drop the frame behind one user PTE */
+static void vmm_release_pte(uint32_t pte) {
+    if (pte & PTE_PRESENT) {
+        pmm_frame_unref(pte & 0xFFFFF000);
+    }
+}
+
+static bool vmm_zero_frame_init(void) {
+    if (vmm_user.zero_frame) {
+        return true;
+    }
+    uintptr_t frame = pmm_alloc_frame();
+    if (!frame) {
+        return false;
+    }
+    memset((void*)frame, 0, PAGE_SIZE);
+    vmm_user.zero_frame = frame; /* Holds its own reference forever */
+    return true;
+}
+
+uint32_t* vmm_get_kernel_directory(void) {
+    return page_directory;
+}
+
+void vmm_switch_address_space(uint32_t* directory) {
+    if (!mmu_initialized || !directory || directory == vmm_active_directory()) {
+        return;
+    }
+    __asm__ volatile("mov %0, %%cr3" : : "r"(directory) : "memory");
+}
+
+/**
+ * vmm_map_anonymous – Reserve demand-zero user memory in the active
+ * address space. No frames are allocated here; reads map the shared
+ * zero frame and the first write to a page gives it a private frame.
+ */
+bool vmm_map_anonymous(uint32_t virtual_addr, uint32_t size, bool writable) {
+    if (!mmu_initialized || size == 0 || !vmm_zero_frame_init()) {
+        return false;
+    }
+
+    uint32_t* directory = vmm_active_directory();
+    uint32_t virt = virtual_addr & 0xFFFFF000;
+    uint32_t end  = (virtual_addr + size + PAGE_SIZE - 1) & 0xFFFFF000;
+    uint32_t marker = PTE_ANON | PTE_USER | (writable ? PTE_WRITE : 0);
+
+    spinlock_acquire(&vmm_user.lock);
+    for (; virt < end; virt += PAGE_SIZE) {
+        uint32_t pd_index = virt >> 22;
+        uint32_t pde = directory[pd_index];
+
+        if (!(pde & PTE_PRESENT)) {
+            uint32_t* page_table = (uint32_t*)kzalloc(PAGE_SIZE);
+            if (!page_table) {
+                spinlock_release(&vmm_user.lock);
+                return false;
+            }
+            pde = (uint32_t)page_table | PTE_PRESENT | PTE_WRITE | PTE_USER;
+            directory[pd_index] = pde;
+        } else if (!(pde & PTE_USER) || (pde & PDE_LARGE)) {
+            spinlock_release(&vmm_user.lock);
+            KLOG_W("VMM: %08x overlaps a kernel mapping", virt);
+            return false;
+        }
+
+        uint32_t* page_table = (uint32_t*)(pde & 0xFFFFF000);
+        uint32_t pt_index = (virt >> 12) & 0x3FF;
+        vmm_release_pte(page_table[pt_index]);
+        page_table[pt_index] = marker;
+        tlb_flush_page(virt);
+    }
+    spinlock_release(&vmm_user.lock);
+    return true;
+}
+
+/**
+ * vmm_alloc_anonymous – Place demand-zero user memory at *cursor, which
+ * starts out 0, in the active address space. The cursor moves past the
+ * region and an unmapped guard page. Returns the region's address or 0.
+ */
+uint32_t vmm_alloc_anonymous(uint32_t* cursor, uint32_t size, bool writable) {
+    if (!mmu_initialized || !cursor || size == 0) {
+        return 0;
+    }
+
+    uint32_t base = *cursor ? *cursor : vmm_user.base;
+    uint32_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    if (base >= VMM_USER_END || pages > (VMM_USER_END - base) / PAGE_SIZE - 1) {
+        return 0;
+    }
+    if (!vmm_map_anonymous(base, size, writable)) {
+        return 0;
+    }
+    *cursor = base + (pages + 1) * PAGE_SIZE;
+    return base;
+}
+
+/**
+ * vmm_clone_address_space – Duplicate the user half of an address space
+ * for fork(). Only page tables are copied; data frames are shared
+ * copy-on-write and gain one reference each.
+ */
+uint32_t* vmm_clone_address_space(uint32_t* source) {
+    if (!mmu_initialized || !source) {
+        return NULL;
+    }
+
+    uint32_t* directory = (uint32_t*)kmalloc_aligned(PAGE_SIZE);
+    if (!directory) {
+        return NULL;
+    }
+
+    spinlock_acquire(&vmm_user.lock);
+    for (uint32_t i = 0; i < PAGE_DIRECTORY_SIZE; i++) {
+        uint32_t pde = source[i];
+        if (!(pde & PTE_PRESENT) || !(pde & PTE_USER) || (pde & PDE_LARGE)) {
+            directory[i] = pde; /* Kernel mappings are shared */
+            continue;
+        }
+
+        uint32_t* page_table = (uint32_t*)kmalloc_aligned(PAGE_SIZE);
+        if (!page_table) {
+            spinlock_release(&vmm_user.lock);
+            for (uint32_t j = i; j < PAGE_DIRECTORY_SIZE; j++) {
+                directory[j] = 0;
+            }
+            vmm_destroy_address_space(directory);
+            return NULL;
+        }
+
+        uint32_t* parent_table = (uint32_t*)(pde & 0xFFFFF000);
+        for (uint32_t j = 0; j < PAGE_TABLE_SIZE; j++) {
+            uint32_t pte = parent_table[j];
+            if (pte & PTE_PRESENT) {
+                if (pte & PTE_WRITE) {
+                    pte = (pte & ~PTE_WRITE) | PTE_COW;
+                    parent_table[j] = pte;
+                }
+                pmm_frame_ref(pte & 0xFFFFF000);
+            }
+            page_table[j] = pte;
+        }
+        directory[i] = (uint32_t)page_table | (pde & PTE_FLAGS);
+    }
+    spinlock_release(&vmm_user.lock);
+
+    /* The parent's writable entries just became read-only */
+    if (source == vmm_active_directory()) {
+        tlb_flush_all();
+    }
+    return directory;
+}
+
+/* Release the user page tables and frames of an inactive address space */
+void vmm_destroy_address_space(uint32_t* directory) {
+    if (!directory || directory == page_directory) {
+        return;
+    }
+    if (directory == vmm_active_directory()) {
+        KLOG_W("VMM: refusing to destroy the active address space");
+        return;
+    }
+
+    spinlock_acquire(&vmm_user.lock);
+    for (uint32_t i = 0; i < PAGE_DIRECTORY_SIZE; i++) {
+        uint32_t pde = directory[i];
+        if (!(pde & PTE_PRESENT) || !(pde & PTE_USER) || (pde & PDE_LARGE)) {
+            continue;
+        }
+        uint32_t* page_table = (uint32_t*)(pde & 0xFFFFF000);
+        for (uint32_t j = 0; j < PAGE_TABLE_SIZE; j++) {
+            vmm_release_pte(page_table[j]);
+        }
+        kfree(page_table);
+    }
+    spinlock_release(&vmm_user.lock);
+    kfree(directory);
+}
+
+/**
+ * vmm_handle_page_fault – Resolve copy-on-write and demand-zero faults.
+ * Returns false for genuine faults so the caller can report them.
+ */
+bool vmm_handle_page_fault(uint32_t fault_addr, uint32_t error_code) {
+    if (!mmu_initialized) {
+        return false;
+    }
+
+    uint32_t* directory = vmm_active_directory();
+    uint32_t pde = directory[fault_addr >> 22];
+    if (!(pde & PTE_PRESENT) || !(pde & PTE_USER) || (pde & PDE_LARGE)) {
+        return false;
+    }
+
+    uint32_t* page_table = (uint32_t*)(pde & 0xFFFFF000);
+    uint32_t pt_index = (fault_addr >> 12) & 0x3FF;
+    uint32_t page_addr = fault_addr & 0xFFFFF000;
+    bool write = (error_code & PF_WRITE) != 0;
+    bool handled = false;
+
+    spinlock_acquire(&vmm_user.lock);
+    uint32_t pte = page_table[pt_index];
+
+    if (!(pte & PTE_PRESENT) && (pte & PTE_ANON)) {
+        uint32_t flags = pte & (PTE_USER | PTE_WRITE);
+        if (write && (flags & PTE_WRITE)) {
+            uintptr_t frame = pmm_alloc_frame();
+            if (frame) {
+                memset((void*)frame, 0, PAGE_SIZE);
+                page_table[pt_index] = frame | flags | PTE_PRESENT;
+                vmm_user.zero_fills++;
+                handled = true;
+            }
+        } else if (!write) {
+            /* Remember writability in PTE_COW so the first write can upgrade */
+            pmm_frame_ref(vmm_user.zero_frame);
+            page_table[pt_index] = vmm_user.zero_frame | PTE_PRESENT | PTE_USER |
+                                   ((flags & PTE_WRITE) ? PTE_COW : 0);
+            vmm_user.zero_maps++;
+            handled = true;
+        }
+    } else if ((pte & PTE_PRESENT) && write && (pte & PTE_COW)) {
+        uintptr_t old_frame = pte & 0xFFFFF000;
+        uint32_t flags = (pte & PTE_FLAGS & ~PTE_COW) | PTE_WRITE;
+
+        if (old_frame != vmm_user.zero_frame && pmm_frame_refcount(old_frame) == 1) {
+            /* Every other sharer already copied or exited */
+            page_table[pt_index] = old_frame | flags;
+            vmm_user.cow_reuses++;
+            handled = true;
+        } else {
+            uintptr_t frame = pmm_alloc_frame();
+            if (frame) {
+                if (old_frame == vmm_user.zero_frame) {
+                    memset((void*)frame, 0, PAGE_SIZE);
+                    vmm_user.zero_fills++;
+                } else {
+                    memcpy((void*)frame, (const void*)old_frame, PAGE_SIZE);
+                    vmm_user.cow_copies++;
+                }
+                page_table[pt_index] = frame | flags;
+                pmm_frame_unref(old_frame);
+                handled = true;
+            }
+        }
+    }
+
+    if (handled) {
+        tlb_flush_page(page_addr);
+    }
+    spinlock_release(&vmm_user.lock);
+
+    if (!handled && (pte & (PTE_COW | PTE_ANON))) {
+        KLOG_E("VMM: out of memory resolving fault at %08x", fault_addr);
+    }
+    return handled;
+}
+
+/**
+ * vmm_fault_in – Make the page holding an address of the active address
+ * space present for reading, resolving a demand-zero entry the way a read
+ * fault would. For callers that must read it where faulting is not allowed.
+ */
+bool vmm_fault_in(uint32_t virtual_addr) {
+    if (!mmu_initialized) {
+        return true; /* Everything is identity mapped */
+    }
+
+    uint32_t pde = vmm_active_directory()[virtual_addr >> 22];
+    if (!(pde & PTE_PRESENT)) {
+        return false;
+    }
+    if (pde & PDE_LARGE) {
+        return true;
+    }
+
+    uint32_t pte = ((uint32_t*)(pde & 0xFFFFF000))[(virtual_addr >> 12) & 0x3FF];
+    if (pte & PTE_PRESENT) {
+        return true;
+    }
+    return vmm_handle_page_fault(virtual_addr, 0);
+}
 
-static uint32_t* page_directory = NULL;
-static memory_block_t* heap_blocks = NULL;
-static uint32_t total_memory = 0;
-static uint32_t used_memory = 0;
-static bool mmu_initialized = false;
+bool vmm_get_fault_stats(vmm_fault_stats_t* stats) {
+    if (!stats) {
+        return false;
+    }
+    stats->cow_copies = vmm_user.cow_copies;
+    stats->cow_reuses = vmm_user.cow_reuses;
+    stats->zero_fills = vmm_user.zero_fills;
+    stats->zero_maps  = vmm_user.zero_maps;
+    return true;
+}
 
-// Memory map from multiboot info
-static struct memory_map {
-    uint64_t base_addr;
-    uint64_t length;
-    uint32_t type;
-} __attribute__((packed)) *memory_map;
+/* ─── heap internals ───────────────────────────────────────────── */
 
-bool pmm_init(struct multiboot_info* mbi) {
-    if (!mbi || !(mbi->flags & 0x40)) {
-        return false;
+static inline uint32_t block_size(const heap_block_t* block) {
+    return block->size & ~BLOCK_FLAGS;
+}
+
+static inline heap_block_t* block_next(heap_block_t* block) {
+    return (heap_block_t*)((uint8_t*)block + block_size(block));
+}
+
+static inline void block_set_footer(heap_block_t* block) {
+    *(uint32_t*)((uint8_t*)block + block_size(block) - sizeof(uint32_t)) = block_size(block);
+}
+
+static inline uint32_t fls32(uint32_t value) {
+    return 31 - __builtin_clz(value);
+}
+
+static uint32_t bin_class_size(uint32_t bin) {
+    return (bin & 1) ? (3u << (bin / 2 + 4)) : (1u << (bin / 2 + 5));
+}
+
+/* Bin holding free blocks of this size: largest class <= size */
+static uint32_t bin_for_free(uint32_t size) {
+    uint32_t p = fls32(size);
+    uint32_t bin = (p - 5) * 2 + ((size >> (p - 1)) & 1);
+    return bin < HEAP_BIN_COUNT ? bin : HEAP_BIN_COUNT - 1;
+}
+
+/* First bin whose every block can hold this size */
+static uint32_t bin_for_request(uint32_t size) {
+    uint32_t bin = bin_for_free(size);
+    if (bin_class_size(bin) < size) {
+        bin++;
     }
+    return bin;
+}
 
-    memory_map = (struct memory_map*)mbi->mmap_addr;
-    uint32_t mmap_end = mbi->mmap_addr + mbi->mmap_length;
+static void bin_insert(heap_block_t* block) {
+    uint32_t bin = bin_for_free(block_size(block));
+    block->magic = HEAP_MAGIC_FREE;
+    block->prev_free = NULL;
+    block->next_free = heap.bins[bin];
+    if (block->next_free) {
+        block->next_free->prev_free = block;
+    }
+    heap.bins[bin] = block;
+    heap.bin_bitmap |= 1u << bin;
+}
 
-    // Calculate total available memory
-    total_memory = 0;
-    while ((uint32_t)memory_map < mmap_end) {
-        if (memory_map->type == 1) { // Available memory
-            total_memory += memory_map->length;
+static void bin_remove(heap_block_t* block) {
+    uint32_t bin = bin_for_free(block_size(block));
+    if (block->prev_free) {
+        block->prev_free->next_free = block->next_free;
+    } else {
+        heap.bins[bin] = block->next_free;
+        if (!heap.bins[bin]) {
+            heap.bin_bitmap &= ~(1u << bin);
         }
-        memory_map = (struct memory_map*)((uint32_t)memory_map + memory_map->length + sizeof(uint32_t));
+    }
+    if (block->next_free) {
+        block->next_free->prev_free = block->prev_free;
+    }
+}
+
+/* Pull a fresh arena from the PMM; caller holds the heap lock */
+static bool heap_grow(void) {
+    uintptr_t base = pmm_alloc_pages(HEAP_ARENA_ORDER);
+    if (!base) {
+        return false;
     }
 
+    /* One free block spanning the arena, then a zero-size used sentinel
+       so coalescing never walks off the end */
+    heap_block_t* block = (heap_block_t*)base;
+    block->size = (HEAP_ARENA_SIZE - HEAP_HEADER_SIZE) | BLOCK_PREV_USED | BLOCK_FIRST;
+    block_set_footer(block);
+    bin_insert(block);
+
+    heap_block_t* sentinel = block_next(block);
+    sentinel->size = BLOCK_USED;
+    sentinel->magic = HEAP_MAGIC_USED;
+
+    heap.arena_count++;
     return true;
 }
 
-bool vmm_init(void) {
-    if (mmu_initialized) {
-        return true;
+/* Usage accounting for blocks entering/leaving the shared heap; caller holds the lock */
+static inline void heap_account_alloc(uint32_t bytes) {
+    heap.used_memory += bytes;
+    if (heap.used_memory > heap.peak_memory) {
+        heap.peak_memory = heap.used_memory;
     }
+    heap.total_allocated += bytes;
+    heap.allocation_count++;
+}
 
-    // Allocate page directory
-    page_directory = (uint32_t*)kmalloc_aligned(PAGE_SIZE);
-    if (!page_directory) {
-        return false;
+static inline void heap_account_free(uint32_t bytes) {
+    heap.used_memory -= bytes;
+    heap.total_freed += bytes;
+    heap.free_count++;
+}
+
+/* Whole buddy blocks handed out directly; tagged so kfree() can spot them */
+static void* heap_alloc_pages(size_t size, bool zeroed) {
+    uint32_t order = pmm_order_for_size(size);
+    if (((size_t)PAGE_SIZE << order) < size) {
+        return NULL;
     }
 
-    // Clear page directory
-    memset(page_directory, 0, PAGE_SIZE);
+    uintptr_t base = zeroed ? pmm_alloc_zeroed_pages(order) : pmm_alloc_pages(order);
+    if (!base) {
+        return NULL;
+    }
+
+    pmm_frame_to_page(base)->flags |= PAGE_FLAG_DIRECT;
+
+    spinlock_acquire(&heap.lock);
+    heap_account_alloc(PAGE_SIZE << order);
+    spinlock_release(&heap.lock);
 
-    // Identity map first 4MB
-    for (uint32_t i = 0; i < 1024; i++) {
-        page_map(i * PAGE_SIZE, i * PAGE_SIZE);
+    return (void*)base;
+}
+
+static bool heap_free_pages(void* ptr) {
+    if ((uintptr_t)ptr & (PAGE_SIZE - 1)) {
+        return false;
     }
 
-    // Set up page directory
-    uint32_t cr0;
-    __asm__ volatile(
-        "mov %%cr0, %0"
-        : "=r"(cr0)
-    );
-    cr0 |= 0x80000000; // Enable paging
+    page_t* page = pmm_frame_to_page((uintptr_t)ptr);
+    if (!page || !(page->flags & PAGE_FLAG_DIRECT)) {
+        return false;
+    }
 
-    __asm__ volatile(
-        "mov %0, %%cr3
-"
-        "mov %1, %%cr0"
-        : : "r"(page_directory), "r"(cr0)
-    );
+    uint32_t order = page->order;
+    page->flags &= ~PAGE_FLAG_DIRECT;
 
-    mmu_initialized = true;
+    spinlock_acquire(&heap.lock);
+    heap_account_free(PAGE_SIZE << order);
+    spinlock_release(&heap.lock);
+
+    pmm_free_pages((uintptr_t)ptr, order);
     return true;
 }
 
-bool page_map(uint32_t virtual_addr, uint32_t physical_addr) {
-    if (!mmu_initialized) {
+/* Remove a free block of at least `needed` bytes from the bins; caller holds the lock */
+static heap_block_t* heap_take(uint32_t needed) {
+    uint32_t first_bin = bin_for_request(needed);
+    uint32_t candidates = heap.bin_bitmap & ~((1u << first_bin) - 1);
+    if (!candidates) {
+        if (!heap_grow()) {
+            return NULL;
+        }
+        candidates = heap.bin_bitmap & ~((1u << first_bin) - 1);
+    }
+
+    heap_block_t* block = heap.bins[__builtin_ctz(candidates)];
+    bin_remove(block);
+    return block;
+}
+
+/* Trim a taken block to `needed` bytes and mark it used; caller holds the lock */
+static void* heap_claim(heap_block_t* block, uint32_t needed) {
+    /* Split off the tail if it can stand as a block of its own */
+    uint32_t total = block_size(block);
+    if (total - needed >= HEAP_MIN_BLOCK) {
+        heap_block_t* rest = (heap_block_t*)((uint8_t*)block + needed);
+        rest->size = (total - needed) | BLOCK_PREV_USED;
+        block_set_footer(rest);
+        bin_insert(rest);
+        block->size = needed | (block->size & BLOCK_FLAGS);
+    } else {
+        block_next(block)->size |= BLOCK_PREV_USED;
+    }
+
+    block->size |= BLOCK_USED;
+    block->magic = HEAP_MAGIC_USED;
+    heap_account_alloc(block_size(block));
+    return (uint8_t*)block + HEAP_HEADER_SIZE;
+}
+
+static inline uint32_t heap_block_needed(size_t size) {
+    uint32_t needed = (size + HEAP_HEADER_SIZE + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1);
+    return needed < HEAP_MIN_BLOCK ? HEAP_MIN_BLOCK : needed;
+}
+
+/**
+ * heap_resize – Fit a used block to `size` without moving it, absorbing the
+ * following block when it is free. False when the payload has to move.
+ */
+static bool heap_resize(heap_block_t* block, size_t size) {
+    if (size > HEAP_SMALL_MAX - HEAP_HEADER_SIZE) {
         return false;
     }
 
-    uint32_t pd_index = virtual_addr >> 22;
-    uint32_t pt_index = (virtual_addr >> 12) & 0x3FF;
+    uint32_t needed = heap_block_needed(size);
+    uint32_t current = block_size(block);
+    if (needed <= current) {
+        return true; /* Spare capacity left by the size class */
+    }
 
-    // Get/Create page table
-    uint32_t* page_table;
-    if (!(page_directory[pd_index] & 1)) {
-        page_table = (uint32_t*)kmalloc_aligned(PAGE_SIZE);
-        if (!page_table) {
-            return false;
-        }
-        memset(page_table, 0, PAGE_SIZE);
-        page_directory[pd_index] = ((uint32_t)page_table) | 3; // Present + RW
+    spinlock_acquire(&heap.lock);
+
+    heap_block_t* next = block_next(block);
+    if ((next->size & BLOCK_USED) || current + block_size(next) < needed) {
+        spinlock_release(&heap.lock);
+        return false;
+    }
+
+    bin_remove(next);
+    uint32_t total = current + block_size(next);
+    uint32_t flags = block->size & BLOCK_FLAGS;
+    if (total - needed >= HEAP_MIN_BLOCK) {
+        heap_block_t* rest = (heap_block_t*)((uint8_t*)block + needed);
+        rest->size = (total - needed) | BLOCK_PREV_USED;
+        block_set_footer(rest);
+        bin_insert(rest);
+        block->size = needed | flags;
     } else {
-        page_table = (uint32_t*)(page_directory[pd_index] & 0xFFFFF000);
+        block->size = total | flags;
+        block_next(block)->size |= BLOCK_PREV_USED;
     }
 
-    // Map the page
-    page_table[pt_index] = (physical_addr & 0xFFFFF000) | 3;
-    
-    // Invalidate TLB entry
-    __asm__ volatile("invlpg (%0)" : : "r"(virtual_addr));
+    heap.used_memory += block_size(block) - current;
+    if (heap.used_memory > heap.peak_memory) {
+        heap.peak_memory = heap.used_memory;
+    }
 
+    spinlock_release(&heap.lock);
     return true;
 }
 
-void* kmalloc(size_t size) {
-    if (size == 0) {
-        return NULL;
+static void* heap_alloc(size_t size) {
+    if (size > HEAP_SMALL_MAX - HEAP_HEADER_SIZE) {
+        return heap_alloc_pages(size, false);
     }
 
-    // Round up to 4-byte alignment
-    size = (size + 3) & ~3;
+    uint32_t needed = heap_block_needed(size);
 
-    memory_block_t* block = heap_blocks;
-    memory_block_t* best_fit = NULL;
-    uint32_t best_size = 0xFFFFFFFF;
+    spinlock_acquire(&heap.lock);
+    heap_block_t* block = heap_take(needed);
+    void* ptr = block ? heap_claim(block, needed) : NULL;
+    spinlock_release(&heap.lock);
 
-    // Find best fit block
-    while (block) {
-        if (!block->used && block->size >= size) {
-            if (block->size < best_size) {
-                best_fit = block;
-                best_size = block->size;
-            }
+    return ptr;
+}
+
+static void* kmalloc_small(size_t size);
+
+static void* heap_alloc_aligned(size_t size, size_t alignment) {
+    if (size == 0 || (alignment & (alignment - 1))) {
+        return NULL;
+    }
+    if (alignment <= HEAP_ALIGN) {
+        return kmalloc_small(size);
+    }
+
+    /* Page-sized or page-aligned requests: buddy blocks are naturally aligned */
+    uint32_t needed = heap_block_needed(size);
+    if (alignment >= PAGE_SIZE || needed + alignment + HEAP_MIN_BLOCK > HEAP_SMALL_MAX) {
+        if (size < alignment) {
+            size = alignment;
         }
-        block = block->next;
+        return heap_alloc_pages(size, false);
+    }
+
+    if (!heap.initialized) {
+        return NULL;
     }
 
-    if (!best_fit) {
+    spinlock_acquire(&heap.lock);
+
+    heap_block_t* block = heap_take(needed + alignment + HEAP_MIN_BLOCK);
+    if (!block) {
+        spinlock_release(&heap.lock);
         return NULL;
     }
 
-    // Split block if too large
-    if (best_fit->size > size + sizeof(memory_block_t) + 4) {
-        memory_block_t* new_block = (memory_block_t*)(best_fit->start + size);
-        new_block->start = best_fit->start + size;
-        new_block->size = best_fit->size - size - sizeof(memory_block_t);
-        new_block->used = false;
-        new_block->next = best_fit->next;
-        
-        best_fit->size = size;
-        best_fit->next = new_block;
+    /* Carve the padding in front of the aligned payload off as its own
+       free block so nothing is lost and kfree() sees a normal header */
+    uintptr_t payload = (uintptr_t)block + HEAP_HEADER_SIZE;
+    uintptr_t aligned = (payload + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    while (aligned != payload && aligned - payload < HEAP_MIN_BLOCK) {
+        aligned += alignment;
+    }
+
+    if (aligned != payload) {
+        uint32_t lead = (uint32_t)(aligned - payload);
+        uint32_t total = block_size(block);
+        heap_block_t* carved = (heap_block_t*)(aligned - HEAP_HEADER_SIZE);
+
+        block->size = lead | (block->size & (BLOCK_PREV_USED | BLOCK_FIRST));
+        block_set_footer(block);
+        bin_insert(block);
+
+        carved->size = total - lead;
+        block = carved;
     }
 
-    best_fit->used = true;
-    used_memory += best_fit->size;
+    void* ptr = heap_claim(block, needed);
+    spinlock_release(&heap.lock);
+    return ptr;
+}
 
-    return (void*)best_fit->start;
+void* memory_alloc_aligned(size_t size, size_t alignment) {
+    void* ptr = heap_alloc_aligned(size, alignment);
+    HEAP_PROFILE_ALLOC(ptr, size);
+    return ptr;
 }
 
 void* kmalloc_aligned(size_t size) {
-    if (size == 0) {
-        return NULL;
+    void* ptr = heap_alloc_aligned(size, PAGE_SIZE);
+    HEAP_PROFILE_ALLOC(ptr, size);
+    return ptr;
+}
+
+static void heap_free(void* ptr) {
+    if (heap_free_pages(ptr)) {
+        return;
     }
 
-    // Round up to page size
-    size = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
-    
-    void* ptr = kmalloc(size + PAGE_SIZE);
-    if (!ptr) {
-        return NULL;
+    heap_block_t* block = (heap_block_t*)((uint8_t*)ptr - HEAP_HEADER_SIZE);
+
+    if (block->magic != HEAP_MAGIC_USED || !(block->size & BLOCK_USED)) {
+        /* Double free or a pointer kmalloc never returned */
+        return;
     }
 
-    uint32_t addr = (uint32_t)ptr;
-    uint32_t aligned_addr = (addr + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
-    
-    if (addr != aligned_addr) {
-        kfree(ptr);
-        ptr = kmalloc(size + (aligned_addr - addr));
-        if (!ptr) {
+    spinlock_acquire(&heap.lock);
+
+    heap_account_free(block_size(block));
+    uint32_t flags = block->size & (BLOCK_PREV_USED | BLOCK_FIRST);
+    uint32_t size = block_size(block);
+
+    /* Merge with the following block */
+    heap_block_t* next = block_next(block);
+    if (!(next->size & BLOCK_USED)) {
+        bin_remove(next);
+        size += block_size(next);
+        next->magic = 0;
+    }
+
+    /* Merge with the preceding block via its boundary tag */
+    if (!(flags & BLOCK_PREV_USED)) {
+        uint32_t prev_size = *(uint32_t*)((uint8_t*)block - sizeof(uint32_t));
+        heap_block_t* prev = (heap_block_t*)((uint8_t*)block - prev_size);
+        bin_remove(prev);
+        flags = prev->size & (BLOCK_PREV_USED | BLOCK_FIRST);
+        size += prev_size;
+        /* The absorbed header must not pass a later double-free check */
+        block->magic = 0;
+        block = prev;
+    }
+
+    block->size = size | flags;
+    block_set_footer(block);
+    next = block_next(block);
+    next->size &= ~BLOCK_PREV_USED;
+
+    /* Hand a completely free arena back, but always keep one around */
+    if ((flags & BLOCK_FIRST) && next->size == BLOCK_USED &&
+        size == HEAP_ARENA_SIZE - HEAP_HEADER_SIZE && heap.arena_count > 1) {
+        heap.arena_count--;
+        block->magic = 0;
+        spinlock_release(&heap.lock);
+        pmm_free_pages((uintptr_t)block, HEAP_ARENA_ORDER);
+        return;
+    }
+
+    bin_insert(block);
+    spinlock_release(&heap.lock);
+}
+
+/* ─── per-CPU magazine layer ───────────────────────────────────── */
+
+static heap_cpu_cache_t* heap_cpu_cache(void) {
+    uint32_t apic_id = apic_get_id() & 0xFF;
+    uint32_t slot = depot.cpu_map[apic_id];
+    if (!slot) {
+        slot = __sync_add_and_fetch(&depot.cpu_count, 1);
+        if (slot > HEAP_MAX_CPUS) {
             return NULL;
         }
+        depot.cpu_map[apic_id] = (uint8_t)slot;
+    }
+    return &depot.cpus[slot - 1];
+}
+
+/* Depot operations; caller holds depot.lock */
+static magazine_t* depot_take(magazine_t** list) {
+    magazine_t* mag = *list;
+    if (mag) {
+        *list = mag->next;
+        mag->next = NULL;
     }
+    return mag;
+}
 
-    return (void*)aligned_addr;
+static void depot_put(magazine_t** list, magazine_t* mag) {
+    mag->next = *list;
+    *list = mag;
 }
 
-void kfree(void* ptr) {
-    if (!ptr) {
-        return;
+static magazine_t* magazine_new(void) {
+    magazine_t* mag = heap_alloc(sizeof(magazine_t));
+    if (mag) {
+        mag->rounds = 0;
+        mag->next = NULL;
+    }
+    return mag;
+}
+
+static void magazine_flush(magazine_t* mag) {
+    while (mag->rounds) {
+        void* obj = mag->objs[--mag->rounds];
+        ((heap_block_t*)((uint8_t*)obj - HEAP_HEADER_SIZE))->magic = HEAP_MAGIC_USED;
+        heap_free(obj);
     }
+}
 
-    memory_block_t* block = heap_blocks;
-    while (block) {
-        if (block->start == (uint32_t)ptr) {
-            block->used = false;
-            used_memory -= block->size;
+/* Called with interrupts disabled */
+static void* magazine_alloc(heap_cpu_cache_t* cpu, uint32_t cls) {
+    magazine_t* loaded = cpu->loaded[cls];
 
-            // Merge with next block if free
-            if (block->next && !block->next->used) {
-                block->size += block->next->size + sizeof(memory_block_t);
-                block->next = block->next->next;
+    if (!loaded || !loaded->rounds) {
+        magazine_t* previous = cpu->previous[cls];
+        if (previous && previous->rounds) {
+            cpu->previous[cls] = loaded;
+            cpu->loaded[cls] = loaded = previous;
+        } else {
+            /* Both empty: swap a full magazine in from the depot */
+            cpu->stats.alloc_misses++;
+            spinlock_acquire(&depot.lock);
+            magazine_t* full = depot_take(&depot.full[cls]);
+            if (full) {
+                depot.full_count[cls]--;
+                if (previous) {
+                    depot_put(&depot.empty[cls], previous);
+                }
+                cpu->previous[cls] = loaded;
+                cpu->loaded[cls] = full;
+                spinlock_release(&depot.lock);
+                full->rounds--;
+                return full->objs[full->rounds];
             }
+            spinlock_release(&depot.lock);
 
-            // Find previous block
-            memory_block_t* prev = heap_blocks;
-            while (prev && prev->next != block) {
-                prev = prev->next;
+            /* Depot dry: refill the loaded magazine from the heap in one batch */
+            if (!loaded) {
+                loaded = cpu->loaded[cls] = magazine_new();
+                if (!loaded) {
+                    return NULL;
+                }
+            }
+            uint32_t payload = bin_class_size(cls) - HEAP_HEADER_SIZE;
+            while (loaded->rounds < HEAP_MAG_BATCH) {
+                void* obj = heap_alloc(payload);
+                if (!obj) {
+                    break;
+                }
+                ((heap_block_t*)((uint8_t*)obj - HEAP_HEADER_SIZE))->magic = HEAP_MAGIC_CACHED;
+                loaded->objs[loaded->rounds++] = obj;
             }
+            if (!loaded->rounds) {
+                return NULL;
+            }
+            loaded->rounds--;
+            return loaded->objs[loaded->rounds];
+        }
+    }
+
+    cpu->stats.alloc_hits++;
+    loaded->rounds--;
+    return loaded->objs[loaded->rounds];
+}
+
+/* Called with interrupts disabled; false means the caller frees to the heap */
+static bool magazine_free(heap_cpu_cache_t* cpu, uint32_t cls, void* obj) {
+    magazine_t* loaded = cpu->loaded[cls];
 
-            // Merge with previous block if free
-            if (prev && !prev->used) {
-                prev->size += block->size + sizeof(memory_block_t);
-                prev->next = block->next;
+    if (!loaded || loaded->rounds == HEAP_MAG_ROUNDS) {
+        magazine_t* previous = cpu->previous[cls];
+        if (previous && previous->rounds < HEAP_MAG_ROUNDS) {
+            cpu->previous[cls] = loaded;
+            cpu->loaded[cls] = loaded = previous;
+        } else {
+            /* Both full: hand one to the depot and load an empty one */
+            cpu->stats.free_misses++;
+            spinlock_acquire(&depot.lock);
+            magazine_t* empty = depot_take(&depot.empty[cls]);
+            magazine_t* spill = NULL;
+            if (previous) {
+                if (depot.full_count[cls] < HEAP_DEPOT_MAX) {
+                    depot_put(&depot.full[cls], previous);
+                    depot.full_count[cls]++;
+                } else {
+                    spill = previous;
+                }
             }
+            spinlock_release(&depot.lock);
 
-            break;
+            /* Depot saturated: batch-flush the spilled magazine and reuse it */
+            if (spill) {
+                magazine_flush(spill);
+                if (!empty) {
+                    empty = spill;
+                } else {
+                    spinlock_acquire(&depot.lock);
+                    depot_put(&depot.empty[cls], spill);
+                    spinlock_release(&depot.lock);
+                }
+            }
+            if (!empty) {
+                empty = magazine_new();
+                if (!empty) {
+                    cpu->previous[cls] = NULL;
+                    return false;
+                }
+            }
+            cpu->previous[cls] = loaded;
+            cpu->loaded[cls] = loaded = empty;
+            goto push;
         }
-        block = block->next;
     }
+    cpu->stats.free_hits++;
+
+push:
+    ((heap_block_t*)((uint8_t*)obj - HEAP_HEADER_SIZE))->magic = HEAP_MAGIC_CACHED;
+    loaded->objs[loaded->rounds++] = obj;
+    return true;
 }
 
-uint32_t get_total_memory(void) {
-    return total_memory;
+/* ─── kernel heap API ──────────────────────────────────────────── */
+
+/* kmalloc() without profiling; fast path through the CPU's magazine */
+static void* kmalloc_small(size_t size) {
+    if (size == 0 || !heap.initialized) {
+        return NULL;
+    }
+
+    uint32_t needed = (size + HEAP_HEADER_SIZE + HEAP_ALIGN - 1) & ~(HEAP_ALIGN - 1);
+    if (needed < HEAP_MIN_BLOCK) {
+        needed = HEAP_MIN_BLOCK;
+    }
+
+    uint32_t cls = bin_for_request(needed);
+    if (size <= HEAP_SMALL_MAX && cls < HEAP_MAG_CLASSES) {
+        uint32_t flags = interrupt_disable();
+        heap_cpu_cache_t* cpu = heap_cpu_cache();
+        void* obj = cpu ? magazine_alloc(cpu, cls) : NULL;
+        interrupt_restore(flags);
+        if (obj) {
+            ((heap_block_t*)((uint8_t*)obj - HEAP_HEADER_SIZE))->magic = HEAP_MAGIC_USED;
+            return obj;
+        }
+    }
+
+    return heap_alloc(size);
+}
+
+void* kmalloc(size_t size) {
+    void* ptr = kmalloc_small(size);
+    HEAP_PROFILE_ALLOC(ptr, size);
+    return ptr;
+}
+
+/**
+ * kzalloc – kmalloc() returning zeroed memory. Requests of a page or more
+ * are whole page-aligned blocks taken from the PMM's pre-zeroed pool, so
+ * large buffers and page tables skip the memset on this path.
+ */
+void* kzalloc(size_t size) {
+    void* ptr;
+    if (size > HEAP_SMALL_MAX - HEAP_HEADER_SIZE) {
+        ptr = heap_alloc_pages(size, true);
+    } else {
+        ptr = kmalloc_small(size);
+        if (ptr) {
+            memset(ptr, 0, size);
+        }
+    }
+    HEAP_PROFILE_ALLOC(ptr, size);
+    return ptr;
+}
+
+void kfree(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    if (is_vmalloc_addr(ptr)) {
+        vfree(ptr);
+        return;
+    }
+    HEAP_PROFILE_FREE(ptr);
+    if (heap_free_pages(ptr) || !heap.initialized) {
+        return;
+    }
+
+    heap_block_t* block = (heap_block_t*)((uint8_t*)ptr - HEAP_HEADER_SIZE);
+    if (block->magic == HEAP_MAGIC_USED) {
+        /* Only exact class-sized blocks are interchangeable in a magazine */
+        uint32_t size = block_size(block);
+        uint32_t cls = bin_for_free(size);
+        if (cls < HEAP_MAG_CLASSES && bin_class_size(cls) == size) {
+            uint32_t flags = interrupt_disable();
+            heap_cpu_cache_t* cpu = heap_cpu_cache();
+            bool cached = cpu && magazine_free(cpu, cls, ptr);
+            interrupt_restore(flags);
+            if (cached) {
+                return;
+            }
+        }
+    }
+
+    heap_free(ptr);
 }
 
-uint32_t pmm_get_total_memory(void) {
-    return total_memory;
+/**
+ * memory_realloc – Resize an allocation, keeping it in place when possible:
+ * spare size-class capacity or a free neighbouring block for heap blocks,
+ * the buddy block's slack for page blocks, and PTE remapping for vmalloc
+ * areas. Buffers copied past VMALLOC_REALLOC_MIN move to vmalloc so later
+ * growth remaps instead of copying. Returns NULL (ptr still valid) on
+ * failure or when size is 0.
+ */
+void* memory_realloc(void* ptr, size_t size) {
+    if (!ptr) {
+        return kmalloc(size);
+    }
+    if (size == 0) {
+        return NULL;
+    }
+
+    size_t capacity;
+    if (is_vmalloc_addr(ptr)) {
+        bool moved;
+        void* resized = vmalloc_resize(ptr, size, &moved);
+        if (resized) {
+            __sync_fetch_and_add(moved ? &realloc_stats.remaps : &realloc_stats.in_place, 1);
+            HEAP_PROFILE_FREE(ptr);
+            HEAP_PROFILE_ALLOC(resized, size);
+        }
+        return resized;
+    }
+
+    page_t* page = ((uintptr_t)ptr & (PAGE_SIZE - 1)) ? NULL : pmm_frame_to_page((uintptr_t)ptr);
+    if (page && (page->flags & PAGE_FLAG_DIRECT)) {
+        capacity = (size_t)PAGE_SIZE << page->order;
+        /* Shrinking to a small size copies so the pages go back to the PMM */
+        if (size <= capacity && size > HEAP_SMALL_MAX - HEAP_HEADER_SIZE) {
+            goto in_place;
+        }
+    } else {
+        heap_block_t* block = (heap_block_t*)((uint8_t*)ptr - HEAP_HEADER_SIZE);
+        if (block->magic != HEAP_MAGIC_USED || !(block->size & BLOCK_USED)) {
+            return NULL;
+        }
+        if (heap_resize(block, size)) {
+            goto in_place;
+        }
+        capacity = block_size(block) - HEAP_HEADER_SIZE;
+    }
+
+    void* moved_to = size >= VMALLOC_REALLOC_MIN ? vmalloc_area(size, false) : kmalloc_small(size);
+    if (!moved_to) {
+        return NULL;
+    }
+    memcpy(moved_to, ptr, capacity < size ? capacity : size);
+    kfree(ptr);
+    HEAP_PROFILE_ALLOC(moved_to, size);
+    __sync_fetch_and_add(&realloc_stats.copies, 1);
+    return moved_to;
+
+in_place:
+    HEAP_PROFILE_FREE(ptr);
+    HEAP_PROFILE_ALLOC(ptr, size);
+    __sync_fetch_and_add(&realloc_stats.in_place, 1);
+    return ptr;
+}
+
+bool memory_get_realloc_stats(memory_realloc_stats_t* stats) {
+    if (!stats) {
+        return false;
+    }
+    *stats = realloc_stats;
+    return true;
+}
+
+bool kmalloc_get_cpu_stats(uint32_t cpu, heap_magazine_stats_t* stats) {
+    if (!stats || cpu >= HEAP_MAX_CPUS || cpu >= depot.cpu_count) {
+        return false;
+    }
+    *stats = depot.cpus[cpu].stats;
+    return true;
+}
+
+void kmalloc_dump_cpu_stats(void) {
+    for (uint32_t cpu = 0; cpu < depot.cpu_count && cpu < HEAP_MAX_CPUS; cpu++) {
+        heap_magazine_stats_t* s = &depot.cpus[cpu].stats;
+        uint32_t allocs = s->alloc_hits + s->alloc_misses;
+        uint32_t frees  = s->free_hits + s->free_misses;
+        KLOG_I("CPU%u magazines: alloc %u/%u hit (%u%%), free %u/%u hit (%u%%)", cpu,
+               s->alloc_hits, allocs, allocs ? (uint32_t)((uint64_t)s->alloc_hits * 100 / allocs) : 0,
+               s->free_hits, frees, frees ? (uint32_t)((uint64_t)s->free_hits * 100 / frees) : 0);
+    }
+}
+
+uint32_t get_total_memory(void) {
+    return pmm_get_total_memory();
 }
 
 uint32_t get_used_memory(void) {
-    return used_memory;
+    return heap.used_memory;
+}
+
+/**
+ * memory_get_stats – Heap usage plus fragmentation of the free lists.
+ * fragmentation_ratio is how far the largest free block falls short of the
+ * free space it could have been (capped at one arena, since no block spans
+ * arenas): 0 means the free space is as contiguous as it can be. Usage
+ * figures count blocks leaving the shared heap (magazine rounds included)
+ * unless the profiler is built in, which counts every kmalloc()/kfree().
+ */
+memory_error_t memory_get_stats(memory_stats_t *stats) {
+    if (!stats) {
+        return MEMORY_ERROR_NULL_POINTER;
+    }
+    if (!heap.initialized) {
+        return MEMORY_ERROR_INSUFFICIENT_MEMORY;
+    }
+
+    uint32_t free_bytes = 0;
+    uint32_t largest = 0;
+
+    spinlock_acquire(&heap.lock);
+    for (uint32_t bin = 0; bin < HEAP_BIN_COUNT; bin++) {
+        for (heap_block_t* block = heap.bins[bin]; block; block = block->next_free) {
+            uint32_t size = block_size(block);
+            free_bytes += size;
+            if (size > largest) {
+                largest = size;
+            }
+        }
+    }
+    stats->total_allocated  = (size_t)heap.total_allocated;
+    stats->total_freed      = (size_t)heap.total_freed;
+    stats->current_usage    = heap.used_memory;
+    stats->peak_usage       = heap.peak_memory;
+    stats->allocation_count = heap.allocation_count;
+    stats->free_count       = heap.free_count;
+    spinlock_release(&heap.lock);
+
+    heap_profile_fill_stats(stats);
+    uint32_t reachable = free_bytes < HEAP_ARENA_SIZE - HEAP_HEADER_SIZE ?
+                         free_bytes : HEAP_ARENA_SIZE - HEAP_HEADER_SIZE;
+    stats->fragmentation_ratio = reachable ? 100 - (uint32_t)((uint64_t)largest * 100 / reachable) : 0;
+    return MEMORY_SUCCESS;
 }
 
 bool is_mmu_initialized(void) {
@@ -251,10 +2015,10 @@ bool is_mmu_initialized(void) {
  * memory_alloc_dma – Allocate physically contiguous, aligned memory for DMA.
  */
 void* memory_alloc_dma(size_t size, size_t alignment) {
-    // kmalloc_aligned currently just rounds to PAGE_SIZE.
-    // For specific alignment, we can use a wrapper.
-    (void)alignment; // alignment is handled by kmalloc_aligned to some extent
-    return kmalloc_aligned(size);
+    // Heap arenas and direct page blocks are both physically contiguous
+    void* ptr = heap_alloc_aligned(size, alignment ? alignment : HEAP_ALIGN);
+    HEAP_PROFILE_ALLOC(ptr, size);
+    return ptr;
 }
 
 /**
@@ -277,7 +2041,10 @@ uintptr_t memory_get_physical(void* virt_addr) {
     uint32_t pd_index = addr >> 22;
     uint32_t pt_index = (addr >> 12) & 0x3FF;
     
-    if (!(page_directory[pd_index] & 1)) return 0;
+    if (!(page_directory[pd_index] & PTE_PRESENT)) return 0;
+    if (page_directory[pd_index] & PDE_LARGE) {
+        return (page_directory[pd_index] & 0xFFC00000) | (addr & 0x3FFFFF);
+    }
     uint32_t* page_table = (uint32_t*)(page_directory[pd_index] & 0xFFFFF000);
     if (!(page_table[pt_index] & 1)) return 0;
     
@@ -289,43 +2056,49 @@ uintptr_t memory_get_physical(void* virt_addr) {
  * For now, we identity map the region if it's not already.
  */
 void* memory_map_physical(uintptr_t phys_addr, size_t size) {
-    uint32_t start = (uint32_t)phys_addr & 0xFFFFF000;
-    uint32_t end   = ((uint32_t)phys_addr + size + 0xFFF) & 0xFFFFF000;
-    
-    for (uint32_t addr = start; addr < end; addr += 0x1000) {
-        page_map(addr, addr); // Identity map for simplicity/hardware access
+    if (!mmu_initialized) {
+        return (void*)phys_addr;
     }
-    
+
+    // Identity map for simplicity/hardware access; aligned 4 MB spans use large pages
+    uint32_t base = (uint32_t)phys_addr & 0xFFFFF000;
+    uint32_t offset = (uint32_t)phys_addr - base;
+    if (!vmm_map_region(base, base, size + offset, PTE_PRESENT | PTE_WRITE)) {
+        return NULL;
+    }
+
     return (void*)phys_addr;
 }
 
 void* memory_map_region_v(uintptr_t phys_addr, uintptr_t virt_addr, size_t size, uint32_t flags) {
     (void)flags;
-    uint32_t p_start = (uint32_t)phys_addr & 0xFFFFF000;
-    uint32_t v_start = (uint32_t)virt_addr & 0xFFFFF000;
-    uint32_t count = (size + 0xFFF) / 0x1000;
-    
-    for (uint32_t i = 0; i < count; i++) {
-        page_map(v_start + (i * 0x1000), p_start + (i * 0x1000));
+    if (!mmu_initialized ||
+        !vmm_map_region((uint32_t)virt_addr, (uint32_t)phys_addr, size, PTE_PRESENT | PTE_WRITE)) {
+        return NULL;
     }
     return (void*)virt_addr;
 }
 
- * The heap spans HEAP_START .. HEAP_END (256 MB window by default).
- * The first block descriptor is placed at HEAP_START itself.
+/**
+ * heap_init – Set up the kernel heap with its first arena.
+ * Further arenas are pulled from the PMM on demand.
  */
 bool heap_init(void) {
-    if (heap_blocks != NULL) {
+    if (heap.initialized) {
         return true; /* already initialised */
     }
 
-    /* Place the first block descriptor at the very start of the heap region */
-    heap_blocks = (memory_block_t *)HEAP_START;
-    heap_blocks->start = HEAP_START + sizeof(memory_block_t);
-    heap_blocks->size  = (HEAP_END - HEAP_START) - sizeof(memory_block_t);
-    heap_blocks->used  = false;
-    heap_blocks->next  = NULL;
+    /* `heap` is not cleared: vmm_init() has already accounted its page
+       tables here through the direct-page path */
+    spinlock_init_mcs(&heap.lock);
+    memset(&depot, 0, sizeof(depot));
+    spinlock_init(&depot.lock);
+
+    if (!heap_grow()) {
+        return false;
+    }
 
+    heap.initialized = true;
     return true;
 }
 
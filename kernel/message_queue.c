@@ -6,8 +6,10 @@
 
 #include "kernel/message_queue.h"
 #include "kernel/memory.h"
+#include "kernel/slab.h"
 #include "kernel/process.h"
 #include "kernel/scheduler.h"
+#include "kernel/wait_queue.h"
 #include "libc/string.h"
 
 #define MAX_MESSAGE_SIZE 1024
@@ -25,18 +27,39 @@ typedef struct {
     size_t count;
     size_t max_messages;
     size_t max_size;
-    mutex_t lock;
-    condition_t not_full;
-    condition_t not_empty;
+    spinlock_t lock;
+    wait_queue_t not_full;      // Senders waiting for a free slot
+    wait_queue_t not_empty;     // Receivers waiting for a message
     bool closed;
 } message_queue_t;
 
+static kmem_cache_t* volatile message_cache;
+static spinlock_t message_cache_lock;   // Zero-initialised, so usable before any init
+
+// Created by the first queue; two CPUs racing here must end up with one cache
+static bool message_cache_ready(void) {
+    if (message_cache) {
+        return true;
+    }
+
+    spinlock_acquire(&message_cache_lock);
+    if (!message_cache) {
+        message_cache = kmem_cache_create("message_t", sizeof(message_t), 0, NULL);
+    }
+    spinlock_release(&message_cache_lock);
+    return message_cache != NULL;
+}
+
 message_queue_t* msgqueue_create(size_t max_messages, size_t max_size) {
     if (max_messages == 0 || max_size == 0 || 
         max_messages > MAX_MESSAGES || max_size > MAX_MESSAGE_SIZE) {
         return NULL;
     }
 
+    if (!message_cache_ready()) {
+        return NULL;
+    }
+
     message_queue_t* queue = kmalloc(sizeof(message_queue_t));
     if (!queue) {
         return NULL;
@@ -49,9 +72,9 @@ message_queue_t* msgqueue_create(size_t max_messages, size_t max_size) {
     queue->max_size = max_size;
     queue->closed = false;
 
-    mutex_init(&queue->lock);
-    condition_init(&queue->not_full);
-    condition_init(&queue->not_empty);
+    spinlock_init(&queue->lock);
+    wait_queue_init(&queue->not_full);
+    wait_queue_init(&queue->not_empty);
 
     return queue;
 }
@@ -61,22 +84,22 @@ bool msgqueue_send(message_queue_t* queue, const void* data, size_t size) {
         return false;
     }
 
-    mutex_lock(&queue->lock);
+    spinlock_acquire(&queue->lock);
 
     // Wait while queue is full
     while (queue->count >= queue->max_messages && !queue->closed) {
-        condition_wait(&queue->not_full, &queue->lock);
+        wait_queue_sleep_locked(&queue->not_full, &queue->lock);
     }
 
     if (queue->closed) {
-        mutex_unlock(&queue->lock);
+        spinlock_release(&queue->lock);
         return false;
     }
 
     // Allocate new message
-    message_t* msg = kmalloc(sizeof(message_t));
+    message_t* msg = kmem_cache_alloc(message_cache);
     if (!msg) {
-        mutex_unlock(&queue->lock);
+        spinlock_release(&queue->lock);
         return false;
     }
 
@@ -97,9 +120,9 @@ bool msgqueue_send(message_queue_t* queue, const void* data, size_t size) {
     queue->count++;
 
     // Signal waiting receivers
-    condition_signal(&queue->not_empty);
+    wait_queue_wake_one(&queue->not_empty);
 
-    mutex_unlock(&queue->lock);
+    spinlock_release(&queue->lock);
     return true;
 }
 
@@ -108,15 +131,15 @@ bool msgqueue_receive(message_queue_t* queue, void* buffer, size_t* size) {
         return false;
     }
 
-    mutex_lock(&queue->lock);
+    spinlock_acquire(&queue->lock);
 
     // Wait while queue is empty
     while (queue->count == 0 && !queue->closed) {
-        condition_wait(&queue->not_empty, &queue->lock);
+        wait_queue_sleep_locked(&queue->not_empty, &queue->lock);
     }
 
     if (queue->count == 0 && queue->closed) {
-        mutex_unlock(&queue->lock);
+        spinlock_release(&queue->lock);
         return false;
     }
 
@@ -132,20 +155,20 @@ bool msgqueue_receive(message_queue_t* queue, void* buffer, size_t* size) {
     // Copy message data
     if (*size < msg->size) {
         *size = msg->size;
-        kfree(msg);
-        mutex_unlock(&queue->lock);
+        kmem_cache_free(message_cache, msg);
+        spinlock_release(&queue->lock);
         return false;
     }
 
     memcpy(buffer, msg->data, msg->size);
     *size = msg->size;
 
-    kfree(msg);
+    kmem_cache_free(message_cache, msg);
 
     // Signal waiting senders
-    condition_signal(&queue->not_full);
+    wait_queue_wake_one(&queue->not_full);
 
-    mutex_unlock(&queue->lock);
+    spinlock_release(&queue->lock);
     return true;
 }
 
@@ -154,17 +177,17 @@ bool msgqueue_try_send(message_queue_t* queue, const void* data, size_t size) {
         return false;
     }
 
-    mutex_lock(&queue->lock);
+    spinlock_acquire(&queue->lock);
 
     if (queue->count >= queue->max_messages) {
-        mutex_unlock(&queue->lock);
+        spinlock_release(&queue->lock);
         return false;
     }
 
     // Allocate new message
-    message_t* msg = kmalloc(sizeof(message_t));
+    message_t* msg = kmem_cache_alloc(message_cache);
     if (!msg) {
-        mutex_unlock(&queue->lock);
+        spinlock_release(&queue->lock);
         return false;
     }
 
@@ -185,9 +208,9 @@ bool msgqueue_try_send(message_queue_t* queue, const void* data, size_t size) {
     queue->count++;
 
     // Signal waiting receivers
-    condition_signal(&queue->not_empty);
+    wait_queue_wake_one(&queue->not_empty);
 
-    mutex_unlock(&queue->lock);
+    spinlock_release(&queue->lock);
     return true;
 }
 
@@ -196,10 +219,10 @@ bool msgqueue_try_receive(message_queue_t* queue, void* buffer, size_t* size) {
         return false;
     }
 
-    mutex_lock(&queue->lock);
+    spinlock_acquire(&queue->lock);
 
     if (queue->count == 0) {
-        mutex_unlock(&queue->lock);
+        spinlock_release(&queue->lock);
         return false;
     }
 
@@ -215,20 +238,20 @@ bool msgqueue_try_receive(message_queue_t* queue, void* buffer, size_t* size) {
     // Copy message data
     if (*size < msg->size) {
         *size = msg->size;
-        kfree(msg);
-        mutex_unlock(&queue->lock);
+        kmem_cache_free(message_cache, msg);
+        spinlock_release(&queue->lock);
         return false;
     }
 
     memcpy(buffer, msg->data, msg->size);
     *size = msg->size;
 
-    kfree(msg);
+    kmem_cache_free(message_cache, msg);
 
     // Signal waiting senders
-    condition_signal(&queue->not_full);
+    wait_queue_wake_one(&queue->not_full);
 
-    mutex_unlock(&queue->lock);
+    spinlock_release(&queue->lock);
     return true;
 }
 
@@ -237,13 +260,13 @@ void msgqueue_close(message_queue_t* queue) {
         return;
     }
 
-    mutex_lock(&queue->lock);
+    spinlock_acquire(&queue->lock);
     queue->closed = true;
-    mutex_unlock(&queue->lock);
+    spinlock_release(&queue->lock);
 
     // Wake up all waiting processes
-    condition_broadcast(&queue->not_full);
-    condition_broadcast(&queue->not_empty);
+    wait_queue_wake_all(&queue->not_full);
+    wait_queue_wake_all(&queue->not_empty);
 }
 
 void msgqueue_destroy(message_queue_t* queue) {
@@ -253,20 +276,20 @@ void msgqueue_destroy(message_queue_t* queue) {
 
     msgqueue_close(queue);
 
-    mutex_lock(&queue->lock);
+    spinlock_acquire(&queue->lock);
 
     // Free all queued messages
     while (queue->first) {
         message_t* msg = queue->first;
         queue->first = msg->next;
-        kfree(msg);
+        kmem_cache_free(message_cache, msg);
     }
 
-    mutex_unlock(&queue->lock);
+    spinlock_release(&queue->lock);
 
     // Clean up synchronization objects
-    condition_destroy(&queue->not_full);
-    condition_destroy(&queue->not_empty);
+    wait_queue_wake_all(&queue->not_full);
+    wait_queue_wake_all(&queue->not_empty);
 
     kfree(queue);
 }
@@ -276,9 +299,9 @@ size_t msgqueue_get_count(message_queue_t* queue) {
         return 0;
     }
 
-    mutex_lock(&queue->lock);
+    spinlock_acquire(&queue->lock);
     size_t count = queue->count;
-    mutex_unlock(&queue->lock);
+    spinlock_release(&queue->lock);
 
     return count;
 }
@@ -288,9 +311,9 @@ bool msgqueue_is_full(message_queue_t* queue) {
         return true;
     }
 
-    mutex_lock(&queue->lock);
+    spinlock_acquire(&queue->lock);
     bool is_full = queue->count >= queue->max_messages;
-    mutex_unlock(&queue->lock);
+    spinlock_release(&queue->lock);
 
     return is_full;
 }
@@ -300,9 +323,9 @@ bool msgqueue_is_empty(message_queue_t* queue) {
         return true;
     }
 
-    mutex_lock(&queue->lock);
+    spinlock_acquire(&queue->lock);
     bool is_empty = queue->count == 0;
-    mutex_unlock(&queue->lock);
+    spinlock_release(&queue->lock);
 
     return is_empty;
 }
@@ -312,9 +335,9 @@ bool msgqueue_is_closed(message_queue_t* queue) {
         return true;
     }
 
-    mutex_lock(&queue->lock);
+    spinlock_acquire(&queue->lock);
     bool is_closed = queue->closed;
-    mutex_unlock(&queue->lock);
+    spinlock_release(&queue->lock);
 
     return is_closed;
 }
@@ -2,36 +2,240 @@
  * Maya OS Mutex Implementation
  * Updated: 2025-08-29 11:16:18 UTC
  * Author: AmanNagtodeOfficial
+ *
+ * The state word holds the owner's process_t address, so an uncontended
+ * lock or unlock is one compare-and-swap. On a contended lock, while the
+ * owner is running on another CPU it is likely to release soon, so the
+ * locker spins up to its class's budget before paying for a block and a
+ * context switch; an owner that is not running makes it block at once.
+ * A task that has to wait sets
+ * MUTEX_WAITERS, queues by scheduler rank and blocks, lending its rank to
+ * the owner; when the owner is itself waiting for another mutex the loan
+ * travels on down that chain. Unlock hands the mutex straight to the
+ * highest waiter and the old owner drops back to what its remaining
+ * waiters still lend it, so a high-priority task waits for one critical
+ * section per mutex in its chain, however many tasks of middle priority
+ * are runnable.
  */
 
 #include "kernel/mutex.h"
 #include "kernel/process.h"
 #include "kernel/scheduler.h"
-#include "kernel/interrupts.h"
+#include "kernel/spinlock.h"
+#include "kernel/timer.h"
+#include "kernel/smp.h"
 #include "libc/string.h"
 
+#define MUTEX_WAITERS       0x1u   /* Unlock must hand over to a waiter   */
+#define MUTEX_ANONYMOUS     0x2u   /* Held by boot code, not by a process */
+#define MUTEX_FLAGS         0x3u
+#define MUTEX_PI_MAX_CHAIN  16     /* Longer chains are deadlock cycles  */
+
 typedef struct mutex_waiter {
     process_t* process;
     struct mutex_waiter* next;
 } mutex_waiter_t;
 
-static bool mutex_try_lock(mutex_t* mutex) {
-    uint32_t old_value = __sync_val_compare_and_swap(&mutex->locked, 0, 1);
-    if (old_value == 0) {
-        mutex->owner = process_get_current();
-        return true;
+static struct {
+    spinlock_t lock;        // Waiter lists, pi_held lists, rank loans, classes
+    mutex_stats_t stats;
+    mutex_class_t* classes[MUTEX_CLASS_MAX];
+    uint32_t class_count;
+} mutex_state;
+
+static mutex_class_t mutex_default_class = MUTEX_CLASS_INIT("mutex");
+
+static inline uint32_t mutex_self(process_t* current) {
+    return current ? (uint32_t)current : MUTEX_ANONYMOUS;
+}
+
+static inline process_t* mutex_owner(uint32_t state) {
+    return (process_t*)(state & ~MUTEX_FLAGS);
+}
+
+static inline uint8_t task_rank(const process_t* process) {
+    return scheduler_rank(process->policy, process->priority);
+}
+
+/* ─── waiter queue ─────────────────────────────────────────────── */
+
+// Behind every waiter of equal or higher rank
+static void waiter_insert(mutex_t* mutex, mutex_waiter_t* waiter) {
+    uint8_t rank = task_rank(waiter->process);
+    mutex_waiter_t** link = &mutex->waiters;
+    while (*link && task_rank((*link)->process) >= rank) {
+        link = &(*link)->next;
+    }
+    waiter->next = *link;
+    *link = waiter;
+}
+
+static mutex_waiter_t* waiter_remove(mutex_t* mutex, process_t* process) {
+    mutex_waiter_t** link = &mutex->waiters;
+    while (*link && (*link)->process != process) {
+        link = &(*link)->next;
+    }
+    mutex_waiter_t* waiter = *link;
+    if (waiter) {
+        *link = waiter->next;
+    }
+    return waiter;
+}
+
+/* ─── priority inheritance ─────────────────────────────────────── */
+
+static void pi_held_remove(process_t* owner, mutex_t* mutex) {
+    if (owner->pi_held == mutex) {
+        owner->pi_held = mutex->pi_next;
+    } else {
+        mutex_t* prev = owner->pi_held;
+        while (prev && prev->pi_next != mutex) {
+            prev = prev->pi_next;
+        }
+        if (prev) {
+            prev->pi_next = mutex->pi_next;
+        }
+    }
+    mutex->pi_next = NULL;
+}
+
+/**
+ * Recompute what `task` inherits from the top waiters of the mutexes it
+ * holds. If its rank changed while it waits itself, re-sort it in that
+ * mutex's queue and carry on with that mutex's owner. Returns the number
+ * of owners visited.
+ */
+static uint32_t pi_update(process_t* task) {
+    uint32_t depth = 0;
+    while (task && depth < MUTEX_PI_MAX_CHAIN) {
+        uint8_t before = task_rank(task);
+        uint8_t loan = 0;
+        for (mutex_t* held = task->pi_held; held; held = held->pi_next) {
+            uint8_t rank = task_rank(held->waiters->process);
+            if (rank > loan) {
+                loan = rank;
+            }
+        }
+        if (loan > before) {
+            mutex_state.stats.boosts++;
+        }
+        scheduler_set_pi_rank(task, loan);
+        depth++;
+
+        mutex_t* next = task->pi_blocked_on;
+        if (task_rank(task) == before || !next) {
+            break;
+        }
+        mutex_waiter_t* waiter = waiter_remove(next, task);
+        if (waiter) {
+            waiter_insert(next, waiter);
+        }
+        task = mutex_owner(next->state);
+    }
+    return depth;
+}
+
+/*
+ * A killed waiter gives up: out of the queue, with its loan taken back
+ * from the owner. If the mutex was handed to it meanwhile, pass it on.
+ */
+static void mutex_abandon(mutex_t* mutex, process_t* current) {
+    spinlock_acquire(&mutex_state.lock);
+    current->waiting = false;
+    if (mutex_owner(mutex->state) == current) {
+        spinlock_release(&mutex_state.lock);
+        mutex_unlock(mutex);
+        return;
+    }
+
+    process_t* owner = mutex_owner(mutex->state);
+    waiter_remove(mutex, current);
+    current->pi_blocked_on = NULL;
+    if (!mutex->waiters) {
+        pi_held_remove(owner, mutex);
+        __sync_fetch_and_and(&mutex->state, ~MUTEX_WAITERS);
+    }
+    pi_update(owner);
+    spinlock_release(&mutex_state.lock);
+}
+
+/* ─── adaptive spinning ────────────────────────────────────────── */
+
+/**
+ * Busy-wait for the mutex while its owner runs on another CPU. Gives up
+ * when the owner is preempted or blocks, when others are already queued
+ * (unlock hands over to them), or when the class's budget runs out.
+ */
+static bool mutex_spin(mutex_t* mutex, uint32_t self) {
+    mutex_class_t* cls = mutex->cls ? mutex->cls : &mutex_default_class;
+    if (!cls->spin_budget || smp_cpu_count() < 2) {
+        return false;
+    }
+
+    process_t* owner = mutex_owner(mutex->state);
+    if (!owner || !owner->on_cpu) {
+        __sync_fetch_and_add(&cls->owner_off_cpu, 1);
+        return false;
+    }
+
+    __sync_fetch_and_add(&cls->spins, 1);
+    for (uint32_t i = 0; i < cls->spin_budget; i++) {
+        uint32_t state = mutex->state;
+        if (state == 0) {
+            if (__sync_bool_compare_and_swap(&mutex->state, 0, self)) {
+                __sync_fetch_and_add(&cls->spin_hits, 1);
+                return true;
+            }
+            continue;
+        }
+        if (state & MUTEX_WAITERS) {
+            return false;
+        }
+
+        // A new owner gets the same test; one that is off-CPU ends the spin
+        owner = mutex_owner(state);
+        if (!owner || !owner->on_cpu) {
+            return false;
+        }
+        __asm__ volatile("pause");
     }
+
+    __sync_fetch_and_add(&cls->spin_timeouts, 1);
     return false;
 }
 
+/* ─── public API ───────────────────────────────────────────────── */
+
 void mutex_init(mutex_t* mutex) {
-    if (!mutex) {
+    mutex_init_class(mutex, &mutex_default_class);
+}
+
+void mutex_init_class(mutex_t* mutex, mutex_class_t* cls) {
+    if (!mutex || !cls) {
         return;
     }
 
-    mutex->locked = 0;
-    mutex->owner = NULL;
+    mutex->state = 0;
     mutex->waiters = NULL;
+    mutex->pi_next = NULL;
+    mutex->wait_max = 0;
+    mutex->cls = cls;
+
+    // Classes are listed for mutex_get_class() the first time one is used
+    if (!cls->registered) {
+        spinlock_acquire(&mutex_state.lock);
+        if (!cls->registered && mutex_state.class_count < MUTEX_CLASS_MAX) {
+            mutex_state.classes[mutex_state.class_count++] = cls;
+            cls->registered = true;
+        }
+        spinlock_release(&mutex_state.lock);
+    }
+}
+
+void mutex_class_set_spin(mutex_class_t* cls, uint32_t spin_budget) {
+    if (cls) {
+        cls->spin_budget = spin_budget;
+    }
 }
 
 void mutex_lock(mutex_t* mutex) {
@@ -39,80 +243,97 @@ void mutex_lock(mutex_t* mutex) {
         return;
     }
 
-    // Disable interrupts while manipulating mutex state
-    uint32_t flags = interrupt_disable();
-
-    // Try to acquire lock
-    if (mutex_try_lock(mutex)) {
-        interrupt_restore(flags);
+    process_t* current = process_get_current();
+    uint32_t self = mutex_self(current);
+    if (__sync_bool_compare_and_swap(&mutex->state, 0, self)) {
         return;
     }
 
     // If already owned by current process, deadlock
-    process_t* current = process_get_current();
-    if (mutex->owner == current) {
+    if (current && mutex_owner(mutex->state) == current) {
         // TODO: Handle deadlock detection
-        interrupt_restore(flags);
         return;
     }
 
-    // Create waiter entry
-    mutex_waiter_t* waiter = kmalloc(sizeof(mutex_waiter_t));
-    if (!waiter) {
-        interrupt_restore(flags);
+    if (current && mutex_spin(mutex, self)) {
         return;
     }
 
-    waiter->process = current;
-    waiter->next = NULL;
+    uint32_t start = timer_get_ticks();
+    mutex_waiter_t waiter = { .process = current, .next = NULL };
 
-    // Add to waiter list
-    if (!mutex->waiters) {
-        mutex->waiters = waiter;
-    } else {
-        mutex_waiter_t* last = mutex->waiters;
-        while (last->next) {
-            last = last->next;
+    spinlock_acquire(&mutex_state.lock);
+    for (;;) {
+        uint32_t state = mutex->state;
+        if (state == 0) {
+            if (__sync_bool_compare_and_swap(&mutex->state, 0, self)) {
+                spinlock_release(&mutex_state.lock);
+                return;
+            }
+            continue;
+        }
+
+        // Boot code can neither block nor lend its rank to one that cannot
+        if (!current || !mutex_owner(state)) {
+            spinlock_release(&mutex_state.lock);
+            while (mutex->state != 0) {
+                __asm__ volatile("pause");
+            }
+            spinlock_acquire(&mutex_state.lock);
+            continue;
+        }
+
+        // From here on the owner cannot unlock without taking our lock
+        if ((state & MUTEX_WAITERS) ||
+            __sync_bool_compare_and_swap(&mutex->state, state, state | MUTEX_WAITERS)) {
+            break;
         }
-        last->next = waiter;
     }
 
-    while (!mutex_try_lock(mutex)) {
-        // Re-enable interrupts while waiting
-        interrupt_restore(flags);
-        
-        // Yield to other processes
-        scheduler_switch_task();
+    process_t* owner = mutex_owner(mutex->state);
+    bool first = !mutex->waiters;
+    waiter_insert(mutex, &waiter);
+    current->pi_blocked_on = mutex;
+    current->waiting = true;
+    current->wake_pending = false;
+    if (first) {
+        mutex->pi_next = owner->pi_held;
+        owner->pi_held = mutex;
+    }
 
-        // Disable interrupts to check mutex again
-        flags = interrupt_disable();
+    // Only a new top waiter can raise what the owner inherits
+    if (mutex->waiters == &waiter) {
+        uint32_t depth = pi_update(owner);
+        if (depth > mutex_state.stats.chain_max) {
+            mutex_state.stats.chain_max = depth;
+        }
     }
+    mutex_state.stats.contended++;
+    spinlock_release(&mutex_state.lock);
 
-    // Remove from waiter list
-    if (mutex->waiters == waiter) {
-        mutex->waiters = waiter->next;
-    } else {
-        mutex_waiter_t* prev = mutex->waiters;
-        while (prev->next != waiter) {
-            prev = prev->next;
+    // mutex_unlock() makes us the owner before it wakes us
+    while (mutex_owner(mutex->state) != current) {
+        if (!scheduler_block(current)) {
+            mutex_abandon(mutex, current);
+            process_exit();
         }
-        prev->next = waiter->next;
     }
+    current->waiting = false;
 
-    kfree(waiter);
-    interrupt_restore(flags);
+    uint32_t waited = timer_get_ticks() - start;
+    if (waited > mutex->wait_max) {
+        mutex->wait_max = waited;
+    }
+    if (waited > mutex_state.stats.wait_max) {
+        mutex_state.stats.wait_max = waited;
+    }
 }
 
 bool mutex_try_lock(mutex_t* mutex) {
     if (!mutex) {
         return false;
     }
-
-    uint32_t flags = interrupt_disable();
-    bool result = mutex_try_lock(mutex);
-    interrupt_restore(flags);
-
-    return result;
+    return __sync_bool_compare_and_swap(&mutex->state, 0, mutex_self(process_get_current()));
 }
 
 void mutex_unlock(mutex_t* mutex) {
@@ -120,37 +341,87 @@ void mutex_unlock(mutex_t* mutex) {
         return;
     }
 
-    uint32_t flags = interrupt_disable();
-
     // Verify owner
     process_t* current = process_get_current();
-    if (mutex->owner != current) {
-        interrupt_restore(flags);
+    uint32_t self = mutex_self(current);
+    if ((mutex->state & ~MUTEX_WAITERS) != self) {
+        return;
+    }
+    if (__sync_bool_compare_and_swap(&mutex->state, self, 0)) {
         return;
     }
 
-    mutex->owner = NULL;
-    __sync_synchronize();
-    mutex->locked = 0;
+    // Waiters: hand over to the highest one instead of letting anyone barge in
+    spinlock_acquire(&mutex_state.lock);
+    mutex_waiter_t* top = mutex->waiters;
+    if (!top) {
+        mutex->state = 0;
+        spinlock_release(&mutex_state.lock);
+        return;
+    }
 
-    // Wake up first waiter
+    process_t* next = top->process;
+    mutex->waiters = top->next;
+    pi_held_remove(current, mutex);
     if (mutex->waiters) {
-        process_wake(mutex->waiters->process);
+        mutex->pi_next = next->pi_held;
+        next->pi_held = mutex;
+    }
+    next->pi_blocked_on = NULL;
+    __sync_synchronize();
+    mutex->state = (uint32_t)next | (mutex->waiters ? MUTEX_WAITERS : 0);
+
+    // Give back the loan, and let the new owner inherit from those still waiting
+    pi_update(current);
+    pi_update(next);
+    spinlock_release(&mutex_state.lock);
+
+    scheduler_wake(next);
+}
+
+void mutex_unlock_all(void) {
+    process_t* current = process_get_current();
+    if (!current) {
+        return;
     }
 
-    interrupt_restore(flags);
+    for (;;) {
+        spinlock_acquire(&mutex_state.lock);
+        mutex_t* held = current->pi_held;
+        spinlock_release(&mutex_state.lock);
+        if (!held) {
+            return;
+        }
+        mutex_unlock(held);
+    }
 }
 
 bool mutex_is_locked(mutex_t* mutex) {
     if (!mutex) {
         return false;
     }
-    return mutex->locked != 0;
+    return mutex->state != 0;
 }
 
 process_t* mutex_get_owner(mutex_t* mutex) {
     if (!mutex) {
         return NULL;
     }
-    return mutex->owner;
+    return mutex_owner(mutex->state);
+}
+
+bool mutex_get_stats(mutex_stats_t* stats) {
+    if (!stats) {
+        return false;
+    }
+    *stats = mutex_state.stats;
+    return true;
+}
+
+bool mutex_get_class(uint32_t index, mutex_class_t* cls) {
+    if (!cls || index >= mutex_state.class_count) {
+        return false;
+    }
+    *cls = *mutex_state.classes[index];
+    return true;
 }
@@ -8,6 +8,7 @@
 #include "kernel/memory.h"
 #include "kernel/process.h"
 #include "kernel/scheduler.h"
+#include "kernel/wait_queue.h"
 #include "libc/string.h"
 
 #define PIPE_BUFFER_SIZE 4096
@@ -17,9 +18,9 @@ typedef struct {
     size_t read_pos;
     size_t write_pos;
     size_t count;
-    semaphore_t read_sem;
-    semaphore_t write_sem;
-    mutex_t lock;
+    spinlock_t lock;
+    wait_queue_t readers;       // Waiting for data
+    wait_queue_t writers;       // Waiting for space
     bool closed;
 } pipe_t;
 
@@ -47,9 +48,9 @@ bool pipe_create(int* read_fd, int* write_fd) {
     pipe->count = 0;
     pipe->closed = false;
 
-    semaphore_init(&pipe->read_sem, 0);
-    semaphore_init(&pipe->write_sem, PIPE_BUFFER_SIZE);
-    mutex_init(&pipe->lock);
+    spinlock_init(&pipe->lock);
+    wait_queue_init(&pipe->readers);
+    wait_queue_init(&pipe->writers);
 
     // Create file descriptors
     *read_fd = process_alloc_fd(pipe, FD_TYPE_PIPE_READ);
@@ -78,17 +79,19 @@ ssize_t pipe_read(pipe_t* pipe, void* buffer, size_t size) {
     size_t bytes_read = 0;
     uint8_t* buf = (uint8_t*)buffer;
 
+    spinlock_acquire(&pipe->lock);
     while (bytes_read < size) {
         // Wait for data
-        semaphore_wait(&pipe->read_sem);
+        while (pipe->count == 0 && !pipe->closed) {
+            wait_queue_sleep_locked(&pipe->readers, &pipe->lock);
+        }
 
-        if (pipe->closed) {
-            return bytes_read > 0 ? bytes_read : -1;
+        if (pipe->count == 0) {
+            spinlock_release(&pipe->lock);
+            return bytes_read > 0 ? (ssize_t)bytes_read : -1;
         }
 
         // Read data
-        mutex_lock(&pipe->lock);
-
         size_t available = pipe->count;
         size_t to_read = size - bytes_read;
         if (to_read > available) {
@@ -101,15 +104,10 @@ ssize_t pipe_read(pipe_t* pipe, void* buffer, size_t size) {
             pipe->count--;
         }
 
-        mutex_unlock(&pipe->lock);
-
         // Signal writer
-        semaphore_signal(&pipe->write_sem);
-
-        if (bytes_read == size || pipe->closed) {
-            break;
-        }
+        wait_queue_wake_all(&pipe->writers);
     }
+    spinlock_release(&pipe->lock);
 
     return bytes_read;
 }
@@ -122,17 +120,19 @@ ssize_t pipe_write(pipe_t* pipe, const void* buffer, size_t size) {
     size_t bytes_written = 0;
     const uint8_t* buf = (const uint8_t*)buffer;
 
+    spinlock_acquire(&pipe->lock);
     while (bytes_written < size) {
         // Wait for space
-        semaphore_wait(&pipe->write_sem);
+        while (pipe->count == PIPE_BUFFER_SIZE && !pipe->closed) {
+            wait_queue_sleep_locked(&pipe->writers, &pipe->lock);
+        }
 
         if (pipe->closed) {
+            spinlock_release(&pipe->lock);
             return -1;
         }
 
         // Write data
-        mutex_lock(&pipe->lock);
-
         size_t available = PIPE_BUFFER_SIZE - pipe->count;
         size_t to_write = size - bytes_written;
         if (to_write > available) {
@@ -145,15 +145,10 @@ ssize_t pipe_write(pipe_t* pipe, const void* buffer, size_t size) {
             pipe->count++;
         }
 
-        mutex_unlock(&pipe->lock);
-
         // Signal reader
-        semaphore_signal(&pipe->read_sem);
-
-        if (bytes_written == size || pipe->closed) {
-            break;
-        }
+        wait_queue_wake_all(&pipe->readers);
     }
+    spinlock_release(&pipe->lock);
 
     return bytes_written;
 }
@@ -163,13 +158,13 @@ void pipe_close(pipe_t* pipe) {
         return;
     }
 
-    mutex_lock(&pipe->lock);
+    spinlock_acquire(&pipe->lock);
     pipe->closed = true;
-    mutex_unlock(&pipe->lock);
 
     // Wake up waiting processes
-    semaphore_signal(&pipe->read_sem);
-    semaphore_signal(&pipe->write_sem);
+    wait_queue_wake_all(&pipe->readers);
+    wait_queue_wake_all(&pipe->writers);
+    spinlock_release(&pipe->lock);
 }
 
 void pipe_destroy(pipe_t* pipe) {
@@ -180,9 +175,6 @@ void pipe_destroy(pipe_t* pipe) {
     pipe_close(pipe);
 
     // Clean up resources
-    semaphore_destroy(&pipe->read_sem);
-    semaphore_destroy(&pipe->write_sem);
-    
     if (pipe->buffer) {
         kfree(pipe->buffer);
     }
@@ -201,9 +193,9 @@ size_t pipe_get_available(pipe_t* pipe) {
         return 0;
     }
 
-    mutex_lock(&pipe->lock);
+    spinlock_acquire(&pipe->lock);
     size_t count = pipe->count;
-    mutex_unlock(&pipe->lock);
+    spinlock_release(&pipe->lock);
 
     return count;
 }
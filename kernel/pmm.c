@@ -0,0 +1,589 @@
+/**
+ * Maya OS Physical Memory Manager
+ * Buddy-system allocator over every usable multiboot memory region.
+ * Author: AmanNagtodeOfficial
+ */
+
+#include "kernel/pmm.h"
+#include "kernel/spinlock.h"
+#include "kernel/logging.h"
+#include "libc/string.h"
+
+#define MULTIBOOT_FLAG_MMAP   0x40
+#define MULTIBOOT_MEM_USABLE  1
+#define LOW_MEMORY_END        0x100000  /* Leave BIOS/VGA area alone */
+#define PMM_MEMORY_LIMIT      0xC0000000ULL /* Identity-mapped; above is kernel virtual space */
+
+/* Pre-zeroed pool, refilled from the idle loop */
+#define ZERO_POOL_MAX_FRAMES  4096      /* 16 MB */
+#define ZERO_POOL_BASE_TARGET 64        /* Order-0 blocks kept for page tables */
+#define ZERO_POOL_MAX_TARGET  4         /* Blocks per higher order, grown on misses */
+#define CPUID_EDX_SSE2        (1u << 26)
+
+/* Multiboot memory map entry; `size` does not include itself */
+typedef struct {
+    uint32_t size;
+    uint64_t base_addr;
+    uint64_t length;
+    uint32_t type;
+} __attribute__((packed)) mmap_entry_t;
+
+/* End of the kernel image, provided by linker.ld */
+extern uint8_t _kernel_end[];
+
+static struct {
+    page_t   *pages;
+    uint32_t  frame_count;
+    page_t   *free_lists[PMM_MAX_ORDER + 1];
+    uint32_t  free_blocks[PMM_MAX_ORDER + 1];
+    uint32_t  free_frames;
+    uint32_t  total_memory;
+    spinlock_t lock;
+    bool      initialized;
+} pmm_state;
+
+/* Free blocks that are already zero; they count as free frames */
+static struct {
+    page_t   *lists[PMM_MAX_ORDER + 1];
+    uint32_t  count[PMM_MAX_ORDER + 1];
+    uint32_t  target[PMM_MAX_ORDER + 1];
+    uint32_t  frames;
+    page_t   *filling;          /* Block the idle loop is zeroing */
+    uint32_t  filling_order;
+    uint32_t  filling_claimed;  /* Frames of it handed to a zeroing CPU */
+    uint32_t  filling_zeroed;   /* Frames of it finished */
+    bool      nt_stores;
+    pmm_zero_stats_t stats;
+} zero_pool;
+
+static uintptr_t align_up(uintptr_t value, uintptr_t align) {
+    return (value + align - 1) & ~(align - 1);
+}
+
+/* ─── free list helpers ─────────────────────────────────────────── */
+
+static void free_list_push(page_t *page, uint32_t order) {
+    page->flags |= PAGE_FLAG_FREE;
+    page->order = order;
+    page->prev = NULL;
+    page->next = pmm_state.free_lists[order];
+    if (page->next) {
+        page->next->prev = page;
+    }
+    pmm_state.free_lists[order] = page;
+    pmm_state.free_blocks[order]++;
+}
+
+static void free_list_remove(page_t *page, uint32_t order) {
+    if (page->prev) {
+        page->prev->next = page->next;
+    } else {
+        pmm_state.free_lists[order] = page->next;
+    }
+    if (page->next) {
+        page->next->prev = page->prev;
+    }
+    page->next = NULL;
+    page->prev = NULL;
+    page->flags &= ~PAGE_FLAG_FREE;
+    pmm_state.free_blocks[order]--;
+}
+
+/* Return a block to the free lists, merging with its buddy while possible */
+static void buddy_free(uint32_t index, uint32_t order) {
+    while (order < PMM_MAX_ORDER) {
+        uint32_t buddy_index = index ^ (1u << order);
+        if (buddy_index >= pmm_state.frame_count) {
+            break;
+        }
+
+        page_t *buddy = &pmm_state.pages[buddy_index];
+        if (!(buddy->flags & PAGE_FLAG_FREE) || buddy->order != order) {
+            break;
+        }
+
+        free_list_remove(buddy, order);
+        index &= ~(1u << order);
+        order++;
+    }
+
+    free_list_push(&pmm_state.pages[index], order);
+}
+
+/* Hand a frame range to the allocator in the largest aligned blocks */
+static void add_free_range(uint32_t first, uint32_t last) {
+    while (first < last) {
+        uint32_t order = PMM_MAX_ORDER;
+        while (order > 0 &&
+               ((first & ((1u << order) - 1)) || first + (1u << order) > last)) {
+            order--;
+        }
+
+        for (uint32_t i = 0; i < (1u << order); i++) {
+            pmm_state.pages[first + i].flags &= ~PAGE_FLAG_RESERVED;
+        }
+        pmm_state.free_frames += 1u << order;
+        buddy_free(first, order);
+        first += 1u << order;
+    }
+}
+
+/* Take a block of exactly `order` from the buddy lists; caller holds the lock */
+static page_t *buddy_alloc(uint32_t order) {
+    /* Smallest non-empty list that can satisfy the request */
+    uint32_t current = order;
+    while (current <= PMM_MAX_ORDER && !pmm_state.free_lists[current]) {
+        current++;
+    }
+    if (current > PMM_MAX_ORDER) {
+        return NULL;
+    }
+
+    page_t *page = pmm_state.free_lists[current];
+    free_list_remove(page, current);
+
+    /* Split down, returning the upper halves to their free lists */
+    while (current > order) {
+        current--;
+        free_list_push(page + (1u << current), current);
+    }
+
+    page->order = order;
+    return page;
+}
+
+/* ─── pre-zeroed pool ──────────────────────────────────────────── */
+
+static void zero_list_push(page_t *page, uint32_t order) {
+    page->flags |= PAGE_FLAG_ZEROED;
+    page->order = order;
+    page->prev = NULL;
+    page->next = zero_pool.lists[order];
+    if (page->next) {
+        page->next->prev = page;
+    }
+    zero_pool.lists[order] = page;
+    zero_pool.count[order]++;
+    zero_pool.frames += 1u << order;
+}
+
+/* Take a zeroed block of `order`, splitting a larger one if needed; caller holds the lock */
+static page_t *zero_pool_take(uint32_t order) {
+    uint32_t current = order;
+    while (current <= PMM_MAX_ORDER && !zero_pool.lists[current]) {
+        current++;
+    }
+    if (current > PMM_MAX_ORDER) {
+        return NULL;
+    }
+
+    page_t *page = zero_pool.lists[current];
+    zero_pool.lists[current] = page->next;
+    if (page->next) {
+        page->next->prev = NULL;
+    }
+    page->next = NULL;
+    page->flags &= ~PAGE_FLAG_ZEROED;
+    zero_pool.count[current]--;
+    zero_pool.frames -= 1u << current;
+
+    /* Both halves of a zeroed block are zeroed */
+    while (current > order) {
+        current--;
+        zero_list_push(page + (1u << current), current);
+    }
+
+    page->order = order;
+    return page;
+}
+
+static bool cpu_has_sse2(void) {
+    uint32_t eax = 1, ebx, ecx, edx;
+    __asm__ volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+    return (edx & CPUID_EDX_SSE2) != 0;
+}
+
+/* Clear whole frames; non-temporal stores keep the zeroes out of the cache */
+static void zero_frames(uintptr_t addr, uint32_t frames) {
+    if (!zero_pool.nt_stores) {
+        memset((void *)addr, 0, frames * PMM_FRAME_SIZE);
+        return;
+    }
+
+    uint32_t *dst = (uint32_t *)addr;
+    uint32_t words = frames * (PMM_FRAME_SIZE / sizeof(uint32_t));
+    __asm__ volatile(
+        "1: movnti %%eax, (%0)\n"
+        "   movnti %%eax, 4(%0)\n"
+        "   movnti %%eax, 8(%0)\n"
+        "   movnti %%eax, 12(%0)\n"
+        "   add $16, %0\n"
+        "   sub $4, %1\n"
+        "   jnz 1b\n"
+        "   sfence"
+        : "+r"(dst), "+r"(words) : "a"(0) : "memory");
+}
+
+/* ─── public API ───────────────────────────────────────────────── */
+
+bool pmm_init(struct multiboot_info *mbi) {
+    if (pmm_state.initialized) {
+        return true;
+    }
+    if (!mbi || !(mbi->flags & MULTIBOOT_FLAG_MMAP)) {
+        return false;
+    }
+
+    memset(&pmm_state, 0, sizeof(pmm_state));
+    spinlock_init_mcs(&pmm_state.lock);
+    memset(&zero_pool, 0, sizeof(zero_pool));
+    zero_pool.target[0] = ZERO_POOL_BASE_TARGET;
+    zero_pool.nt_stores = cpu_has_sse2();
+
+    uintptr_t mmap_start = mbi->mmap_addr;
+    uintptr_t mmap_end   = mbi->mmap_addr + mbi->mmap_length;
+
+    /* Pass 1: total usable memory and highest usable frame */
+    uint64_t highest = 0;
+    for (uintptr_t p = mmap_start; p < mmap_end;
+         p += ((mmap_entry_t *)p)->size + sizeof(uint32_t)) {
+        mmap_entry_t *entry = (mmap_entry_t *)p;
+        if (entry->type != MULTIBOOT_MEM_USABLE || entry->base_addr >= PMM_MEMORY_LIMIT) {
+            continue;
+        }
+        uint64_t end = entry->base_addr + entry->length;
+        if (end > PMM_MEMORY_LIMIT) {
+            end = PMM_MEMORY_LIMIT;
+        }
+        pmm_state.total_memory += (uint32_t)(end - entry->base_addr);
+        if (end > highest) {
+            highest = end;
+        }
+    }
+
+    pmm_state.frame_count = (uint32_t)(highest >> PMM_FRAME_SHIFT);
+    if (pmm_state.frame_count == 0) {
+        return false;
+    }
+
+    /* Everything below this is kernel image, boot data or low memory */
+    uintptr_t reserved_end = align_up((uintptr_t)_kernel_end, PMM_FRAME_SIZE);
+    if (reserved_end < LOW_MEMORY_END) {
+        reserved_end = LOW_MEMORY_END;
+    }
+    if (mmap_end > reserved_end) {
+        reserved_end = align_up(mmap_end, PMM_FRAME_SIZE);
+    }
+    if ((uintptr_t)mbi + sizeof(*mbi) > reserved_end) {
+        reserved_end = align_up((uintptr_t)mbi + sizeof(*mbi), PMM_FRAME_SIZE);
+    }
+
+    /* Pass 2: place the frame descriptor array in the first region that fits */
+    size_t array_size = align_up(pmm_state.frame_count * sizeof(page_t), PMM_FRAME_SIZE);
+    for (uintptr_t p = mmap_start; p < mmap_end && !pmm_state.pages;
+         p += ((mmap_entry_t *)p)->size + sizeof(uint32_t)) {
+        mmap_entry_t *entry = (mmap_entry_t *)p;
+        if (entry->type != MULTIBOOT_MEM_USABLE || entry->base_addr >= PMM_MEMORY_LIMIT) {
+            continue;
+        }
+        uint64_t start = entry->base_addr;
+        uint64_t end   = entry->base_addr + entry->length;
+        if (end > PMM_MEMORY_LIMIT) {
+            end = PMM_MEMORY_LIMIT;
+        }
+        if (start < reserved_end) {
+            start = reserved_end;
+        }
+        start = align_up((uintptr_t)start, PMM_FRAME_SIZE);
+        if (start + array_size <= end) {
+            pmm_state.pages = (page_t *)(uintptr_t)start;
+            reserved_end = (uintptr_t)start + array_size;
+        }
+    }
+    if (!pmm_state.pages) {
+        return false;
+    }
+
+    /* Every frame starts reserved; usable regions are released below */
+    for (uint32_t i = 0; i < pmm_state.frame_count; i++) {
+        pmm_state.pages[i].next  = NULL;
+        pmm_state.pages[i].prev  = NULL;
+        pmm_state.pages[i].flags = PAGE_FLAG_RESERVED;
+        pmm_state.pages[i].order = 0;
+        pmm_state.pages[i].refcount = 0;
+    }
+
+    /* Pass 3: release every usable frame above the reserved area */
+    uint32_t reserved_frame = (uint32_t)(reserved_end >> PMM_FRAME_SHIFT);
+    for (uintptr_t p = mmap_start; p < mmap_end;
+         p += ((mmap_entry_t *)p)->size + sizeof(uint32_t)) {
+        mmap_entry_t *entry = (mmap_entry_t *)p;
+        if (entry->type != MULTIBOOT_MEM_USABLE || entry->base_addr >= PMM_MEMORY_LIMIT) {
+            continue;
+        }
+        uint64_t end = entry->base_addr + entry->length;
+        if (end > PMM_MEMORY_LIMIT) {
+            end = PMM_MEMORY_LIMIT;
+        }
+
+        uint32_t first = (uint32_t)(align_up((uintptr_t)entry->base_addr, PMM_FRAME_SIZE) >> PMM_FRAME_SHIFT);
+        uint32_t last  = (uint32_t)(end >> PMM_FRAME_SHIFT);
+        if (first < reserved_frame) {
+            first = reserved_frame;
+        }
+        if (first < last) {
+            add_free_range(first, last);
+        }
+    }
+
+    pmm_state.initialized = true;
+    KLOG_I("PMM: %u frames managed, %u free (%u KB descriptors)",
+           pmm_state.frame_count, pmm_state.free_frames, (uint32_t)(array_size / 1024));
+    return true;
+}
+
+uintptr_t pmm_alloc_pages(uint32_t order) {
+    if (!pmm_state.initialized || order > PMM_MAX_ORDER) {
+        return 0;
+    }
+
+    spinlock_acquire(&pmm_state.lock);
+
+    /* Zeroed blocks are the last resort for ordinary requests */
+    page_t *page = buddy_alloc(order);
+    if (!page) {
+        page = zero_pool_take(order);
+    }
+    if (!page) {
+        spinlock_release(&pmm_state.lock);
+        return 0;
+    }
+
+    page->refcount = 1;
+    pmm_state.free_frames -= 1u << order;
+
+    spinlock_release(&pmm_state.lock);
+    return pmm_page_to_frame(page);
+}
+
+/**
+ * pmm_alloc_zeroed_pages – Allocate a block whose contents are zero.
+ * Served from the pre-zeroed pool when possible; a miss zeroes inline and
+ * raises the pool's target for that order so the idle loop keeps some.
+ */
+uintptr_t pmm_alloc_zeroed_pages(uint32_t order) {
+    if (!pmm_state.initialized || order > PMM_MAX_ORDER) {
+        return 0;
+    }
+
+    spinlock_acquire(&pmm_state.lock);
+    page_t *page = zero_pool_take(order);
+    if (page) {
+        page->refcount = 1;
+        pmm_state.free_frames -= 1u << order;
+        zero_pool.stats.hits++;
+        spinlock_release(&pmm_state.lock);
+        return pmm_page_to_frame(page);
+    }
+
+    zero_pool.stats.misses++;
+    zero_pool.stats.frames_zeroed_inline += 1u << order;
+    uint32_t limit = order ? ZERO_POOL_MAX_TARGET : ZERO_POOL_BASE_TARGET;
+    if (zero_pool.target[order] < limit) {
+        zero_pool.target[order]++;
+    }
+    spinlock_release(&pmm_state.lock);
+
+    uintptr_t addr = pmm_alloc_pages(order);
+    if (addr) {
+        zero_frames(addr, 1u << order);
+    }
+    return addr;
+}
+
+/**
+ * pmm_zero_pool_refill – Zero up to `budget` frames towards the pool
+ * targets. Meant for the idle loop: no lock is held while zeroing, so
+ * the caller stays preemptible. Returns false when there is nothing to do.
+ */
+bool pmm_zero_pool_refill(uint32_t budget) {
+    if (!pmm_state.initialized || budget == 0) {
+        return false;
+    }
+
+    spinlock_acquire(&pmm_state.lock);
+    if (!zero_pool.filling) {
+        uint32_t cap = pmm_state.free_frames / 4;
+        if (cap > ZERO_POOL_MAX_FRAMES) {
+            cap = ZERO_POOL_MAX_FRAMES;
+        }
+
+        for (uint32_t order = 0; order <= PMM_MAX_ORDER; order++) {
+            if (zero_pool.count[order] >= zero_pool.target[order] ||
+                zero_pool.frames + (1u << order) > cap) {
+                continue;
+            }
+            page_t *page = buddy_alloc(order);
+            if (page) {
+                zero_pool.filling = page;
+                zero_pool.filling_order = order;
+                zero_pool.filling_claimed = 0;
+                zero_pool.filling_zeroed = 0;
+                break;
+            }
+        }
+    } else if (zero_pool.filling_claimed == (1u << zero_pool.filling_order)) {
+        /* Other CPUs' idle loops are finishing this block */
+        spinlock_release(&pmm_state.lock);
+        return false;
+    }
+
+    page_t *page = zero_pool.filling;
+    if (!page) {
+        spinlock_release(&pmm_state.lock);
+        return false;
+    }
+    uint32_t total = 1u << zero_pool.filling_order;
+    uint32_t start = zero_pool.filling_claimed;
+    uint32_t count = total - start < budget ? total - start : budget;
+    zero_pool.filling_claimed += count;
+    spinlock_release(&pmm_state.lock);
+
+    zero_frames(pmm_page_to_frame(page) + start * PMM_FRAME_SIZE, count);
+
+    spinlock_acquire(&pmm_state.lock);
+    zero_pool.stats.frames_zeroed_idle += count;
+    zero_pool.filling_zeroed += count;
+    if (zero_pool.filling_zeroed == total) {
+        zero_list_push(page, zero_pool.filling_order);
+        zero_pool.filling = NULL;
+    }
+    spinlock_release(&pmm_state.lock);
+    return true;
+}
+
+bool pmm_get_zero_stats(pmm_zero_stats_t *stats) {
+    if (!pmm_state.initialized || !stats) {
+        return false;
+    }
+
+    spinlock_acquire(&pmm_state.lock);
+    *stats = zero_pool.stats;
+    stats->pooled_frames = zero_pool.frames;
+    spinlock_release(&pmm_state.lock);
+    return true;
+}
+
+void pmm_free_pages(uintptr_t addr, uint32_t order) {
+    if (!pmm_state.initialized || order > PMM_MAX_ORDER) {
+        return;
+    }
+
+    page_t *page = pmm_frame_to_page(addr);
+    if (!page || (addr & ((PMM_FRAME_SIZE << order) - 1))) {
+        KLOG_W("PMM: bad free of %08x (order %u)", (uint32_t)addr, order);
+        return;
+    }
+
+    spinlock_acquire(&pmm_state.lock);
+
+    if (page->flags & (PAGE_FLAG_FREE | PAGE_FLAG_RESERVED | PAGE_FLAG_ZEROED)) {
+        spinlock_release(&pmm_state.lock);
+        KLOG_W("PMM: double free or reserved frame %08x", (uint32_t)addr);
+        return;
+    }
+
+    page->refcount = 0;
+    pmm_state.free_frames += 1u << order;
+    buddy_free((uint32_t)(addr >> PMM_FRAME_SHIFT), order);
+
+    spinlock_release(&pmm_state.lock);
+}
+
+uintptr_t pmm_alloc_frame(void) {
+    return pmm_alloc_pages(0);
+}
+
+void pmm_free_frame(uintptr_t addr) {
+    pmm_free_pages(addr, 0);
+}
+
+/* Another mapping now shares this frame */
+void pmm_frame_ref(uintptr_t addr) {
+    page_t *page = pmm_frame_to_page(addr);
+    if (page && !(page->flags & PAGE_FLAG_RESERVED)) {
+        __atomic_add_fetch(&page->refcount, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/* Drop one mapping; the frame is freed with its last one. Returns true if freed. */
+bool pmm_frame_unref(uintptr_t addr) {
+    page_t *page = pmm_frame_to_page(addr);
+    if (!page || (page->flags & PAGE_FLAG_RESERVED)) {
+        return false;
+    }
+    if (__atomic_sub_fetch(&page->refcount, 1, __ATOMIC_ACQ_REL) != 0) {
+        return false;
+    }
+    pmm_free_pages(addr & ~(uintptr_t)(PMM_FRAME_SIZE - 1), 0);
+    return true;
+}
+
+uint32_t pmm_frame_refcount(uintptr_t addr) {
+    page_t *page = pmm_frame_to_page(addr);
+    return page ? __atomic_load_n(&page->refcount, __ATOMIC_ACQUIRE) : 0;
+}
+
+uint32_t pmm_get_free_count(uint32_t order) {
+    if (!pmm_state.initialized || order > PMM_MAX_ORDER) {
+        return 0;
+    }
+    return pmm_state.free_blocks[order];
+}
+
+bool pmm_get_stats(pmm_stats_t *stats) {
+    if (!pmm_state.initialized || !stats) {
+        return false;
+    }
+
+    spinlock_acquire(&pmm_state.lock);
+    stats->total_frames = pmm_state.frame_count;
+    stats->free_frames  = pmm_state.free_frames;
+    for (uint32_t i = 0; i <= PMM_MAX_ORDER; i++) {
+        stats->free_blocks[i] = pmm_state.free_blocks[i];
+    }
+    spinlock_release(&pmm_state.lock);
+    return true;
+}
+
+page_t *pmm_frame_to_page(uintptr_t addr) {
+    uint32_t index = (uint32_t)(addr >> PMM_FRAME_SHIFT);
+    if (!pmm_state.pages || index >= pmm_state.frame_count) {
+        return NULL;
+    }
+    return &pmm_state.pages[index];
+}
+
+uintptr_t pmm_page_to_frame(const page_t *page) {
+    return (uintptr_t)(page - pmm_state.pages) << PMM_FRAME_SHIFT;
+}
+
+uint32_t pmm_order_for_size(size_t size) {
+    uint32_t order = 0;
+    while (order < PMM_MAX_ORDER && ((size_t)PMM_FRAME_SIZE << order) < size) {
+        order++;
+    }
+    return order;
+}
+
+uint32_t pmm_get_total_memory(void) {
+    return pmm_state.total_memory;
+}
+
+uint32_t pmm_get_free_memory(void) {
+    return pmm_state.free_frames * PMM_FRAME_SIZE;
+}
+
+bool pmm_is_initialized(void) {
+    return pmm_state.initialized;
+}
@@ -6,20 +6,107 @@
 
 #include "kernel/process.h"
 #include "kernel/memory.h"
+#include "kernel/scheduler.h"
+#include "kernel/smp.h"
+#include "kernel/fpu.h"
+#include "kernel/timer.h"
+#include "kernel/security.h"
+#include "kernel/slab.h"
+#include "kernel/syscall.h"
 #include "kernel/interrupts.h"
+#include "kernel/mutex.h"
+#include "kernel/kernel.h"
+#include "kernel/spinlock.h"
 #include "libc/string.h"
 
 #define MAX_PROCESSES 256
 #define PROCESS_STACK_SIZE 16384  // 16 KB
 
 typedef struct {
-    process_t* processes[MAX_PROCESSES];
-    process_t* current_process;
+    process_t* pid_map[PROCESS_PID_MAX];        // pid -> process, NULL if free
+    uint32_t pid_bitmap[PROCESS_PID_MAX / 32];  // Bit set while a pid is in use
+    uint32_t last_pid;                          // Allocation resumes after it
+    process_t* current[SMP_MAX_CPUS];   // Running process per CPU
+    process_t* switching_from[SMP_MAX_CPUS];    // prev of an unfinished switch
+    process_t* zombies;                 // Killed while running, freed once off-CPU
     uint32_t process_count;
+    spinlock_t lock;                    // pid map, bitmap and zombie list
     bool initialized;
 } process_manager_t;
 
 static process_manager_t pm;
+static kmem_cache_t* process_cache;
+static uint32_t boot_esp[SMP_MAX_CPUS];   // Discarded context of each CPU's boot code
+
+/* ─── pid allocation ───────────────────────────────────────────── */
+
+/*
+ * Next free pid after the last one handed out, wrapping around so a pid
+ * is not reused while unused ones remain; pid 0 is never allocated.
+ * Whole words are skipped at a time. Caller holds pm.lock.
+ */
+static uint32_t pid_alloc(void) {
+    uint32_t pid = pm.last_pid;
+    for (uint32_t scanned = 0; scanned <= PROCESS_PID_MAX; ) {
+        pid = (pid + 1) % PROCESS_PID_MAX;
+        uint32_t word = pm.pid_bitmap[pid / 32] | ((1u << (pid % 32)) - 1);
+        if (word == 0xFFFFFFFF) {
+            scanned += 32 - pid % 32;
+            pid |= 31;
+            continue;
+        }
+        pid = (pid & ~31u) + __builtin_ctz(~word);
+        if (pid == 0) {
+            scanned++;
+            continue;
+        }
+        pm.pid_bitmap[pid / 32] |= 1u << (pid % 32);
+        pm.last_pid = pid;
+        return pid;
+    }
+    return 0;
+}
+
+// Caller holds pm.lock
+static void pid_free(uint32_t pid) {
+    pm.pid_bitmap[pid / 32] &= ~(1u << (pid % 32));
+    pm.pid_map[pid] = NULL;
+}
+
+// Register a new process under a fresh pid; false if the table is full
+static bool process_register(process_t* process) {
+    spinlock_acquire(&pm.lock);
+    uint32_t pid = pm.process_count < MAX_PROCESSES ? pid_alloc() : 0;
+    if (pid) {
+        process->pid = pid;
+        pm.pid_map[pid] = process;
+        pm.process_count++;
+    }
+    spinlock_release(&pm.lock);
+    return pid != 0;
+}
+
+// boot/switch.asm
+extern void switch_to(void* prev_esp, uint32_t next_esp);
+extern void switch_to_new_task(void);
+
+/*
+ * Below a struct registers frame at `sp`, lay out what switch_to() pops so
+ * the task's first switch-in unwinds that frame through switch_to_new_task.
+ */
+static uint32_t process_push_switch_frame(uint32_t* sp) {
+    *--sp = (uint32_t)switch_to_new_task;  // Return address
+    *--sp = 0x002;        // EFLAGS: interrupts stay off until the iret
+    *--sp = 0;            // EBP
+    *--sp = 0;            // EBX
+    *--sp = 0;            // ESI
+    *--sp = 0;            // EDI
+    *--sp = 0x10;         // DS
+    *--sp = 0x10;         // ES
+    *--sp = 0x10;         // FS
+    *--sp = 0x10;         // GS
+    return (uint32_t)sp;
+}
 
 bool process_init(void) {
     if (pm.initialized) {
@@ -27,17 +114,25 @@ bool process_init(void) {
     }
 
     memset(&pm, 0, sizeof(process_manager_t));
+    spinlock_init(&pm.lock);
+
+    process_cache = kmem_cache_create("process_t", sizeof(process_t), 0, NULL);
+    if (!process_cache) {
+        return false;
+    }
+
     pm.initialized = true;
     return true;
 }
 
 process_t* process_create(const char* name, process_entry_t entry) {
-    if (!pm.initialized || !name || !entry || pm.process_count >= MAX_PROCESSES) {
+    if (!pm.initialized || !name || !entry) {
         return NULL;
     }
+    process_reap_zombies();
 
     // Allocate process structure
-    process_t* process = kmalloc(sizeof(process_t));
+    process_t* process = kmem_cache_alloc(process_cache);
     if (!process) {
         return NULL;
     }
@@ -46,19 +141,19 @@ process_t* process_create(const char* name, process_entry_t entry) {
     memset(process, 0, sizeof(process_t));
     strncpy(process->name, name, PROCESS_NAME_MAX - 1);
     process->name[PROCESS_NAME_MAX - 1] = '\0';
-    process->pid = pm.process_count++;
     process->state = PROCESS_STATE_READY;
     process->priority = 1; // Default priority
+    process->base_priority = 1;
     process->quantum_remaining = 10; // Default quantum
     process->total_runtime = 0;
     process->last_run = 0;
     process->entry = entry;
+    process->page_directory = (uint32_t)vmm_get_kernel_directory();
 
     // Allocate stack
     process->stack = kmalloc(PROCESS_STACK_SIZE);
     if (!process->stack) {
-        kfree(process);
-        pm.process_count--;
+        kmem_cache_free(process_cache, process);
         return NULL;
     }
 
@@ -84,59 +179,335 @@ process_t* process_create(const char* name, process_entry_t entry) {
     *--stack = 0x10;      // FS
     *--stack = 0x10;      // GS
 
-    process->esp = (uint32_t)stack;
-
-    // Add to process list
-    pm.processes[process->id] = process;
+    process->esp = process_push_switch_frame(stack);
+    process->fpu_cpu = 0xFF;
+    process->sleep_slot = PROCESS_NOT_SLEEPING;
 
+    // Publish under a pid that stays fixed until the process is destroyed
+    if (!process_register(process)) {
+        kfree(process->stack);
+        kmem_cache_free(process_cache, process);
+        return NULL;
+    }
     return process;
 }
 
+/*
+ * Move a frame pointer, and the chain of frame pointers saved behind it,
+ * from a kernel stack [low, high) to its copy `delta` bytes away. Each
+ * link lies above the previous one; the chain ends at the first that
+ * leaves the stack. Returns the moved frame pointer.
+ */
+static uint32_t process_relocate_frames(uint32_t ebp, uint32_t low, uint32_t high,
+                                        uint32_t delta) {
+    if (ebp < low || ebp + sizeof(uint32_t) > high) {
+        return ebp;
+    }
+
+    uint32_t* link = (uint32_t*)(ebp + delta);
+    uint32_t prev = ebp;
+    while (*link > prev && *link + sizeof(uint32_t) <= high) {
+        prev = *link;
+        *link += delta;
+        link = (uint32_t*)*link;
+    }
+    return ebp + delta;
+}
+
+/**
+ * process_fork – Duplicate the calling process from inside a system call.
+ * Page tables are copied but data frames are shared copy-on-write, so the
+ * cost is independent of how much memory the parent has touched.
+ */
+process_t* process_fork(process_t* parent) {
+    struct registers* frame = syscall_get_frame();
+    if (!pm.initialized || !parent || !frame || !parent->stack) {
+        return NULL;
+    }
+
+    // The trap frame must be on the parent's own kernel stack to be copied
+    uint32_t stack_low = (uint32_t)parent->stack;
+    uint32_t stack_high = stack_low + PROCESS_STACK_SIZE;
+    if ((uint32_t)frame < stack_low || (uint32_t)frame + sizeof(*frame) > stack_high) {
+        return NULL;
+    }
+
+    process_t* child = kmem_cache_alloc(process_cache);
+    if (!child) {
+        return NULL;
+    }
+
+    // Name, priority, capabilities and descriptors are inherited
+    memcpy(child, parent, sizeof(process_t));
+    child->state = PROCESS_STATE_READY;
+    child->quantum_remaining = 10;
+    child->total_runtime = 0;
+    child->last_run = 0;
+    child->parent = parent;
+    child->next = NULL;
+    child->rq_next = NULL;
+    child->rq_prev = NULL;
+    child->on_rq = false;
+    child->on_cpu = false;
+    child->wake_pending = false;
+    child->waiting = false;
+    child->killed = false;
+    child->zombie = false;
+    child->wake_timed = false;
+    child->wakeups = 0;
+    child->wake_latency_total = 0;
+    child->wake_latency_max = 0;
+    child->sleep_slot = PROCESS_NOT_SLEEPING;
+
+    // Mutexes stay with the parent, and so does anything it inherited
+    child->pi_blocked_on = NULL;
+    child->pi_held = NULL;
+    child->pi_rank = 0;
+    child->priority = child->base_priority;
+    child->policy = child->base_policy;
+
+    child->stack = kmalloc(PROCESS_STACK_SIZE);
+    if (!child->stack) {
+        kmem_cache_free(process_cache, child);
+        return NULL;
+    }
+
+    uint32_t* parent_dir = parent->page_directory ? (uint32_t*)parent->page_directory
+                                                  : vmm_get_kernel_directory();
+    uint32_t* child_dir = vmm_clone_address_space(parent_dir);
+    if (!child_dir) {
+        kfree(child->stack);
+        kmem_cache_free(process_cache, child);
+        return NULL;
+    }
+    child->page_directory = (uint32_t)child_dir;
+
+    // The child resumes on a copy of the parent's stack from the trap frame
+    // up, seeing 0 from fork(). Callers in ring 0 return into their own
+    // frames on it, so saved frame pointers are moved over to the copy.
+    uint32_t delta = (uint32_t)child->stack - stack_low;
+    uint32_t* frame_base = (uint32_t*)((uint32_t)frame + delta);
+    struct registers* child_frame = (struct registers*)frame_base;
+    memcpy(child_frame, frame, stack_high - (uint32_t)frame);
+    child_frame->eax = 0;
+    if (child_frame->esp >= stack_low && child_frame->esp < stack_high) {
+        child_frame->esp += delta;
+    }
+    child_frame->ebp = process_relocate_frames(frame->ebp, stack_low, stack_high, delta);
+    child->esp = process_push_switch_frame(frame_base);
+    child->ebp = child_frame->ebp;
+
+    if (!fpu_fork(parent, child)) {
+        vmm_destroy_address_space(child_dir);
+        kfree(child->stack);
+        kmem_cache_free(process_cache, child);
+        return NULL;
+    }
+
+    if (!process_register(child)) {
+        fpu_release(child);
+        vmm_destroy_address_space(child_dir);
+        kfree(child->stack);
+        kmem_cache_free(process_cache, child);
+        return NULL;
+    }
+
+    if (!scheduler_add_task(child, child->base_priority)) {
+        process_destroy(child);
+        return NULL;
+    }
+    return child;
+}
+
+/**
+ * process_map_anonymous – Give the calling process demand-zero memory.
+ * A task still running on the shared kernel directory first gets an
+ * address space of its own, so the mapping is private to it and is
+ * shared copy-on-write with children it forks afterwards.
+ */
+uint32_t process_map_anonymous(uint32_t size, bool writable) {
+    process_t* current = process_get_current();
+    if (!pm.initialized || !current) {
+        return 0;
+    }
+
+    uint32_t* kernel_dir = vmm_get_kernel_directory();
+    if (!current->page_directory || (uint32_t*)current->page_directory == kernel_dir) {
+        uint32_t* directory = vmm_clone_address_space(kernel_dir);
+        if (!directory) {
+            return 0;
+        }
+        current->page_directory = (uint32_t)directory;
+        vmm_switch_address_space(directory);
+    }
+    uint32_t cursor = current->anon_next;
+    uint32_t addr = vmm_alloc_anonymous(&cursor, size, writable);
+    current->anon_next = cursor;
+    return addr;
+}
+
 void process_destroy(process_t* process) {
     if (!pm.initialized || !process) {
         return;
     }
 
-    // Remove from process list
-    for (uint32_t i = 0; i < pm.process_count; i++) {
-        if (pm.processes[i] == process) {
-            // Shift remaining processes
-            for (uint32_t j = i; j < pm.process_count - 1; j++) {
-                pm.processes[j] = pm.processes[j + 1];
-                pm.processes[j]->pid = j;
-            }
-            pm.process_count--;
-            break;
-        }
+    // Release the pid; no other process is renumbered. Its capabilities go
+    // first, so whoever is handed the pid next never sees them.
+    spinlock_acquire(&pm.lock);
+    if (pm.pid_map[process->pid] == process) {
+        sec_release(process->pid);
+        pid_free(process->pid);
+        pm.process_count--;
     }
+    spinlock_release(&pm.lock);
+
+    timer_cancel_sleep(process);
 
     // Free resources
+    if (process->page_directory &&
+        (uint32_t*)process->page_directory != vmm_get_kernel_directory()) {
+        if (process == pm.current[smp_cpu_index()]) {
+            vmm_switch_address_space(vmm_get_kernel_directory());
+        }
+        vmm_destroy_address_space((uint32_t*)process->page_directory);
+    }
     if (process->stack) {
         kfree(process->stack);
     }
-    kfree(process);
+    fpu_release(process);
+    kmem_cache_free(process_cache, process);
 
     // Update current process if needed
-    if (pm.current_process == process) {
-        pm.current_process = NULL;
+    for (uint32_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        if (pm.current[cpu] == process) {
+            pm.current[cpu] = NULL;
+        }
     }
 }
 
-void process_schedule(void) {
-    if (!pm.initialized || pm.process_count == 0) {
+// Queue a dying process for process_reap_zombies(); at most once
+static void process_add_zombie(process_t* process) {
+    spinlock_acquire(&pm.lock);
+    if (!process->zombie) {
+        process->zombie = true;
+        process->next = pm.zombies;
+        pm.zombies = process;
+    }
+    spinlock_release(&pm.lock);
+}
+
+/*
+ * Free killed processes once they have terminated and no CPU runs on
+ * their stack any more. Each kill adds at most one entry, so this stays
+ * short.
+ */
+void process_reap_zombies(void) {
+    if (!pm.zombies) {
         return;
     }
 
-    // Simple round-robin scheduling
-    if (!pm.current_process) {
-        pm.current_process = pm.processes[0];
-    } else {
-        uint32_t next_id = (pm.current_process->pid + 1) % pm.process_count;
-        pm.current_process = pm.processes[next_id];
+    process_t* reap = NULL;
+    process_t* keep = NULL;
+    spinlock_acquire(&pm.lock);
+    while (pm.zombies) {
+        process_t* zombie = pm.zombies;
+        pm.zombies = zombie->next;
+        // A killed task runs on until it has left its waits and its CPU
+        if (zombie->state != PROCESS_STATE_TERMINATED || zombie->on_cpu || zombie->on_rq) {
+            zombie->next = keep;
+            keep = zombie;
+        } else {
+            zombie->next = reap;
+            reap = zombie;
+        }
+    }
+    pm.zombies = keep;
+    spinlock_release(&pm.lock);
+
+    while (reap) {
+        process_t* next = reap->next;
+        process_destroy(reap);
+        reap = next;
+    }
+}
+
+process_t* process_get_by_pid(uint32_t pid) {
+    if (!pm.initialized || pid == 0 || pid >= PROCESS_PID_MAX) {
+        return NULL;
+    }
+    return pm.pid_map[pid];
+}
+
+/*
+ * Snapshot a process by pid. Taken under pm.lock, which process_destroy()
+ * holds to unpublish a process before freeing it.
+ */
+bool process_get_info(uint32_t pid, process_info_t* info) {
+    if (!pm.initialized || pid == 0 || pid >= PROCESS_PID_MAX || !info) {
+        return false;
+    }
+
+    spinlock_acquire(&pm.lock);
+    process_t* process = pm.pid_map[pid];
+    if (process) {
+        info->pid = pid;
+        memcpy(info->name, process->name, PROCESS_NAME_MAX);
+        info->state = process->state;
+        info->cpu = process->cpu;
+        info->wakeups = process->wakeups;
+        info->wake_latency_total = process->wake_latency_total;
+        info->wake_latency_max = process->wake_latency_max;
+    }
+    spinlock_release(&pm.lock);
+    return process != NULL;
+}
+
+/*
+ * Terminate a process by pid. One that is idle is freed at once. One that
+ * is running somewhere or waiting is only marked killed: it leaves its
+ * wait, hands on its mutexes and terminates at its next switch, and a
+ * later reap frees it. Killing the caller does not return.
+ */
+bool process_kill(uint32_t pid) {
+    process_t* process = process_get_by_pid(pid);
+    if (!process || process->state == PROCESS_STATE_TERMINATED) {
+        return false;
+    }
+    if (process == process_get_current()) {
+        process_exit();
+    }
+
+    if (!scheduler_remove_task(process)) {
+        process_add_zombie(process);
+        return true;
+    }
+    process_destroy(process);
+    process_reap_zombies();
+    return true;
+}
+
+/*
+ * End the calling process. Contended mutexes go to their next owner;
+ * one it owns uncontended stays locked. A mutex can gain a waiter again
+ * before the switch, so hand on and retry until the scheduler lets go.
+ */
+void process_exit(void) {
+    process_t* current = process_get_current();
+    if (!current) {
+        kernel_panic("process_exit() without a process");
+    }
+
+    process_add_zombie(current);
+    current->killed = true;
+    for (;;) {
+        mutex_unlock_all();
+        scheduler_switch_task();
     }
+}
 
-    // Switch to next process
-    process_switch(pm.current_process);
+// Round robin now lives in the scheduler's run queues
+void process_schedule(void) {
+    scheduler_switch_task();
 }
 
 void process_switch(process_t* next) {
@@ -144,29 +515,65 @@ void process_switch(process_t* next) {
         return;
     }
 
-    // Save current process state
-    if (pm.current_process) {
-        __asm__ volatile(
-            "mov %%esp, %0\n"
-            "mov %%ebp, %1\n"
-            : "=r"(pm.current_process->esp),
-              "=r"(pm.current_process->ebp)
-        );
+    process_t** current = &pm.current[smp_cpu_index()];
+    process_t* prev = *current;
+    if (prev == next) {
+        return;
+    }
+
+    // Arm the #NM trap; FPU registers are only saved if prev used them
+    fpu_switch(prev);
+
+    // Traps from ring 3 land on the next process's kernel stack
+    if (next->stack) {
+        smp_set_kernel_stack((uint32_t)next->stack + PROCESS_STACK_SIZE);
     }
 
-    // Load next process state
-    __asm__ volatile(
-        "mov %0, %%esp\n"
-        "mov %1, %%ebp\n"
-        : : "r"(next->esp),
-            "r"(next->ebp)
-    );
+    // Enter the next address space; kernel mappings are shared by all of them
+    if (next->page_directory) {
+        vmm_switch_address_space((uint32_t*)next->page_directory);
+    }
+
+    // Returns once something switches back to prev
+    *current = next;
+    next->on_cpu = true;
+    pm.switching_from[smp_cpu_index()] = prev;
+    switch_to(prev ? &prev->esp : &boot_esp[smp_cpu_index()], next->esp);
+    process_finish_switch();
+}
+
+/*
+ * First thing on the new stack after switch_to(), also for tasks entered
+ * through switch_to_new_task: only now is prev's stack no longer in use.
+ */
+void process_finish_switch(void) {
+    uint32_t cpu = smp_cpu_index();
+    process_t* prev = pm.switching_from[cpu];
+    pm.switching_from[cpu] = NULL;
+    if (prev) {
+        // switch_to() has stored prev's esp; from here another CPU may run it
+        __sync_synchronize();
+        prev->on_cpu = false;
+    }
+}
+
+// Adopt the context already running on this CPU as `process` (AP idle tasks)
+void process_set_current(process_t* process) {
+    pm.current[smp_cpu_index()] = process;
+    process->on_cpu = true;
+}
+
+// Sleep until process_wake(); the scheduler drops blocked tasks from its queues
+void process_block(process_t* process) {
+    scheduler_block(process);
+}
 
-    pm.current_process = next;
+void process_wake(process_t* process) {
+    scheduler_wake(process);
 }
 
 process_t* process_get_current(void) {
-    return pm.current_process;
+    return pm.current[smp_cpu_index()];
 }
 
 uint32_t process_get_count(void) {
@@ -7,43 +7,623 @@
 #include "kernel/scheduler.h"
 #include "kernel/process.h"
 #include "kernel/memory.h"
+#include "kernel/pmm.h"
 #include "kernel/timer.h"
+#include "kernel/smp.h"
+#include "kernel/apic.h"
+#include "kernel/interrupts.h"
+#include "kernel/spinlock.h"
+#include "kernel/logging.h"
 #include "libc/string.h"
 
-#define MAX_TASKS 256
-#define SCHEDULER_QUANTUM 10 // milliseconds
-
-static struct {
-    process_t* tasks[MAX_TASKS];
+#define SCHEDULER_QUANTUM 10 // milliseconds, round-robin real-time tasks
+#define SCHED_QUANTUM_NONE 0xFFFFFFFF // FIFO tasks run until they block or yield
+#define IDLE_ZERO_CHUNK 4     // frames pre-zeroed per idle iteration
+
+// Fair class: every runnable task runs once per latency period, in slices
+// proportional to its weight but never shorter than the minimum granularity
+#define SCHED_LATENCY            20   // ticks
+#define SCHED_MIN_GRANULARITY    3    // ticks
+#define SCHED_WEIGHT_DEFAULT     1024 // Weight of priority 1
+#define SCHED_VRUNTIME_SHIFT     10   // vruntime counts 1/1024 ticks at the default weight
+#define SCHED_WAKEUP_GRANULARITY (2ull << SCHED_VRUNTIME_SHIFT)
+#define SCHED_WAKEUP_CREDIT      ((uint64_t)(SCHED_LATENCY / 2) << SCHED_VRUNTIME_SHIFT)
+
+// Each priority step is worth 25% more CPU than the one below it
+static const uint32_t sched_weights[SCHED_PRIORITY_LEVELS] = {
+        819,    1024,    1280,    1600,    2000,    2500,    3125,    3906,
+       4883,    6104,    7629,    9537,   11921,   14901,   18626,   23283,
+      29104,   36380,   45475,   56843,   71054,   88818,  111022,  138778,
+     173472,  216840,  271051,  338813,  423516,  529396,  661744,  827181,
+};
+
+typedef struct {
+    process_t* head;
+    process_t* tail;
+} run_list_t;
+
+// One per CPU; tasks only change queues while their current queue is locked
+typedef struct {
+    run_list_t queues[SCHED_PRIORITY_LEVELS];
+    uint32_t ready_bitmap;      // Bit p set while queues[p] is non-empty
+    process_t* fair_heap[MAX_PROCESSES];  // Fair tasks, min-heap on vruntime
+    uint32_t fair_count;
+    uint32_t fair_weight;       // Sum of queued fair tasks' weights
+    uint64_t min_vruntime;      // Monotonic floor new and woken tasks start from
+    uint32_t rt_time;           // Ticks real-time tasks ran this period
+    uint32_t rt_period_start;
+    bool rt_throttled;          // Budget spent: fair tasks run until the period ends
+    uint32_t rt_throttle_count;
+    uint32_t ready_count;
     process_t* current_process;
     process_t* idle_process;
-    uint32_t task_count;
     uint32_t total_switches;
+    uint32_t steals;            // Tasks pulled from other CPUs' queues
+    spinlock_t lock;
+    bool online;
+} run_queue_t;
+
+static struct {
+    run_queue_t cpus[SMP_MAX_CPUS];
+    uint32_t rt_runtime;        // Real-time budget per CPU and period, in ticks
+    uint32_t rt_period;
+    uint32_t task_count;
     bool initialized;
 } scheduler_state;
 
+static inline run_queue_t* this_rq(void) {
+    return &scheduler_state.cpus[smp_cpu_index()];
+}
+
+// Lock the run queue a task belongs to, following it if it migrates meanwhile
+static run_queue_t* task_rq_lock(process_t* process) {
+    for (;;) {
+        run_queue_t* rq = &scheduler_state.cpus[process->cpu];
+        spinlock_acquire(&rq->lock);
+        if (rq == &scheduler_state.cpus[process->cpu]) {
+            return rq;
+        }
+        spinlock_release(&rq->lock);
+    }
+}
+
+/* ─── fair class ───────────────────────────────────────────────── */
+
+static inline uint32_t sched_level(uint8_t priority) {
+    return priority < SCHED_PRIORITY_LEVELS ? priority : SCHED_PRIORITY_LEVELS - 1;
+}
+
+static inline uint32_t sched_weight(const process_t* process) {
+    return sched_weights[sched_level(process->priority)];
+}
+
+static inline bool sched_is_fair(const run_queue_t* rq, const process_t* process) {
+    return process != rq->idle_process && process->policy == SCHED_POLICY_FAIR;
+}
+
+static inline bool sched_is_rt(const process_t* process) {
+    return process->policy == SCHED_POLICY_FIFO || process->policy == SCHED_POLICY_RR;
+}
+
+static inline void fair_heap_set(run_queue_t* rq, uint32_t slot, process_t* process) {
+    rq->fair_heap[slot] = process;
+    process->fair_slot = (uint16_t)slot;
+}
+
+static void fair_heap_sift_up(run_queue_t* rq, uint32_t slot) {
+    process_t* process = rq->fair_heap[slot];
+    while (slot > 0) {
+        uint32_t parent = (slot - 1) / 2;
+        if (rq->fair_heap[parent]->vruntime <= process->vruntime) {
+            break;
+        }
+        fair_heap_set(rq, slot, rq->fair_heap[parent]);
+        slot = parent;
+    }
+    fair_heap_set(rq, slot, process);
+}
+
+static void fair_heap_sift_down(run_queue_t* rq, uint32_t slot) {
+    process_t* process = rq->fair_heap[slot];
+    for (;;) {
+        uint32_t child = slot * 2 + 1;
+        if (child >= rq->fair_count) {
+            break;
+        }
+        if (child + 1 < rq->fair_count &&
+            rq->fair_heap[child + 1]->vruntime < rq->fair_heap[child]->vruntime) {
+            child++;
+        }
+        if (rq->fair_heap[child]->vruntime >= process->vruntime) {
+            break;
+        }
+        fair_heap_set(rq, slot, rq->fair_heap[child]);
+        slot = child;
+    }
+    fair_heap_set(rq, slot, process);
+}
+
+static void fair_enqueue(run_queue_t* rq, process_t* process) {
+    rq->fair_heap[rq->fair_count] = process;
+    fair_heap_sift_up(rq, rq->fair_count++);
+    rq->fair_weight += sched_weight(process);
+}
+
+static void fair_dequeue(run_queue_t* rq, process_t* process) {
+    uint32_t slot = process->fair_slot;
+    uint32_t last = --rq->fair_count;
+    rq->fair_weight -= sched_weight(process);
+    if (slot == last) {
+        return;
+    }
+    fair_heap_set(rq, slot, rq->fair_heap[last]);
+    if (slot > 0 && rq->fair_heap[slot]->vruntime < rq->fair_heap[(slot - 1) / 2]->vruntime) {
+        fair_heap_sift_up(rq, slot);
+    } else {
+        fair_heap_sift_down(rq, slot);
+    }
+}
+
+// Advance min_vruntime to the smallest vruntime still competing, never backwards
+static void sched_update_min_vruntime(run_queue_t* rq) {
+    process_t* current = rq->current_process;
+    bool running = current && current->state == PROCESS_STATE_RUNNING && sched_is_fair(rq, current);
+    uint64_t floor = running ? current->vruntime : 0;
+
+    if (rq->fair_count && (!running || rq->fair_heap[0]->vruntime < floor)) {
+        floor = rq->fair_heap[0]->vruntime;
+    } else if (!running) {
+        return;
+    }
+    if (floor > rq->min_vruntime) {
+        rq->min_vruntime = floor;
+    }
+}
+
+/*
+ * Charge real-time runtime against the CPU's budget. Once it is spent, a
+ * runaway real-time task yields to waiting fair tasks until the period ends.
+ */
+static void sched_update_rt(run_queue_t* rq, process_t* current, uint32_t now, uint32_t delta) {
+    if (sched_is_rt(current)) {
+        rq->rt_time += delta;
+        if (!rq->rt_throttled && rq->rt_time >= scheduler_state.rt_runtime) {
+            rq->rt_throttled = true;
+            rq->rt_throttle_count++;
+            if (rq->fair_count) {
+                current->quantum_remaining = 0;
+            }
+        }
+    }
+
+    if (now - rq->rt_period_start >= scheduler_state.rt_period) {
+        rq->rt_period_start = now;
+        rq->rt_time = 0;
+        if (rq->rt_throttled) {
+            rq->rt_throttled = false;
+            if (rq->ready_bitmap && !sched_is_rt(current)) {
+                current->quantum_remaining = 0;
+            }
+        }
+    }
+}
+
+// Charge the running task for the ticks since it was last charged
+static void sched_update_curr(run_queue_t* rq) {
+    process_t* current = rq->current_process;
+    if (!current) {
+        return;
+    }
+
+    uint32_t now = timer_get_ticks();
+    uint32_t delta = now - current->last_run;
+    current->total_runtime += delta;
+    current->last_run = now;
+
+    if (delta && sched_is_fair(rq, current)) {
+        current->vruntime += ((uint64_t)delta << SCHED_VRUNTIME_SHIFT) *
+                             SCHED_WEIGHT_DEFAULT / sched_weight(current);
+        sched_update_min_vruntime(rq);
+    }
+    sched_update_rt(rq, current, now, delta);
+}
+
+/*
+ * New tasks start at the queue's floor so they cannot monopolise the CPU;
+ * woken ones keep up to `credit` of the lead they built up while asleep.
+ */
+static void sched_place_fair(run_queue_t* rq, process_t* process, uint64_t credit) {
+    uint64_t floor = rq->min_vruntime > credit ? rq->min_vruntime - credit : 0;
+    if (process->vruntime < floor) {
+        process->vruntime = floor;
+    }
+}
+
+// Ticks a task may run before it is switched out
+static uint32_t sched_slice(run_queue_t* rq, process_t* process) {
+    if (process->policy == SCHED_POLICY_FIFO) {
+        return SCHED_QUANTUM_NONE;
+    }
+    if (!sched_is_fair(rq, process)) {
+        return SCHEDULER_QUANTUM;
+    }
+    uint32_t weight = sched_weight(process);
+    uint32_t slice = (uint32_t)((uint64_t)SCHED_LATENCY * weight / (rq->fair_weight + weight));
+    return slice > SCHED_MIN_GRANULARITY ? slice : SCHED_MIN_GRANULARITY;
+}
+
+/* ─── run queues ───────────────────────────────────────────────── */
+
+/*
+ * Real-time tasks join their priority level, at the head for a preempted
+ * FIFO task and at the tail otherwise; fair tasks go into the vruntime
+ * heap. Caller holds rq->lock.
+ */
+static void rq_enqueue_at(run_queue_t* rq, process_t* process, bool head) {
+    process->on_rq = true;
+    process->cpu = (uint8_t)(rq - scheduler_state.cpus);
+    rq->ready_count++;
+
+    if (process->policy == SCHED_POLICY_FAIR) {
+        fair_enqueue(rq, process);
+        return;
+    }
+
+    uint32_t level = sched_level(process->priority);
+    run_list_t* queue = &rq->queues[level];
+
+    if (head) {
+        process->rq_prev = NULL;
+        process->rq_next = queue->head;
+        if (queue->head) {
+            queue->head->rq_prev = process;
+        } else {
+            queue->tail = process;
+        }
+        queue->head = process;
+    } else {
+        process->rq_next = NULL;
+        process->rq_prev = queue->tail;
+        if (queue->tail) {
+            queue->tail->rq_next = process;
+        } else {
+            queue->head = process;
+        }
+        queue->tail = process;
+    }
+    rq->ready_bitmap |= 1u << level;
+}
+
+static inline void rq_enqueue(run_queue_t* rq, process_t* process) {
+    rq_enqueue_at(rq, process, false);
+}
+
+static void rq_dequeue(run_queue_t* rq, process_t* process) {
+    process->on_rq = false;
+    rq->ready_count--;
+
+    if (process->policy == SCHED_POLICY_FAIR) {
+        fair_dequeue(rq, process);
+        return;
+    }
+
+    uint32_t level = sched_level(process->priority);
+    run_list_t* queue = &rq->queues[level];
+
+    if (process->rq_prev) {
+        process->rq_prev->rq_next = process->rq_next;
+    } else {
+        queue->head = process->rq_next;
+    }
+    if (process->rq_next) {
+        process->rq_next->rq_prev = process->rq_prev;
+    } else {
+        queue->tail = process->rq_prev;
+    }
+    process->rq_next = NULL;
+    process->rq_prev = NULL;
+
+    if (!queue->head) {
+        rq->ready_bitmap &= ~(1u << level);
+    }
+}
+
+/*
+ * Real-time tasks first, highest non-empty level via find-last-set and
+ * FIFO within the level; then the fair task with the smallest vruntime.
+ * A throttled CPU only runs real-time tasks when no fair task is waiting.
+ */
+static process_t* rq_pick(run_queue_t* rq) {
+    process_t* next;
+    if (rq->ready_bitmap && (!rq->rt_throttled || !rq->fair_count)) {
+        uint32_t level = 31 - __builtin_clz(rq->ready_bitmap);
+        next = rq->queues[level].head;
+    } else if (rq->fair_count) {
+        next = rq->fair_heap[0];
+    } else {
+        return NULL;
+    }
+    rq_dequeue(rq, next);
+    return next;
+}
+
+// Queued tasks plus the one running, idle excluded
+static inline uint32_t rq_load(const run_queue_t* rq) {
+    return rq->ready_count +
+           (rq->current_process && rq->current_process != rq->idle_process);
+}
+
+// Other CPU with the most queued work, NULL if none has any
+static run_queue_t* rq_busiest(uint32_t self) {
+    run_queue_t* busiest = NULL;
+    for (uint32_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        run_queue_t* other = &scheduler_state.cpus[cpu];
+        if (cpu != self && other->online && other->ready_count &&
+            (!busiest || other->ready_count > busiest->ready_count)) {
+            busiest = other;
+        }
+    }
+    return busiest;
+}
+
+/*
+ * Like rq_pick(), but passes over a task that is queued again while its
+ * CPU is still switching away from it: until on_cpu clears, its saved
+ * stack pointer is stale. Only that CPU's previous task can be in this
+ * state, so at most one task is skipped.
+ */
+static process_t* rq_pick_migratable(run_queue_t* rq) {
+    process_t* next = rq_pick(rq);
+    if (!next || !next->on_cpu) {
+        return next;
+    }
+
+    process_t* other = rq_pick(rq);
+    rq_enqueue_at(rq, next, true);
+    if (other && other->on_cpu) {
+        rq_enqueue_at(rq, other, true);
+        return NULL;
+    }
+    return other;
+}
+
+/**
+ * rq_steal – Take the highest-priority queued task from the busiest other
+ * CPU. Caller holds rq->lock; the victim's lock is only tried, so two CPUs
+ * stealing from each other cannot deadlock.
+ */
+static process_t* rq_steal(run_queue_t* rq, uint32_t self) {
+    run_queue_t* busiest = rq_busiest(self);
+    if (!busiest || !spinlock_try_acquire(&busiest->lock)) {
+        return NULL;
+    }
+
+    process_t* task = rq_pick_migratable(busiest);
+    if (task) {
+        // Keep its vruntime lag relative to the new queue's floor; a task
+        // still behind the old floor may lead by its lag, but not below zero
+        int64_t lag = (int64_t)(task->vruntime - busiest->min_vruntime);
+        int64_t vruntime = (int64_t)rq->min_vruntime + lag;
+        task->vruntime = vruntime > 0 ? (uint64_t)vruntime : 0;
+        task->cpu = (uint8_t)self;
+        rq->steals++;
+    }
+    spinlock_release(&busiest->lock);
+    return task;
+}
+
+/*
+ * A newly runnable task outranks the CPU's current one: switch on its next
+ * tick. Real-time beats fair unless the CPU's real-time budget is spent;
+ * between fair tasks the newcomer needs a clear vruntime lead, and the
+ * current one still gets its minimum slice.
+ */
+static bool sched_check_preempt(run_queue_t* rq, process_t* process) {
+    process_t* current = rq->current_process;
+    if (!current) {
+        return false;
+    }
+    if (current == rq->idle_process) {
+        current->quantum_remaining = 0;
+        return true;
+    }
+
+    if (sched_is_rt(process)) {
+        if ((!sched_is_rt(current) && !rq->rt_throttled) ||
+            (sched_is_rt(current) && sched_level(process->priority) > sched_level(current->priority))) {
+            current->quantum_remaining = 0;
+            return true;
+        }
+        return false;
+    }
+    if (sched_is_rt(current)) {
+        return false;
+    }
+
+    sched_update_curr(rq);
+    if (process->vruntime + SCHED_WAKEUP_GRANULARITY >= current->vruntime) {
+        return false;
+    }
+    uint32_t ran = timer_get_ticks() - current->exec_start;
+    if (ran < SCHED_MIN_GRANULARITY) {
+        uint32_t left = SCHED_MIN_GRANULARITY - ran;
+        if (current->quantum_remaining > left) {
+            current->quantum_remaining = left;
+        }
+        return false;
+    }
+    current->quantum_remaining = 0;
+    return true;
+}
+
+// Least-loaded online CPU for a new task, preferring the caller's
+static uint32_t sched_select_cpu(void) {
+    uint32_t best = smp_cpu_index();
+    uint32_t best_load = rq_load(&scheduler_state.cpus[best]);
+    for (uint32_t cpu = 0; cpu < SMP_MAX_CPUS && best_load; cpu++) {
+        run_queue_t* rq = &scheduler_state.cpus[cpu];
+        if (rq->online && rq_load(rq) < best_load) {
+            best = cpu;
+            best_load = rq_load(rq);
+        }
+    }
+    return best;
+}
+
+// Killed, and no wait list or contended mutex points at it any more
+static inline bool sched_may_terminate(const process_t* process) {
+    return process->killed && !process->waiting && !process->pi_held;
+}
+
+// Requeue a blocked task; returns whether its CPU should reschedule
+static bool sched_wake_locked(run_queue_t* rq, process_t* process) {
+    process->state = PROCESS_STATE_READY;
+    sched_place_fair(rq, process, SCHED_WAKEUP_CREDIT);
+    process->wake_tick = timer_get_ticks();
+    process->wake_timed = true;
+    rq_enqueue(rq, process);
+    return sched_check_preempt(rq, process);
+}
+
+/*
+ * Pick and switch to the next task; called with rq->lock held, releases it.
+ * The caller disabled interrupts before taking the lock and restores them
+ * only once this returns: between the release and process_finish_switch()
+ * rq->current_process is already the next task but this CPU still runs on
+ * prev's stack, and a tick must not schedule from that state.
+ */
+static void schedule_locked(run_queue_t* rq, uint32_t self) {
+    // Charge the current task; if still runnable it goes to the back of its
+    // level, or back into the heap at its new vruntime. A killed one that
+    // nothing links to any more ends here instead.
+    process_t* prev = rq->current_process;
+    if (prev) {
+        sched_update_curr(rq);
+        if (prev->state == PROCESS_STATE_RUNNING && prev != rq->idle_process &&
+            sched_may_terminate(prev)) {
+            prev->state = PROCESS_STATE_TERMINATED;
+            __sync_fetch_and_sub(&scheduler_state.task_count, 1);
+        } else if (prev->state == PROCESS_STATE_RUNNING) {
+            prev->state = PROCESS_STATE_READY;
+            if (prev != rq->idle_process) {
+                rq_enqueue_at(rq, prev, prev->policy == SCHED_POLICY_FIFO);
+            }
+        }
+    }
+
+    // Local work first, then another CPU's, then idle
+    process_t* next_process = rq_pick(rq);
+    if (!next_process) {
+        next_process = rq_steal(rq, self);
+    }
+    if (!next_process) {
+        next_process = rq->idle_process;
+    }
+
+    next_process->quantum_remaining = sched_slice(rq, next_process);
+    next_process->state = PROCESS_STATE_RUNNING;
+    next_process->last_run = timer_get_ticks();
+    next_process->exec_start = next_process->last_run;
+
+    // Wakeup latency: from scheduler_wake() until the task is picked
+    if (next_process->wake_timed) {
+        uint32_t latency = next_process->exec_start - next_process->wake_tick;
+        next_process->wake_timed = false;
+        next_process->wakeups++;
+        next_process->wake_latency_total += latency;
+        if (latency > next_process->wake_latency_max) {
+            next_process->wake_latency_max = latency;
+        }
+    }
+
+    // Leaving idle from an interrupt: put the periodic tick back for the quantum
+    if (prev == rq->idle_process && next_process != prev) {
+        timer_idle_exit();
+    }
+
+    rq->current_process = next_process;
+    rq->total_switches++;
+
+    spinlock_release(&rq->lock);
+
+    // Perform context switch
+    if (next_process != prev) {
+        process_switch(next_process);
+    }
+}
+
 static void scheduler_timer_callback(uint32_t tick_count) {
-    if (!scheduler_state.initialized || !scheduler_state.current_process) {
+    (void)tick_count;
+    if (!scheduler_state.initialized) {
         return;
     }
 
+    run_queue_t* rq = this_rq();
+    process_t* current = rq->current_process;
+    if (!current) {
+        return;
+    }
+
+    // An idle CPU looks for work every tick, its own or a busy neighbour's
+    if (current == rq->idle_process) {
+        if (rq->ready_count || rq_busiest(smp_cpu_index())) {
+            scheduler_switch_task();
+        }
+        return;
+    }
+
+    spinlock_acquire(&rq->lock);
+    sched_update_curr(rq);
+    spinlock_release(&rq->lock);
+
     // Decrement quantum
-    if (scheduler_state.current_process->quantum_remaining > 0) {
-        scheduler_state.current_process->quantum_remaining--;
+    if (current->quantum_remaining > 0) {
+        current->quantum_remaining--;
     }
 
     // If quantum expired, trigger context switch
-    if (scheduler_state.current_process->quantum_remaining == 0) {
+    if (current->quantum_remaining == 0) {
+        scheduler_switch_task();
+    }
+}
+
+// Another CPU queued work for us or wants the current task preempted
+static void scheduler_resched_ipi(struct registers* r) {
+    (void)r;
+    apic_eoi();
+
+    run_queue_t* rq = this_rq();
+    process_t* current = rq->current_process;
+    if (current && (current == rq->idle_process || current->quantum_remaining == 0)) {
         scheduler_switch_task();
     }
 }
 
-static void scheduler_idle_task(void) {
+void scheduler_run_idle(void) {
     while (1) {
-        __asm__ volatile("hlt");
+        // Spend idle time pre-zeroing frames in small, preemptible chunks;
+        // halt once the pool is full
+        if (pmm_zero_pool_refill(IDLE_ZERO_CHUNK)) {
+            continue;
+        }
+
+        // Stop the tick unless there is work to pick up on the next one
+        __asm__ volatile("cli");
+        run_queue_t* rq = this_rq();
+        if (!rq->ready_count && !rq_busiest(smp_cpu_index())) {
+            timer_idle_enter();
+        }
+        __asm__ volatile("sti; hlt");
+
+        // Woken by something other than our timer: resume ticking
+        __asm__ volatile("cli");
+        timer_idle_exit();
+        __asm__ volatile("sti");
     }
 }
 
+/* ─── public API ───────────────────────────────────────────────── */
+
 bool scheduler_init(void) {
     if (scheduler_state.initialized) {
         return true;
@@ -51,28 +631,64 @@ bool scheduler_init(void) {
 
     // Initialize state
     memset(&scheduler_state, 0, sizeof(scheduler_state));
+    scheduler_state.rt_runtime = SCHED_RT_RUNTIME_DEFAULT;
+    scheduler_state.rt_period = SCHED_RT_PERIOD_DEFAULT;
+    // Every CPU takes remote run-queue locks to wake and steal: queue them
+    for (uint32_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        spinlock_init_mcs(&scheduler_state.cpus[cpu].lock);
+    }
 
-    // Create idle task
-    process_t* idle = process_create("idle", (void*)scheduler_idle_task);
+    // Create the boot CPU's idle task
+    run_queue_t* rq = &scheduler_state.cpus[0];
+    process_t* idle = process_create("idle", scheduler_run_idle);
     if (!idle) {
         return false;
     }
 
-    scheduler_state.idle_process = idle;
-    scheduler_state.idle_process->quantum_remaining = SCHEDULER_QUANTUM;
-    scheduler_state.idle_process->priority = 0;
-    scheduler_state.idle_process->state = PROCESS_STATE_READY;
+    rq->idle_process = idle;
+    rq->idle_process->quantum_remaining = SCHEDULER_QUANTUM;
+    rq->idle_process->priority = 0;
+    rq->idle_process->state = PROCESS_STATE_READY;
+    rq->online = true;
 
     // Register timer callback
     timer_set_callback(scheduler_timer_callback);
+    register_interrupt_handler(SMP_RESCHED_VECTOR, scheduler_resched_ipi);
 
     scheduler_state.initialized = true;
     return true;
 }
 
+/**
+ * scheduler_init_cpu – Bring an AP's run queue online. The AP's boot
+ * context becomes its idle task, which it enters via scheduler_run_idle().
+ */
+bool scheduler_init_cpu(uint32_t cpu) {
+    if (!scheduler_state.initialized || cpu >= SMP_MAX_CPUS) {
+        return false;
+    }
+
+    run_queue_t* rq = &scheduler_state.cpus[cpu];
+    process_t* idle = process_create("idle", scheduler_run_idle);
+    if (!idle) {
+        return false;
+    }
+
+    idle->priority = 0;
+    idle->state = PROCESS_STATE_RUNNING;
+    idle->cpu = (uint8_t)cpu;
+    process_set_current(idle);
+
+    spinlock_acquire(&rq->lock);
+    rq->idle_process = idle;
+    rq->current_process = idle;
+    rq->online = true;
+    spinlock_release(&rq->lock);
+    return true;
+}
+
 bool scheduler_add_task(process_t* process, uint8_t priority) {
-    if (!scheduler_state.initialized || !process || 
-        scheduler_state.task_count >= MAX_TASKS) {
+    if (!scheduler_state.initialized || !process || process->on_rq) {
         return false;
     }
 
@@ -80,95 +696,295 @@ bool scheduler_add_task(process_t* process, uint8_t priority) {
     process->total_runtime = 0;
     process->last_run = timer_get_ticks();
     process->priority = priority;
+    process->base_priority = priority;
     process->state = PROCESS_STATE_READY;
 
-    // Add to task list
-    scheduler_state.tasks[scheduler_state.task_count++] = process;
+    uint32_t cpu = sched_select_cpu();
+    run_queue_t* rq = &scheduler_state.cpus[cpu];
+
+    spinlock_acquire(&rq->lock);
+    sched_place_fair(rq, process, 0);
+    rq_enqueue(rq, process);
+    bool kick = sched_check_preempt(rq, process);
+    spinlock_release(&rq->lock);
+
+    __sync_fetch_and_add(&scheduler_state.task_count, 1);
+    if (kick) {
+        smp_send_reschedule(cpu);
+    }
+    return true;
+}
+
+bool scheduler_remove_task(process_t* process) {
+    if (!scheduler_state.initialized || !process) {
+        return false;
+    }
+
+    run_queue_t* rq = task_rq_lock(process);
+    if (process->state == PROCESS_STATE_TERMINATED) {
+        spinlock_release(&rq->lock);
+        return false;
+    }
+
+    // Freeing it now would leave a CPU, a wait list or a mutex pointing at
+    // it: let it get out of all of them and terminate itself
+    if (rq->current_process == process || process->on_cpu ||
+        process->waiting || process->pi_held) {
+        process->killed = true;
+        bool kick = false;
+        if (process->state == PROCESS_STATE_BLOCKED) {
+            kick = sched_wake_locked(rq, process);
+        } else if (rq->current_process == process) {
+            process->quantum_remaining = 0;
+            kick = rq != this_rq();
+        }
+        uint32_t cpu = process->cpu;
+        spinlock_release(&rq->lock);
+
+        if (kick) {
+            smp_send_reschedule(cpu);
+        }
+        return false;
+    }
+
+    if (process->on_rq) {
+        rq_dequeue(rq, process);
+    }
+    process->state = PROCESS_STATE_TERMINATED;
+    spinlock_release(&rq->lock);
+
+    __sync_fetch_and_sub(&scheduler_state.task_count, 1);
+    return true;
+}
+
+bool scheduler_block(process_t* process) {
+    if (!scheduler_state.initialized || !process) {
+        return true;
+    }
 
-    // Sort tasks by priority
-    for (uint32_t i = scheduler_state.task_count - 1; i > 0; i--) {
-        if (scheduler_state.tasks[i]->priority > scheduler_state.tasks[i-1]->priority) {
-            process_t* temp = scheduler_state.tasks[i];
-            scheduler_state.tasks[i] = scheduler_state.tasks[i-1];
-            scheduler_state.tasks[i-1] = temp;
+    // Interrupts stay off across a switch away, see schedule_locked()
+    uint32_t flags = interrupt_disable();
+    run_queue_t* rq = task_rq_lock(process);
+
+    // A killed task never sleeps again: blocked, a wake would put it back on
+    // a run queue. With nothing linked to it, it leaves the CPU for good
+    // here; otherwise the caller unwinds its wait first.
+    if (process->killed || process->state == PROCESS_STATE_TERMINATED) {
+        bool self = process == rq->current_process && rq == this_rq();
+        if (self && (process->state == PROCESS_STATE_TERMINATED || sched_may_terminate(process))) {
+            schedule_locked(rq, smp_cpu_index());
+        } else {
+            spinlock_release(&rq->lock);
         }
+        interrupt_restore(flags);
+        return false;
     }
 
+    // Already woken on its way here: consume the wakeup instead of sleeping
+    if (process->wake_pending && process->state == PROCESS_STATE_RUNNING) {
+        process->wake_pending = false;
+        spinlock_release(&rq->lock);
+        interrupt_restore(flags);
+        return true;
+    }
+
+    process->state = PROCESS_STATE_BLOCKED;
+    if (process->on_rq) {
+        rq_dequeue(rq, process);
+    }
+
+    // Blocked tasks are off every queue, so they cost nothing until woken.
+    // Blocking ourselves switches away without dropping the lock in between.
+    if (process == rq->current_process && rq == this_rq()) {
+        schedule_locked(rq, smp_cpu_index());
+        interrupt_restore(flags);
+        return !process->killed;
+    }
+    spinlock_release(&rq->lock);
+    interrupt_restore(flags);
     return true;
 }
 
-void scheduler_remove_task(process_t* process) {
+void scheduler_wake(process_t* process) {
     if (!scheduler_state.initialized || !process) {
         return;
     }
 
-    // Find and remove task
-    for (uint32_t i = 0; i < scheduler_state.task_count; i++) {
-        if (scheduler_state.tasks[i] == process) {
-            // Shift remaining tasks
-            for (uint32_t j = i; j < scheduler_state.task_count - 1; j++) {
-                scheduler_state.tasks[j] = scheduler_state.tasks[j + 1];
-            }
+    // Requeue on the CPU it last ran on, where its cache lines still are.
+    // Only a blocked task is requeued; a terminated one never is.
+    run_queue_t* rq = task_rq_lock(process);
+    bool kick = false;
+    if (process->state == PROCESS_STATE_BLOCKED) {
+        kick = sched_wake_locked(rq, process);
+    } else if (process->state == PROCESS_STATE_RUNNING) {
+        process->wake_pending = true;
+    }
+    uint32_t cpu = process->cpu;
+    spinlock_release(&rq->lock);
 
-            scheduler_state.task_count--;
-            break;
-        }
+    if (kick) {
+        smp_send_reschedule(cpu);
     }
 }
 
-void scheduler_switch_task(void) {
-    if (!scheduler_state.initialized || scheduler_state.task_count == 0) {
+// Requeue under the new class so weights and levels stay consistent
+static void sched_change(process_t* process, uint8_t policy, uint8_t priority) {
+    run_queue_t* rq = task_rq_lock(process);
+    if (process->policy == policy && process->priority == priority) {
+        spinlock_release(&rq->lock);
         return;
     }
 
-    // Update current task statistics
-    if (scheduler_state.current_process) {
-        uint32_t current_ticks = timer_get_ticks();
-        scheduler_state.current_process->total_runtime += 
-            current_ticks - scheduler_state.current_process->last_run;
-        scheduler_state.current_process->last_run = current_ticks;
-        scheduler_state.current_process->state = PROCESS_STATE_READY;
+    bool queued = process->on_rq;
+    if (queued) {
+        rq_dequeue(rq, process);
+    } else if (process == rq->current_process) {
+        sched_update_curr(rq);
+    }
+    process->policy = policy;
+    process->priority = priority;
+    if (policy == SCHED_POLICY_FAIR) {
+        sched_place_fair(rq, process, 0);
+    }
+    if (process == rq->current_process) {
+        process->quantum_remaining = sched_slice(rq, process);
+    }
+    bool kick = false;
+    if (queued) {
+        rq_enqueue(rq, process);
+        kick = sched_check_preempt(rq, process);
     }
+    uint32_t cpu = process->cpu;
+    spinlock_release(&rq->lock);
 
-    // Find next task to run
-    process_t* next_process = NULL;
-    for (uint32_t i = 0; i < scheduler_state.task_count; i++) {
-        if (scheduler_state.tasks[i]->state == PROCESS_STATE_READY) {
-            next_process = scheduler_state.tasks[i];
-            break;
-        }
+    if (kick) {
+        smp_send_reschedule(cpu);
     }
+}
 
-    // If no task found, use idle task
-    if (!next_process) {
-        next_process = scheduler_state.idle_process;
+// Run at the higher of the task's own settings and what it inherited
+static void sched_apply_effective(process_t* process) {
+    uint8_t rank = process->pi_rank;
+    if (rank <= scheduler_rank(process->base_policy, process->base_priority)) {
+        sched_change(process, process->base_policy, process->base_priority);
+    } else if (rank > SCHED_RANK_RT_BASE) {
+        sched_change(process, SCHED_POLICY_FIFO, rank - SCHED_RANK_RT_BASE - 1);
+    } else {
+        sched_change(process, SCHED_POLICY_FAIR, rank - 1);
     }
+}
 
-    // Switch to next task
-    next_process->quantum_remaining = SCHEDULER_QUANTUM;
-    next_process->state = PROCESS_STATE_RUNNING;
-    next_process->last_run = timer_get_ticks();
+bool scheduler_set_policy(process_t* process, uint8_t policy, uint8_t priority) {
+    if (!scheduler_state.initialized || !process || policy > SCHED_POLICY_RR) {
+        return false;
+    }
 
-    scheduler_state.current_process = next_process;
-    scheduler_state.total_switches++;
+    process->base_policy = policy;
+    process->base_priority = priority;
+    sched_apply_effective(process);
+    return true;
+}
 
-    // Perform context switch
-    process_switch(next_process);
+void scheduler_set_pi_rank(process_t* process, uint8_t rank) {
+    if (!scheduler_state.initialized || !process || process->pi_rank == rank) {
+        return;
+    }
+
+    process->pi_rank = rank;
+    sched_apply_effective(process);
+}
+
+bool scheduler_promote_rt(process_t* process, uint8_t policy, uint8_t priority) {
+    if (policy != SCHED_POLICY_FIFO && policy != SCHED_POLICY_RR) {
+        return false;
+    }
+    if (!scheduler_set_policy(process, policy, priority)) {
+        return false;
+    }
+    KLOG_I("Scheduler: %s (pid %u) is now %s priority %u", process->name, process->pid,
+           policy == SCHED_POLICY_FIFO ? "FIFO" : "RR", sched_level(priority));
+    return true;
+}
+
+bool scheduler_set_rt_bandwidth(uint32_t runtime, uint32_t period) {
+    if (!period || runtime > period) {
+        return false;
+    }
+    scheduler_state.rt_runtime = runtime;
+    scheduler_state.rt_period = period;
+    return true;
+}
+
+bool scheduler_get_task_stats(process_t* process, scheduler_task_stats_t* stats) {
+    if (!process || !stats) {
+        return false;
+    }
+    stats->wakeups = process->wakeups;
+    stats->latency_max = process->wake_latency_max;
+    stats->latency_avg = process->wakeups ? process->wake_latency_total / process->wakeups : 0;
+    return true;
+}
+
+void scheduler_switch_task(void) {
+    if (!scheduler_state.initialized) {
+        return;
+    }
+
+    uint32_t flags = interrupt_disable();
+    uint32_t self = smp_cpu_index();
+    run_queue_t* rq = &scheduler_state.cpus[self];
+    spinlock_acquire(&rq->lock);
+    schedule_locked(rq, self);
+    interrupt_restore(flags);
 }
 
 process_t* scheduler_get_current_process(void) {
-    if (!scheduler_state.initialized || !scheduler_state.current_process) {
+    if (!scheduler_state.initialized) {
         return NULL;
     }
-    return scheduler_state.current_process;
+    return this_rq()->current_process;
 }
 
 uint32_t scheduler_get_task_count(void) {
     return scheduler_state.task_count;
 }
 
+uint32_t scheduler_get_ready_count(void) {
+    uint32_t ready = 0;
+    for (uint32_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        ready += scheduler_state.cpus[cpu].ready_count;
+    }
+    return ready;
+}
+
 uint32_t scheduler_get_total_switches(void) {
-    return scheduler_state.total_switches;
+    uint32_t switches = 0;
+    for (uint32_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        switches += scheduler_state.cpus[cpu].total_switches;
+    }
+    return switches;
+}
+
+bool scheduler_get_cpu_stats(uint32_t cpu, scheduler_cpu_stats_t* stats) {
+    if (cpu >= SMP_MAX_CPUS || !stats || !scheduler_state.cpus[cpu].online) {
+        return false;
+    }
+
+    run_queue_t* rq = &scheduler_state.cpus[cpu];
+    stats->ready = rq->ready_count;
+    stats->fair_ready = rq->fair_count;
+    stats->rt_throttled = rq->rt_throttle_count;
+    stats->switches = rq->total_switches;
+    stats->steals = rq->steals;
+    stats->idle = rq->current_process == rq->idle_process;
+    return true;
+}
+
+bool scheduler_get_lock_stats(uint32_t cpu, spinlock_stats_t* stats) {
+    if (cpu >= SMP_MAX_CPUS || !scheduler_state.cpus[cpu].online) {
+        return false;
+    }
+    return spinlock_get_stats(&scheduler_state.cpus[cpu].lock, stats);
 }
 
 bool scheduler_is_initialized(void) {
@@ -9,10 +9,10 @@
 #include "kernel/process.h"
 #include "libc/string.h"
 
-#define MAX_SEC_ENTRIES 256
+/* Indexed directly by pid, so lookups never scan */
+#define MAX_SEC_ENTRIES PROCESS_PID_MAX
 
 typedef struct {
-    uint32_t pid;
     uint32_t caps;
     bool     active;
 } sec_entry_t;
@@ -30,23 +30,16 @@ bool sec_init(void) {
 
 /* Find an existing entry for this pid, or -1 */
 static int sec_find_entry(uint32_t pid) {
-    for (int i = 0; i < MAX_SEC_ENTRIES; i++) {
-        if (cap_table[i].active && cap_table[i].pid == pid) return i;
-    }
-    return -1;
+    if (pid >= MAX_SEC_ENTRIES || !cap_table[pid].active) return -1;
+    return (int)pid;
 }
 
 /* Allocate a new entry */
 static int sec_alloc_entry(uint32_t pid) {
-    for (int i = 0; i < MAX_SEC_ENTRIES; i++) {
-        if (!cap_table[i].active) {
-            cap_table[i].active = true;
-            cap_table[i].pid    = pid;
-            cap_table[i].caps   = 0;
-            return i;
-        }
-    }
-    return -1;
+    if (pid >= MAX_SEC_ENTRIES) return -1;
+    cap_table[pid].active = true;
+    cap_table[pid].caps   = 0;
+    return (int)pid;
 }
 
 bool sec_grant_cap(uint32_t pid, uint32_t caps) {
@@ -82,6 +75,13 @@ uint32_t sec_get_caps(uint32_t pid) {
     return cap_table[idx].caps;
 }
 
+/* Drop a dead process's capabilities before its pid can be reused */
+void sec_release(uint32_t pid) {
+    if (!sec_initialized || pid >= MAX_SEC_ENTRIES) return;
+    cap_table[pid].active = false;
+    cap_table[pid].caps   = 0;
+}
+
 bool sec_is_initialized(void) {
     return sec_initialized;
 }
@@ -7,13 +7,6 @@
 #include "kernel/semaphore.h"
 #include "kernel/process.h"
 #include "kernel/scheduler.h"
-#include "kernel/interrupts.h"
-#include "libc/string.h"
-
-typedef struct semaphore_waiter {
-    process_t* process;
-    struct semaphore_waiter* next;
-} semaphore_waiter_t;
 
 void semaphore_init(semaphore_t* sem, int32_t value) {
     if (!sem || value < 0) {
@@ -21,8 +14,8 @@ void semaphore_init(semaphore_t* sem, int32_t value) {
     }
 
     sem->value = value;
-    sem->waiters = NULL;
     spinlock_init(&sem->lock);
+    wait_queue_init(&sem->waiters);
 }
 
 void semaphore_wait(semaphore_t* sem) {
@@ -32,53 +25,12 @@ void semaphore_wait(semaphore_t* sem) {
 
     spinlock_acquire(&sem->lock);
 
-    if (sem->value > 0) {
-        sem->value--;
-        spinlock_release(&sem->lock);
-        return;
-    }
-
-    // Create waiter entry
-    process_t* current = process_get_current();
-    semaphore_waiter_t* waiter = kmalloc(sizeof(semaphore_waiter_t));
-    if (!waiter) {
-        spinlock_release(&sem->lock);
-        return;
-    }
-
-    waiter->process = current;
-    waiter->next = NULL;
-
-    // Add to waiter list
-    if (!sem->waiters) {
-        sem->waiters = waiter;
-    } else {
-        semaphore_waiter_t* last = sem->waiters;
-        while (last->next) {
-            last = last->next;
-        }
-        last->next = waiter;
+    // Blocked until a signal leaves a unit for us
+    while (sem->value <= 0) {
+        wait_queue_sleep_locked(&sem->waiters, &sem->lock);
     }
+    sem->value--;
 
-    // Release lock and block process
-    spinlock_release(&sem->lock);
-    process_block(current);
-
-    // When woken up, clean up waiter entry
-    spinlock_acquire(&sem->lock);
-
-    // Remove from waiter list
-    if (sem->waiters == waiter) {
-        sem->waiters = waiter->next;
-    } else {
-        semaphore_waiter_t* prev = sem->waiters;
-        while (prev->next != waiter) {
-            prev = prev->next;
-        }
-        prev->next = waiter->next;
-    }
-
-    kfree(waiter);
     spinlock_release(&sem->lock);
 }
 
@@ -109,9 +61,7 @@ void semaphore_signal(semaphore_t* sem) {
     sem->value++;
 
     // Wake up first waiter
-    if (sem->waiters) {
-        process_wake(sem->waiters->process);
-    }
+    wait_queue_wake_one(&sem->waiters);
 
     spinlock_release(&sem->lock);
 }
@@ -135,17 +85,10 @@ void semaphore_destroy(semaphore_t* sem) {
 
     spinlock_acquire(&sem->lock);
 
-    // Wake up all waiters
-    semaphore_waiter_t* waiter = sem->waiters;
-    while (waiter) {
-        process_wake(waiter->process);
-        semaphore_waiter_t* next = waiter->next;
-        kfree(waiter);
-        waiter = next;
-    }
-
-    sem->waiters = NULL;
     sem->value = 0;
 
+    // Wake up all waiters
+    wait_queue_wake_all(&sem->waiters);
+
     spinlock_release(&sem->lock);
 }
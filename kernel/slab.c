@@ -0,0 +1,328 @@
+/**
+ * Maya OS Slab Allocator
+ * Per-type object caches carved out of buddy-allocated page blocks.
+ * Author: AmanNagtodeOfficial
+ */
+
+#include "kernel/slab.h"
+#include "kernel/pmm.h"
+#include "kernel/spinlock.h"
+#include "kernel/logging.h"
+#include "libc/string.h"
+
+#define SLAB_MIN_OBJECTS    8
+#define SLAB_MAX_ORDER      3
+#define SLAB_FREE_END       0xFFFF
+
+/* Slab header, followed by the free-index array, then the objects */
+typedef struct slab {
+    struct slab  *next;
+    struct slab  *prev;
+    kmem_cache_t *cache;
+    uint8_t      *objects;
+    uint16_t      inuse;
+    uint16_t      free_head;
+    uint16_t      free_next[];
+} slab_t;
+
+struct kmem_cache {
+    char        name[KMEM_CACHE_NAME_MAX];
+    uint32_t    object_size;
+    uint32_t    align;
+    uint32_t    order;
+    uint32_t    objects_per_slab;
+    uint32_t    header_size;
+    uint32_t    colour_count;   /* Distinct cache-line offsets available */
+    uint32_t    colour_next;
+    kmem_ctor_t ctor;
+    slab_t     *partial;
+    slab_t     *full;
+    slab_t     *empty;
+    uint32_t    hits;
+    uint32_t    misses;
+    uint32_t    slabs;
+    uint32_t    active_objects;
+    spinlock_t  lock;
+    bool        in_use;
+};
+
+static struct {
+    kmem_cache_t caches[KMEM_MAX_CACHES];
+    spinlock_t   lock;
+} slab_state;
+
+static uint32_t align_up(uint32_t value, uint32_t align) {
+    return (value + align - 1) & ~(align - 1);
+}
+
+/* ─── slab list helpers ────────────────────────────────────────── */
+
+static void slab_list_push(slab_t **list, slab_t *slab) {
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list) {
+        (*list)->prev = slab;
+    }
+    *list = slab;
+}
+
+static void slab_list_remove(slab_t **list, slab_t *slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        *list = slab->next;
+    }
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+    slab->next = NULL;
+    slab->prev = NULL;
+}
+
+/* Build a new slab; caller holds the cache lock */
+static slab_t *slab_grow(kmem_cache_t *cache) {
+    uintptr_t frame = pmm_alloc_pages(cache->order);
+    if (!frame) {
+        return NULL;
+    }
+
+    slab_t *slab = (slab_t *)frame;
+    slab->cache = cache;
+    slab->inuse = 0;
+    slab->free_head = 0;
+
+    /* Stagger the first object so equal-indexed objects of different
+       slabs do not all land in the same cache sets */
+    uint32_t colour = cache->colour_next * KMEM_CACHE_LINE;
+    if (cache->colour_count) {
+        cache->colour_next = (cache->colour_next + 1) % cache->colour_count;
+    }
+    slab->objects = (uint8_t *)frame + cache->header_size + colour;
+
+    for (uint32_t i = 0; i < cache->objects_per_slab; i++) {
+        slab->free_next[i] = (i + 1 < cache->objects_per_slab) ? (uint16_t)(i + 1) : SLAB_FREE_END;
+        if (cache->ctor) {
+            cache->ctor(slab->objects + i * cache->object_size);
+        }
+    }
+
+    cache->slabs++;
+    return slab;
+}
+
+/* ─── public API ───────────────────────────────────────────────── */
+
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align,
+                                kmem_ctor_t ctor) {
+    if (!name || size == 0 || (align & (align - 1))) {
+        return NULL;
+    }
+
+    if (align < sizeof(void *)) {
+        align = sizeof(void *);
+    }
+    uint32_t object_size = align_up((uint32_t)size, (uint32_t)align);
+
+    /* Smallest block that holds a useful number of objects */
+    uint32_t order = 0;
+    uint32_t count = 0;
+    uint32_t header = 0;
+    for (order = 0; order <= SLAB_MAX_ORDER; order++) {
+        uint32_t slab_bytes = PMM_FRAME_SIZE << order;
+        count = (slab_bytes - sizeof(slab_t) - (uint32_t)align) / (object_size + sizeof(uint16_t));
+        if (count > SLAB_FREE_END - 1) {
+            count = SLAB_FREE_END - 1;
+        }
+        header = align_up(sizeof(slab_t) + count * sizeof(uint16_t), (uint32_t)align);
+        while (count && header + count * object_size > slab_bytes) {
+            count--;
+            header = align_up(sizeof(slab_t) + count * sizeof(uint16_t), (uint32_t)align);
+        }
+        if (count >= SLAB_MIN_OBJECTS) {
+            break;
+        }
+    }
+    if (order > SLAB_MAX_ORDER) {
+        order = SLAB_MAX_ORDER;
+    }
+    if (count == 0) {
+        KLOG_E("kmem_cache_create: '%s' objects of %u bytes are too large", name, object_size);
+        return NULL;
+    }
+
+    spinlock_acquire(&slab_state.lock);
+
+    kmem_cache_t *cache = NULL;
+    for (int i = 0; i < KMEM_MAX_CACHES; i++) {
+        if (!slab_state.caches[i].in_use) {
+            cache = &slab_state.caches[i];
+            break;
+        }
+    }
+    if (!cache) {
+        spinlock_release(&slab_state.lock);
+        KLOG_E("kmem_cache_create: no free cache slots for '%s'", name);
+        return NULL;
+    }
+
+    memset(cache, 0, sizeof(*cache));
+    strncpy(cache->name, name, KMEM_CACHE_NAME_MAX - 1);
+    cache->object_size = object_size;
+    cache->align = (uint32_t)align;
+    cache->order = order;
+    cache->objects_per_slab = count;
+    cache->header_size = header;
+    cache->colour_count = ((PMM_FRAME_SIZE << order) - header - count * object_size) / KMEM_CACHE_LINE + 1;
+    if (align > KMEM_CACHE_LINE) {
+        cache->colour_count = 1; /* Colouring would break the alignment */
+    }
+    cache->ctor = ctor;
+    spinlock_init(&cache->lock);
+    cache->in_use = true;
+
+    spinlock_release(&slab_state.lock);
+
+    KLOG_D("kmem_cache '%s': %u-byte objects, %u per order-%u slab, %u colours",
+           cache->name, object_size, count, order, cache->colour_count);
+    return cache;
+}
+
+void *kmem_cache_alloc(kmem_cache_t *cache) {
+    if (!cache || !cache->in_use) {
+        return NULL;
+    }
+
+    spinlock_acquire(&cache->lock);
+
+    slab_t *slab = cache->partial;
+    if (slab) {
+        cache->hits++;
+    } else if (cache->empty) {
+        slab = cache->empty;
+        slab_list_remove(&cache->empty, slab);
+        slab_list_push(&cache->partial, slab);
+        cache->hits++;
+    } else {
+        slab = slab_grow(cache);
+        if (!slab) {
+            spinlock_release(&cache->lock);
+            return NULL;
+        }
+        slab_list_push(&cache->partial, slab);
+        cache->misses++;
+    }
+
+    uint16_t index = slab->free_head;
+    slab->free_head = slab->free_next[index];
+    slab->inuse++;
+    cache->active_objects++;
+
+    if (slab->free_head == SLAB_FREE_END) {
+        slab_list_remove(&cache->partial, slab);
+        slab_list_push(&cache->full, slab);
+    }
+
+    spinlock_release(&cache->lock);
+    return slab->objects + index * cache->object_size;
+}
+
+void kmem_cache_free(kmem_cache_t *cache, void *obj) {
+    if (!cache || !obj) {
+        return;
+    }
+
+    /* Slabs are naturally aligned buddy blocks */
+    uint32_t slab_bytes = PMM_FRAME_SIZE << cache->order;
+    slab_t *slab = (slab_t *)((uintptr_t)obj & ~(uintptr_t)(slab_bytes - 1));
+    if (slab->cache != cache) {
+        KLOG_W("kmem_cache_free: %08x does not belong to '%s'", (uint32_t)obj, cache->name);
+        return;
+    }
+
+    uint32_t offset = (uint32_t)((uint8_t *)obj - slab->objects);
+    uint32_t index = offset / cache->object_size;
+    if (offset % cache->object_size || index >= cache->objects_per_slab) {
+        KLOG_W("kmem_cache_free: misaligned object %08x in '%s'", (uint32_t)obj, cache->name);
+        return;
+    }
+
+    spinlock_acquire(&cache->lock);
+
+    bool was_full = slab->free_head == SLAB_FREE_END;
+    slab->free_next[index] = slab->free_head;
+    slab->free_head = (uint16_t)index;
+    slab->inuse--;
+    cache->active_objects--;
+
+    if (was_full) {
+        slab_list_remove(&cache->full, slab);
+        slab_list_push(&cache->partial, slab);
+    }
+
+    if (slab->inuse == 0) {
+        slab_list_remove(&cache->partial, slab);
+        /* Keep one empty slab around to absorb alloc/free ping-pong */
+        if (!cache->empty) {
+            slab_list_push(&cache->empty, slab);
+        } else {
+            cache->slabs--;
+            pmm_free_pages((uintptr_t)slab, cache->order);
+        }
+    }
+
+    spinlock_release(&cache->lock);
+}
+
+void kmem_cache_destroy(kmem_cache_t *cache) {
+    if (!cache || !cache->in_use) {
+        return;
+    }
+
+    spinlock_acquire(&cache->lock);
+
+    if (cache->active_objects) {
+        KLOG_W("kmem_cache_destroy: '%s' still has %u live objects",
+               cache->name, cache->active_objects);
+    }
+
+    slab_t **lists[] = { &cache->partial, &cache->full, &cache->empty };
+    for (uint32_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+        while (*lists[i]) {
+            slab_t *slab = *lists[i];
+            slab_list_remove(lists[i], slab);
+            pmm_free_pages((uintptr_t)slab, cache->order);
+        }
+    }
+
+    cache->slabs = 0;
+    cache->in_use = false;
+    spinlock_release(&cache->lock);
+}
+
+bool kmem_cache_get_stats(kmem_cache_t *cache, kmem_cache_stats_t *stats) {
+    if (!cache || !cache->in_use || !stats) {
+        return false;
+    }
+
+    spinlock_acquire(&cache->lock);
+    stats->name = cache->name;
+    stats->object_size = cache->object_size;
+    stats->objects_per_slab = cache->objects_per_slab;
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->slabs = cache->slabs;
+    stats->active_objects = cache->active_objects;
+    spinlock_release(&cache->lock);
+    return true;
+}
+
+void kmem_cache_dump_stats(void) {
+    KLOG_I("%-20s %6s %6s %8s %8s %6s", "cache", "size", "active", "hits", "misses", "slabs");
+    for (int i = 0; i < KMEM_MAX_CACHES; i++) {
+        kmem_cache_stats_t stats;
+        if (kmem_cache_get_stats(&slab_state.caches[i], &stats)) {
+            KLOG_I("%-20s %6u %6u %8u %8u %6u", stats.name, stats.object_size,
+                   stats.active_objects, stats.hits, stats.misses, stats.slabs);
+        }
+    }
+}
@@ -0,0 +1,376 @@
+/**
+ * Maya OS Symmetric Multiprocessing
+ * Starts the application processors with INIT/SIPI through a real-mode
+ * trampoline and gives every CPU its own GDT, TSS and IPI handlers.
+ * Author: AmanNagtodeOfficial
+ */
+
+#include "kernel/smp.h"
+#include "kernel/apic.h"
+#include "kernel/fpu.h"
+#include "kernel/interrupts.h"
+#include "kernel/kernel.h"
+#include "kernel/memory.h"
+#include "kernel/scheduler.h"
+#include "kernel/spinlock.h"
+#include "kernel/timer.h"
+#include "kernel/logging.h"
+#include "libc/string.h"
+
+#define SMP_TRAMPOLINE_ADDR   0x8000   /* Below 1 MB, never handed out by the PMM */
+#define SMP_AP_STACK_SIZE     16384
+#define SMP_BOOT_TIMEOUT_US   200000
+#define SMP_TLB_FLUSH_ALL     32       /* Pages beyond which a CR3 reload is cheaper */
+
+#define GDT_ENTRIES           6
+#define GDT_KERNEL_CODE       0x08
+#define GDT_KERNEL_DATA       0x10
+#define GDT_TSS               0x28
+
+#define PIT_CHANNEL2          0x42
+#define PIT_COMMAND           0x43
+#define PIT_GATE_PORT         0x61
+#define PIT_FREQUENCY         1193182
+
+typedef struct {
+    uint16_t limit_low;
+    uint16_t base_low;
+    uint8_t  base_mid;
+    uint8_t  access;
+    uint8_t  granularity;
+    uint8_t  base_high;
+} __attribute__((packed)) gdt_entry_t;
+
+typedef struct {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) gdt_ptr_t;
+
+typedef struct {
+    uint32_t prev_tss;
+    uint32_t esp0, ss0, esp1, ss1, esp2, ss2;
+    uint32_t cr3, eip, eflags;
+    uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs, ldt;
+    uint16_t trap;
+    uint16_t iomap_base;
+} __attribute__((packed)) tss_t;
+
+typedef struct {
+    gdt_entry_t gdt[GDT_ENTRIES];
+    tss_t       tss;
+    uint32_t    apic_id;
+    uint8_t    *stack;        /* AP boot stack, later its idle task's stack */
+    bool        online;
+} cpu_t;
+
+/* Filled in by the BSP, read by the trampoline before it enables paging */
+typedef struct {
+    uint32_t cr3;
+    uint32_t cr4;
+    uint32_t stack;
+    uint32_t entry;
+    uint32_t cpu;
+} __attribute__((packed)) smp_boot_params_t;
+
+/* boot/smp_trampoline.asm */
+extern uint8_t smp_trampoline_start[];
+extern uint8_t smp_trampoline_params[];
+extern uint8_t smp_trampoline_end[];
+
+/* boot/idt.asm */
+extern void ipi252(void);
+extern void ipi253(void);
+
+static struct {
+    cpu_t cpus[SMP_MAX_CPUS];
+    uint8_t apic_to_cpu[256];          /* APIC ID -> CPU index + 1 */
+    volatile uint32_t cpu_count;
+    volatile bool ap_started;
+    bool initialized;
+} smp_state;
+
+/* One shootdown in flight at a time; targets clear their bit when done */
+static struct {
+    volatile uint32_t start;
+    volatile uint32_t last;
+    volatile uint32_t pending;         /* Bit per CPU still to flush */
+    spinlock_t lock;
+} shootdown;
+
+/* ─── helpers ──────────────────────────────────────────────────── */
+
+/* Polled delay on PIT channel 2, usable before interrupts are enabled */
+static void smp_udelay(uint32_t us) {
+    while (us) {
+        uint32_t chunk = us > 50000 ? 50000 : us;
+        uint32_t count = (uint32_t)((uint64_t)PIT_FREQUENCY * chunk / 1000000);
+        if (count == 0) {
+            count = 1;
+        }
+
+        uint8_t gate = inb(PIT_GATE_PORT) & ~0x03;  /* Gate low, speaker off */
+        outb(PIT_GATE_PORT, gate);
+        outb(PIT_COMMAND, 0xB0);                    /* Channel 2, lo/hi, mode 0 */
+        outb(PIT_CHANNEL2, count & 0xFF);
+        outb(PIT_CHANNEL2, (count >> 8) & 0xFF);
+        outb(PIT_GATE_PORT, gate | 0x01);           /* Start counting */
+
+        while (!(inb(PIT_GATE_PORT) & 0x20)) {
+            __asm__ volatile("pause");
+        }
+        us -= chunk;
+    }
+}
+
+static void gdt_set(gdt_entry_t *entry, uint32_t base, uint32_t limit,
+                    uint8_t access, uint8_t flags) {
+    entry->limit_low = limit & 0xFFFF;
+    entry->base_low = base & 0xFFFF;
+    entry->base_mid = (base >> 16) & 0xFF;
+    entry->access = access;
+    entry->granularity = ((limit >> 16) & 0x0F) | (flags & 0xF0);
+    entry->base_high = (base >> 24) & 0xFF;
+}
+
+/* Build and load this CPU's GDT and TSS */
+static void smp_load_descriptors(cpu_t *cpu) {
+    memset(&cpu->tss, 0, sizeof(cpu->tss));
+    cpu->tss.ss0 = GDT_KERNEL_DATA;
+    cpu->tss.esp0 = cpu->stack ? (uint32_t)cpu->stack + SMP_AP_STACK_SIZE : 0;
+    cpu->tss.iomap_base = sizeof(tss_t);
+
+    gdt_set(&cpu->gdt[0], 0, 0, 0, 0);
+    gdt_set(&cpu->gdt[1], 0, 0xFFFFF, 0x9A, 0xC0);   /* Kernel code */
+    gdt_set(&cpu->gdt[2], 0, 0xFFFFF, 0x92, 0xC0);   /* Kernel data */
+    gdt_set(&cpu->gdt[3], 0, 0xFFFFF, 0xFA, 0xC0);   /* User code   */
+    gdt_set(&cpu->gdt[4], 0, 0xFFFFF, 0xF2, 0xC0);   /* User data   */
+    gdt_set(&cpu->gdt[5], (uint32_t)&cpu->tss, sizeof(tss_t) - 1, 0x89, 0x00);
+
+    gdt_ptr_t ptr = { sizeof(cpu->gdt) - 1, (uint32_t)cpu->gdt };
+    __asm__ volatile(
+        "lgdt %0\n"
+        "mov %1, %%ds\n"
+        "mov %1, %%es\n"
+        "mov %1, %%fs\n"
+        "mov %1, %%gs\n"
+        "mov %1, %%ss\n"
+        "ljmp %2, $1f\n"
+        "1:\n"
+        "ltr %w3\n"
+        : : "m"(ptr), "r"((uint32_t)GDT_KERNEL_DATA), "i"(GDT_KERNEL_CODE),
+            "r"((uint32_t)GDT_TSS)
+        : "memory");
+}
+
+/* ─── IPI handlers ─────────────────────────────────────────────── */
+
+/* Flush our share of a pending shootdown; safe to call with interrupts off */
+static void smp_tlb_service(void) {
+    uint32_t bit = 1u << smp_cpu_index();
+    if (!(shootdown.pending & bit)) {
+        return;
+    }
+
+    uint32_t start = shootdown.start & ~0xFFFu;
+    uint32_t last = shootdown.last;
+    if (((last - start) >> 12) >= SMP_TLB_FLUSH_ALL) {
+        uint32_t cr3;
+        __asm__ volatile("mov %%cr3, %0\n"
+                         "mov %0, %%cr3" : "=r"(cr3) : : "memory");
+    } else {
+        for (uint32_t virt = start; virt <= last && virt >= start; virt += 0x1000) {
+            __asm__ volatile("invlpg (%0)" : : "r"(virt) : "memory");
+        }
+    }
+    __sync_fetch_and_and(&shootdown.pending, ~bit);
+}
+
+static void smp_tlb_ipi(struct registers *r) {
+    (void)r;
+    smp_tlb_service();
+    apic_eoi();
+}
+
+/* ─── AP entry ─────────────────────────────────────────────────── */
+
+/* Reached from the trampoline on the AP's own stack, paging enabled */
+static void smp_ap_main(uint32_t index) {
+    cpu_t *cpu = &smp_state.cpus[index];
+
+    smp_load_descriptors(cpu);
+    idt_reload();
+    fpu_init_ap();
+    apic_init_ap();
+
+    if (!scheduler_init_cpu(index)) {
+        KLOG_E("SMP: CPU%u has no idle task, parking it", index);
+        for (;;) {
+            __asm__ volatile("cli; hlt");
+        }
+    }
+
+    cpu->online = true;
+    __sync_fetch_and_add(&smp_state.cpu_count, 1);
+    smp_state.ap_started = true;
+
+    timer_init_ap();
+    __asm__ volatile("sti");
+    scheduler_run_idle();
+}
+
+/* INIT, then up to two STARTUP IPIs as the MP specification recommends */
+static bool smp_start_ap(uint32_t index, smp_boot_params_t *params) {
+    cpu_t *cpu = &smp_state.cpus[index];
+
+    cpu->stack = kmalloc(SMP_AP_STACK_SIZE);
+    if (!cpu->stack) {
+        return false;
+    }
+
+    params->stack = (uint32_t)cpu->stack + SMP_AP_STACK_SIZE;
+    params->cpu = index;
+    smp_state.ap_started = false;
+    __sync_synchronize();
+
+    apic_send_init(cpu->apic_id);
+    smp_udelay(10000);
+
+    for (int attempt = 0; attempt < 2 && !smp_state.ap_started; attempt++) {
+        apic_send_startup(cpu->apic_id, SMP_TRAMPOLINE_ADDR >> 12);
+        for (uint32_t waited = 0; waited < SMP_BOOT_TIMEOUT_US && !smp_state.ap_started;
+             waited += 1000) {
+            smp_udelay(1000);
+        }
+    }
+
+    if (!smp_state.ap_started) {
+        kfree(cpu->stack);
+        cpu->stack = NULL;
+        return false;
+    }
+    return true;
+}
+
+/* ─── public API ───────────────────────────────────────────────── */
+
+bool smp_init(void) {
+    if (smp_state.initialized) {
+        return true;
+    }
+    if (!apic_is_initialized() || !scheduler_is_initialized()) {
+        return false;
+    }
+
+    spinlock_init(&shootdown.lock);
+
+    // The BSP is CPU 0 and switches to its own GDT/TSS like everyone else
+    cpu_t *bsp = &smp_state.cpus[0];
+    bsp->apic_id = apic_get_bsp_id();
+    bsp->online = true;
+    smp_state.apic_to_cpu[bsp->apic_id] = 1;
+    smp_state.cpu_count = 1;
+    smp_load_descriptors(bsp);
+
+    idt_set_gate(SMP_RESCHED_VECTOR, (uint32_t)ipi252, 0x08, 0x8E);
+    idt_set_gate(SMP_TLB_VECTOR, (uint32_t)ipi253, 0x08, 0x8E);
+    register_interrupt_handler(SMP_TLB_VECTOR, smp_tlb_ipi);
+
+    // Copy the trampoline where a SIPI vector can reach it
+    uint32_t size = (uint32_t)(smp_trampoline_end - smp_trampoline_start);
+    memcpy((void *)SMP_TRAMPOLINE_ADDR, smp_trampoline_start, size);
+    smp_boot_params_t *params = (smp_boot_params_t *)
+        (SMP_TRAMPOLINE_ADDR + (smp_trampoline_params - smp_trampoline_start));
+
+    uint32_t cr4;
+    __asm__ volatile("mov %%cr4, %0" : "=r"(cr4));
+    params->cr3 = (uint32_t)vmm_get_kernel_directory();
+    params->cr4 = cr4;
+    params->entry = (uint32_t)smp_ap_main;
+
+    // Bring the APs up one at a time; they share the parameter block
+    uint32_t next = 1;
+    for (uint32_t i = 0; i < apic_get_cpu_count() && next < SMP_MAX_CPUS; i++) {
+        uint32_t apic_id = apic_get_cpu_apic_id(i);
+        if (apic_id == bsp->apic_id) {
+            continue;
+        }
+
+        smp_state.cpus[next].apic_id = apic_id;
+        smp_state.apic_to_cpu[apic_id] = (uint8_t)(next + 1);
+        if (smp_start_ap(next, params)) {
+            next++;
+        } else {
+            smp_state.apic_to_cpu[apic_id] = 0;
+            KLOG_W("SMP: CPU with APIC ID %u did not start", apic_id);
+        }
+    }
+
+    smp_state.initialized = true;
+    KLOG_I("SMP: %u of %u CPUs online", smp_state.cpu_count, apic_get_cpu_count());
+    return true;
+}
+
+uint32_t smp_cpu_index(void) {
+    uint32_t slot = smp_state.apic_to_cpu[apic_get_id() & 0xFF];
+    return slot ? slot - 1 : 0;
+}
+
+uint32_t smp_cpu_count(void) {
+    return smp_state.cpu_count ? smp_state.cpu_count : 1;
+}
+
+uint32_t smp_cpu_apic_id(uint32_t cpu) {
+    return cpu < SMP_MAX_CPUS ? smp_state.cpus[cpu].apic_id : 0xFF;
+}
+
+/* Stack the CPU switches to on a ring 3 -> ring 0 transition */
+void smp_set_kernel_stack(uint32_t esp0) {
+    smp_state.cpus[smp_cpu_index()].tss.esp0 = esp0;
+}
+
+void smp_send_reschedule(uint32_t cpu) {
+    if (cpu < SMP_MAX_CPUS && smp_state.cpus[cpu].online && cpu != smp_cpu_index()) {
+        apic_send_ipi(smp_state.cpus[cpu].apic_id, SMP_RESCHED_VECTOR);
+    }
+}
+
+/**
+ * smp_tlb_shootdown – One IPI per batch: every other online CPU drops the
+ * range and the caller waits for all of them. While waiting for the
+ * shootdown lock we keep servicing requests aimed at us, so two CPUs
+ * shooting down at once cannot deadlock with interrupts disabled.
+ */
+void smp_tlb_shootdown(uint32_t start, uint32_t last) {
+    if (smp_state.cpu_count < 2) {
+        return;
+    }
+
+    uint32_t self = smp_cpu_index();
+    uint32_t targets = 0;
+    for (uint32_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        if (cpu != self && smp_state.cpus[cpu].online) {
+            targets |= 1u << cpu;
+        }
+    }
+    if (!targets) {
+        return;
+    }
+
+    while (!spinlock_try_acquire(&shootdown.lock)) {
+        smp_tlb_service();
+        __asm__ volatile("pause");
+    }
+
+    shootdown.start = start;
+    shootdown.last = last;
+    __sync_synchronize();
+    shootdown.pending = targets;
+    apic_send_ipi_all_but_self(SMP_TLB_VECTOR);
+
+    while (shootdown.pending) {
+        __asm__ volatile("pause");
+    }
+
+    spinlock_release(&shootdown.lock);
+}
@@ -2,18 +2,146 @@
  * Maya OS Spinlock Implementation
  * Updated: 2025-08-29 11:16:18 UTC
  * Author: AmanNagtodeOfficial
+ *
+ * Ticket locks hand the lock over in arrival order, so no CPU starves,
+ * but every waiter polls the same word. MCS locks queue waiters in a
+ * list of per-CPU nodes instead: each spins on its own cache line and
+ * the holder releases by writing to its successor's node only. Nodes
+ * come from a small per-CPU pool; a CPU only takes one while interrupts
+ * are off, so the pool needs no locking.
  */
 
 #include "kernel/spinlock.h"
 #include "kernel/interrupts.h"
+#include "kernel/kernel.h"
+#include "kernel/smp.h"
+
+#define SPINLOCK_MCS_NODES   8     /* MCS locks one CPU may hold or wait for */
+#define SPINLOCK_CACHE_LINE  64
+
+typedef struct spinlock_mcs_node {
+    struct spinlock_mcs_node* volatile next;
+    volatile uint32_t waiting;     // Cleared by the predecessor on release
+} __attribute__((aligned(SPINLOCK_CACHE_LINE))) spinlock_mcs_node_t;
+
+static struct {
+    spinlock_mcs_node_t nodes[SMP_MAX_CPUS][SPINLOCK_MCS_NODES];
+    uint32_t used[SMP_MAX_CPUS];   // Bitmap of nodes in use by each CPU
+} mcs_pool;
+
+/* ─── statistics ───────────────────────────────────────────────── */
+
+#ifdef CONFIG_SPINLOCK_STATS
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Only the holder writes the counters
+static inline void stats_acquired(spinlock_t* lock, uint64_t start, bool contended) {
+    uint64_t now = rdtsc();
+    lock->stats.acquisitions++;
+    if (contended) {
+        lock->stats.contended++;
+        lock->stats.spin_cycles += now - start;
+    }
+    lock->hold_start = now;
+}
+
+static inline void stats_released(spinlock_t* lock) {
+    uint64_t held = rdtsc() - lock->hold_start;
+    if (held > lock->stats.hold_max) {
+        lock->stats.hold_max = held;
+    }
+}
+#define STATS_START()                 uint64_t stats_start = rdtsc()
+#define STATS_ACQUIRED(lock, waited)  stats_acquired((lock), stats_start, (waited))
+#define STATS_RELEASED(lock)          stats_released(lock)
+#else
+#define STATS_START()                 do { } while (0)
+#define STATS_ACQUIRED(lock, waited)  do { (void)(waited); } while (0)
+#define STATS_RELEASED(lock)          do { } while (0)
+#endif
+
+/* ─── MCS queue ────────────────────────────────────────────────── */
+
+static spinlock_mcs_node_t* mcs_node_get(uint32_t cpu) {
+    uint32_t free = ~mcs_pool.used[cpu] & ((1u << SPINLOCK_MCS_NODES) - 1);
+    if (!free) {
+        kernel_panic("spinlock: too many MCS locks held on one CPU");
+    }
+    uint32_t slot = __builtin_ctz(free);
+    mcs_pool.used[cpu] |= 1u << slot;
+
+    spinlock_mcs_node_t* node = &mcs_pool.nodes[cpu][slot];
+    node->next = NULL;
+    node->waiting = 1;
+    return node;
+}
+
+// The node is returned to the pool of the CPU it came from
+static void mcs_node_put(spinlock_mcs_node_t* node) {
+    uint32_t index = (uint32_t)(node - &mcs_pool.nodes[0][0]);
+    mcs_pool.used[index / SPINLOCK_MCS_NODES] &= ~(1u << (index % SPINLOCK_MCS_NODES));
+}
+
+// Returns whether it had to wait behind another CPU
+static bool mcs_acquire(spinlock_t* lock, uint32_t cpu) {
+    spinlock_mcs_node_t* node = mcs_node_get(cpu);
+    spinlock_mcs_node_t* prev = __sync_lock_test_and_set(&lock->tail, node);
+    if (prev) {
+        prev->next = node;
+        while (node->waiting) {
+            __asm__ volatile("pause");
+        }
+    }
+    lock->holder = node;
+    return prev != NULL;
+}
+
+static void mcs_release(spinlock_t* lock) {
+    spinlock_mcs_node_t* node = lock->holder;
+    lock->holder = NULL;
+
+    if (!node->next) {
+        // Nobody behind us: empty the queue, unless someone is just joining
+        if (__sync_bool_compare_and_swap(&lock->tail, node, NULL)) {
+            mcs_node_put(node);
+            return;
+        }
+        while (!node->next) {
+            __asm__ volatile("pause");
+        }
+    }
+    node->next->waiting = 0;
+    mcs_node_put(node);
+}
+
+/* ─── public API ───────────────────────────────────────────────── */
 
 void spinlock_init(spinlock_t* lock) {
     if (!lock) {
         return;
     }
-    lock->locked = 0;
+    lock->owner = 0;
+    lock->next = 0;
+    lock->tail = NULL;
+    lock->holder = NULL;
+    lock->mode = SPINLOCK_TICKET;
     lock->cpu = -1;
     lock->interrupt_flags = 0;
+#ifdef CONFIG_SPINLOCK_STATS
+    lock->hold_start = 0;
+    lock->stats = (spinlock_stats_t){0};
+#endif
+}
+
+void spinlock_init_mcs(spinlock_t* lock) {
+    spinlock_init(lock);
+    if (lock) {
+        lock->mode = SPINLOCK_MCS;
+    }
 }
 
 void spinlock_acquire(spinlock_t* lock) {
@@ -21,23 +149,28 @@ void spinlock_acquire(spinlock_t* lock) {
         return;
     }
 
-    // Save interrupt state and disable interrupts
-    lock->interrupt_flags = interrupt_disable();
+    // Disable interrupts; the saved state belongs to the lock only once held
+    uint32_t flags = interrupt_disable();
 
     // Get current CPU ID
-    int cpu = apic_get_id();
+    int cpu = (int)smp_cpu_index();
 
     // Check for recursive locking
-    if (lock->locked && lock->cpu == cpu) {
+    if (spinlock_is_locked(lock) && lock->cpu == cpu) {
         // TODO: Handle deadlock detection
-        interrupt_restore(lock->interrupt_flags);
+        interrupt_restore(flags);
         return;
     }
 
-    // Attempt to acquire lock
-    while (__sync_lock_test_and_set(&lock->locked, 1)) {
-        // Spin until lock is available
-        while (lock->locked) {
+    STATS_START();
+    bool waited;
+    if (lock->mode == SPINLOCK_MCS) {
+        waited = mcs_acquire(lock, (uint32_t)cpu);
+    } else {
+        // Take a ticket and wait for it to be served
+        uint16_t ticket = __sync_fetch_and_add(&lock->next, 1);
+        waited = lock->owner != ticket;
+        while (lock->owner != ticket) {
             __asm__ volatile("pause");
         }
     }
@@ -47,6 +180,8 @@ void spinlock_acquire(spinlock_t* lock) {
 
     // Set owner
     lock->cpu = cpu;
+    lock->interrupt_flags = flags;
+    STATS_ACQUIRED(lock, waited);
 }
 
 bool spinlock_try_acquire(spinlock_t* lock) {
@@ -58,16 +193,31 @@ bool spinlock_try_acquire(spinlock_t* lock) {
     uint32_t flags = interrupt_disable();
 
     // Get current CPU ID
-    int cpu = apic_get_id();
+    int cpu = (int)smp_cpu_index();
 
     // Check for recursive locking
-    if (lock->locked && lock->cpu == cpu) {
+    if (spinlock_is_locked(lock) && lock->cpu == cpu) {
         interrupt_restore(flags);
         return false;
     }
 
     // Attempt to acquire lock
-    if (__sync_lock_test_and_set(&lock->locked, 1)) {
+    STATS_START();
+    bool acquired;
+    if (lock->mode == SPINLOCK_MCS) {
+        spinlock_mcs_node_t* node = mcs_node_get((uint32_t)cpu);
+        acquired = __sync_bool_compare_and_swap(&lock->tail, NULL, node);
+        if (acquired) {
+            lock->holder = node;
+        } else {
+            mcs_node_put(node);
+        }
+    } else {
+        // Free only while no ticket is outstanding (next == owner); take the next one then
+        uint16_t owner = lock->owner;
+        acquired = __sync_bool_compare_and_swap(&lock->next, owner, (uint16_t)(owner + 1));
+    }
+    if (!acquired) {
         interrupt_restore(flags);
         return false;
     }
@@ -78,6 +228,7 @@ bool spinlock_try_acquire(spinlock_t* lock) {
     // Set owner and save interrupt flags
     lock->cpu = cpu;
     lock->interrupt_flags = flags;
+    STATS_ACQUIRED(lock, false);
     return true;
 }
 
@@ -87,29 +238,39 @@ void spinlock_release(spinlock_t* lock) {
     }
 
     // Verify owner
-    int cpu = apic_get_id();
+    int cpu = (int)smp_cpu_index();
     if (lock->cpu != cpu) {
         return;
     }
 
+    STATS_RELEASED(lock);
+    uint32_t flags = lock->interrupt_flags;
+
     // Clear owner
     lock->cpu = -1;
 
     // Memory barrier
     __sync_synchronize();
 
-    // Release lock
-    lock->locked = 0;
+    // Release lock to the next ticket or queued CPU
+    if (lock->mode == SPINLOCK_MCS) {
+        mcs_release(lock);
+    } else {
+        lock->owner++;
+    }
 
     // Restore interrupt state
-    interrupt_restore(lock->interrupt_flags);
+    interrupt_restore(flags);
 }
 
 bool spinlock_is_locked(spinlock_t* lock) {
     if (!lock) {
         return false;
     }
-    return lock->locked != 0;
+    if (lock->mode == SPINLOCK_MCS) {
+        return lock->tail != NULL;
+    }
+    return lock->owner != lock->next;
 }
 
 int spinlock_get_cpu(spinlock_t* lock) {
@@ -118,3 +279,17 @@ int spinlock_get_cpu(spinlock_t* lock) {
     }
     return lock->cpu;
 }
+
+bool spinlock_get_stats(spinlock_t* lock, spinlock_stats_t* stats) {
+#ifdef CONFIG_SPINLOCK_STATS
+    if (!lock || !stats) {
+        return false;
+    }
+    *stats = lock->stats;
+    return true;
+#else
+    (void)lock;
+    (void)stats;
+    return false;
+#endif
+}
@@ -7,6 +7,8 @@
 #include "kernel/syscall.h"
 #include "kernel/interrupts.h"
 #include "kernel/process.h"
+#include "kernel/timer.h"
+#include "kernel/futex.h"
 #include "kernel/memory.h"
 #include "kernel/logging.h"
 #include "drivers/vga.h"
@@ -25,6 +27,7 @@ typedef struct {
 static struct {
     syscall_entry_t syscalls[MAX_SYSCALLS];
     uint32_t syscall_count;
+    struct registers* frame;    // Trap frame of the call in progress
     bool initialized;
 } syscall_state;
 
@@ -42,8 +45,10 @@ static void syscall_handler(struct registers *r) {
     uint32_t args[] = {r->ebx, r->ecx, r->edx, r->esi, r->edi};
     
     // Call handler
+    syscall_state.frame = r;
     r->eax = syscall_state.syscalls[syscall_num].handler(args, 
                 syscall_state.syscalls[syscall_num].arg_count);
+    syscall_state.frame = NULL;
 }
 
 bool syscall_init(void) {
@@ -86,9 +91,9 @@ static uint32_t sys_exit(uint32_t args[], uint32_t arg_count) {
     if (arg_count < 1) return -1;
     int code = (int)args[0];
     KLOG_I("Process exit requested with code: %d", code);
-    process_t* current = process_get_current();
-    if (current) {
-        process_destroy(current);
+    // Its stack is the one we run on: reaped once the switch away is done
+    if (process_get_current()) {
+        process_exit();
     }
     return 0;
 }
@@ -152,15 +157,31 @@ static uint32_t sys_getpid(uint32_t args[], uint32_t arg_count) {
 
 static uint32_t sys_sleep(uint32_t args[], uint32_t arg_count) {
     if (arg_count < 1) return -1;
-    uint32_t ms = args[0];
-    // TODO: Implement process_sleep linked to PIT/APIC timer
-    (void)ms;
+    timer_sleep(args[0]);
     return 0;
 }
 
+static uint32_t sys_futex_wait(uint32_t args[], uint32_t arg_count) {
+    if (arg_count < 2) return -1;
+    return (uint32_t)futex_wait((volatile uint32_t*)args[0], args[1]);
+}
+
+static uint32_t sys_futex_wake(uint32_t args[], uint32_t arg_count) {
+    if (arg_count < 2) return -1;
+    return futex_wake((volatile uint32_t*)args[0], args[1]);
+}
+
 static uint32_t sys_fork(uint32_t args[], uint32_t arg_count) {
-    // TODO: Implement process_clone/fork
-    return -1;
+    process_t* current = process_get_current();
+    if (!current) return -1;
+    // Child shares every user page copy-on-write and returns 0 from its copy of this frame
+    process_t* child = process_fork(current);
+    return child ? child->pid : (uint32_t)-1;
+}
+
+static uint32_t sys_map_anon(uint32_t args[], uint32_t arg_count) {
+    if (arg_count < 2) return 0;
+    return process_map_anonymous(args[0], args[1] != 0);
 }
 
 void syscall_init_defaults(void) {
@@ -172,6 +193,9 @@ void syscall_init_defaults(void) {
     syscall_register(5, sys_getpid, "getpid", 0);
     syscall_register(6, sys_sleep,  "sleep",  1);
     syscall_register(7, sys_fork,   "fork",   0);
+    syscall_register(SYS_FUTEX_WAIT, sys_futex_wait, "futex_wait", 2);
+    syscall_register(SYS_FUTEX_WAKE, sys_futex_wake, "futex_wake", 2);
+    syscall_register(SYS_MAP_ANON, sys_map_anon, "map_anon", 2);
 }
 
 const char* syscall_get_name(uint32_t num) {
@@ -183,6 +207,10 @@ uint32_t syscall_get_count(void) {
     return syscall_state.syscall_count;
 }
 
+struct registers* syscall_get_frame(void) {
+    return syscall_state.frame;
+}
+
 bool syscall_is_initialized(void) {
     return syscall_state.initialized;
 }
@@ -9,6 +9,7 @@
 #include "kernel/process.h"
 #include "kernel/memory.h"
 #include "kernel/fs.h"
+#include "kernel/futex.h"
 #include "libc/string.h"
 
 // System call handler prototypes
@@ -27,6 +28,8 @@ static uint32_t sys_getpid(uint32_t args[]);
 static uint32_t sys_brk(uint32_t args[]);
 static uint32_t sys_sleep(uint32_t args[]);
 static uint32_t sys_kill(uint32_t args[]);
+static uint32_t sys_futex_wait(uint32_t args[]);
+static uint32_t sys_futex_wake(uint32_t args[]);
 static uint32_t sys_socket(uint32_t args[]);
 static uint32_t sys_bind(uint32_t args[]);
 static uint32_t sys_connect(uint32_t args[]);
@@ -52,6 +55,8 @@ const syscall_entry_t syscall_table[] = {
     [SYS_BRK]     = {"brk",     sys_brk,     1},
     [SYS_SLEEP]   = {"sleep",   sys_sleep,   1},
     [SYS_KILL]    = {"kill",    sys_kill,    2},
+    [SYS_FUTEX_WAIT] = {"futex_wait", sys_futex_wait, 2},
+    [SYS_FUTEX_WAKE] = {"futex_wake", sys_futex_wake, 2},
     [SYS_SOCKET]  = {"socket",  sys_socket,  3},
     [SYS_BIND]    = {"bind",    sys_bind,    3},
     [SYS_CONNECT] = {"connect", sys_connect, 3},
@@ -176,6 +181,14 @@ static uint32_t sys_kill(uint32_t args[]) {
     return process_kill(args[0], args[1]);
 }
 
+static uint32_t sys_futex_wait(uint32_t args[]) {
+    return futex_wait((volatile uint32_t*)args[0], args[1]);
+}
+
+static uint32_t sys_futex_wake(uint32_t args[]) {
+    return futex_wake((volatile uint32_t*)args[0], args[1]);
+}
+
 static uint32_t sys_socket(uint32_t args[]) {
     int domain = args[0];
     int type = args[1];
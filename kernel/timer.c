@@ -7,25 +7,269 @@
 #include "kernel/timer.h"
 #include "kernel/apic.h"
 #include "kernel/interrupts.h"
+#include "kernel/smp.h"
+#include "kernel/process.h"
+#include "kernel/scheduler.h"
+#include "kernel/spinlock.h"
 #include "libc/string.h"
 
 #define TIMER_FREQUENCY 1000 // 1000 Hz
 #define TIMER_VECTOR 32
+#define TIMER_MAX_DEADLINE_SOURCES 8
+#define TIMER_MIN_IDLE_TICKS 2    // Shorter idle periods keep the periodic tick
+
+typedef struct {
+    timer_deadline_fn_t next;
+    timer_expire_fn_t expire;
+} timer_deadline_source_t;
+
+// Per-CPU tick state; a tickless CPU runs its APIC timer in one-shot mode
+typedef struct {
+    bool tickless;
+    uint32_t programmed_ticks;    // Length of the armed one-shot
+    uint32_t sleep_deadline;      // timer_sleep() target, or TIMER_NO_DEADLINE
+    uint32_t oneshots;
+    uint32_t ticks_skipped;
+} timer_cpu_t;
+
+// Sleeping task, keyed by the tick it wakes at
+typedef struct {
+    uint32_t wake_tick;
+    process_t* process;
+} timer_sleeper_t;
 
 static struct {
-    uint32_t ticks;
+    volatile uint32_t ticks;
+    uint32_t initial_count;   // APIC timer count per tick, shared by all CPUs
     timer_callback_t callback;
+    timer_deadline_source_t sources[TIMER_MAX_DEADLINE_SOURCES];
+    uint32_t source_count;
+    timer_cpu_t cpus[SMP_MAX_CPUS];
+    volatile uint32_t ticking_mask;  // CPUs whose timer is still periodic
+    process_t* worker;               // Runs expired sources in task context
+    volatile bool expire_pending;    // A source fell due since the worker last ran
     bool initialized;
 } timer_state;
 
-static void timer_handler(struct regs* r) {
-    timer_state.ticks++;
+// Min-heap of blocked sleepers; each task records its slot for removal
+static struct {
+    timer_sleeper_t heap[MAX_PROCESSES];
+    uint32_t count;
+    spinlock_t lock;
+} sleep_queue;
+
+/* ─── deadlines ────────────────────────────────────────────────── */
 
-    if (timer_state.callback) {
-        timer_state.callback(timer_state.ticks);
+// Deadlines are absolute tick counts; compare them modulo wraparound
+static inline bool timer_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+/* ─── sleep queue ──────────────────────────────────────────────── */
+
+static inline void sleep_heap_set(uint32_t slot, timer_sleeper_t sleeper) {
+    sleep_queue.heap[slot] = sleeper;
+    sleeper.process->sleep_slot = (uint16_t)slot;
+}
+
+static void sleep_heap_sift_up(uint32_t slot) {
+    timer_sleeper_t sleeper = sleep_queue.heap[slot];
+    while (slot > 0) {
+        uint32_t parent = (slot - 1) / 2;
+        if (!timer_before(sleeper.wake_tick, sleep_queue.heap[parent].wake_tick)) {
+            break;
+        }
+        sleep_heap_set(slot, sleep_queue.heap[parent]);
+        slot = parent;
+    }
+    sleep_heap_set(slot, sleeper);
+}
+
+static void sleep_heap_sift_down(uint32_t slot) {
+    timer_sleeper_t sleeper = sleep_queue.heap[slot];
+    for (;;) {
+        uint32_t child = slot * 2 + 1;
+        if (child >= sleep_queue.count) {
+            break;
+        }
+        if (child + 1 < sleep_queue.count &&
+            timer_before(sleep_queue.heap[child + 1].wake_tick, sleep_queue.heap[child].wake_tick)) {
+            child++;
+        }
+        if (!timer_before(sleep_queue.heap[child].wake_tick, sleeper.wake_tick)) {
+            break;
+        }
+        sleep_heap_set(slot, sleep_queue.heap[child]);
+        slot = child;
+    }
+    sleep_heap_set(slot, sleeper);
+}
+
+// Caller holds sleep_queue.lock
+static bool sleep_heap_push(process_t* process, uint32_t wake_tick) {
+    if (sleep_queue.count >= MAX_PROCESSES) {
+        return false;
+    }
+    timer_sleeper_t sleeper = { wake_tick, process };
+    sleep_queue.heap[sleep_queue.count] = sleeper;
+    sleep_heap_sift_up(sleep_queue.count++);
+    return true;
+}
+
+// Caller holds sleep_queue.lock; the task must be queued
+static void sleep_heap_remove(process_t* process) {
+    uint32_t slot = process->sleep_slot;
+    process->sleep_slot = PROCESS_NOT_SLEEPING;
+
+    uint32_t last = --sleep_queue.count;
+    if (slot == last) {
+        return;
+    }
+    sleep_heap_set(slot, sleep_queue.heap[last]);
+    if (slot > 0 && timer_before(sleep_queue.heap[slot].wake_tick,
+                                 sleep_queue.heap[(slot - 1) / 2].wake_tick)) {
+        sleep_heap_sift_up(slot);
+    } else {
+        sleep_heap_sift_down(slot);
+    }
+}
+
+// Wake every sleeper whose tick has come; only the top of the heap is looked at
+static void timer_wake_sleepers(void) {
+    uint32_t now = timer_state.ticks;
+    if (!sleep_queue.count || timer_before(now, sleep_queue.heap[0].wake_tick)) {
+        return;
+    }
+
+    spinlock_acquire(&sleep_queue.lock);
+    while (sleep_queue.count && !timer_before(now, sleep_queue.heap[0].wake_tick)) {
+        process_t* process = sleep_queue.heap[0].process;
+        sleep_heap_remove(process);
+        scheduler_wake(process);
+    }
+    spinlock_release(&sleep_queue.lock);
+}
+
+// Earliest pending deadline over sleepers and registered sources
+static uint32_t timer_next_deadline(void) {
+    uint32_t now = timer_state.ticks;
+    uint32_t nearest = TIMER_NO_DEADLINE;
+
+    spinlock_acquire(&sleep_queue.lock);
+    if (sleep_queue.count) {
+        nearest = sleep_queue.heap[0].wake_tick;
+    }
+    spinlock_release(&sleep_queue.lock);
+
+    for (uint32_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        uint32_t deadline = timer_state.cpus[cpu].sleep_deadline;
+        if (deadline != TIMER_NO_DEADLINE &&
+            (nearest == TIMER_NO_DEADLINE || timer_before(deadline - now, nearest - now))) {
+            nearest = deadline;
+        }
+    }
+
+    for (uint32_t i = 0; i < timer_state.source_count; i++) {
+        uint32_t deadline = timer_state.sources[i].next();
+        if (deadline != TIMER_NO_DEADLINE &&
+            (nearest == TIMER_NO_DEADLINE || timer_before(deadline - now, nearest - now))) {
+            nearest = deadline;
+        }
+    }
+    return nearest;
+}
+
+// Whether any registered source's deadline has passed
+static bool timer_sources_due(void) {
+    uint32_t now = timer_state.ticks;
+    for (uint32_t i = 0; i < timer_state.source_count; i++) {
+        uint32_t deadline = timer_state.sources[i].next();
+        if (deadline != TIMER_NO_DEADLINE && !timer_before(now, deadline)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Fire every registered source whose deadline has passed; worker task only
+static void timer_run_expired(void) {
+    uint32_t now = timer_state.ticks;
+    for (uint32_t i = 0; i < timer_state.source_count; i++) {
+        uint32_t deadline = timer_state.sources[i].next();
+        if (deadline != TIMER_NO_DEADLINE && !timer_before(now, deadline)) {
+            timer_state.sources[i].expire();
+        }
+    }
+}
+
+/*
+ * Expiry callbacks allocate and send packets, which must not happen in
+ * interrupt context: the BSP's tick only notices that a source is due and
+ * wakes this task to run them.
+ */
+static void timer_worker(void) {
+    process_t* self = process_get_current();
+    for (;;) {
+        self->wake_pending = false;
+        if (!timer_state.expire_pending) {
+            scheduler_block(self);
+            continue;
+        }
+        timer_state.expire_pending = false;
+        timer_run_expired();
+    }
+}
+
+/* ─── tickless idle ────────────────────────────────────────────── */
+
+// Back to periodic mode, crediting the ticks the one-shot covered
+static void timer_tick_restart(timer_cpu_t* tc, uint32_t cpu) {
+    uint32_t remaining = apic_get_timer_count();
+    uint32_t elapsed = tc->programmed_ticks;
+    if (remaining) {
+        elapsed -= (remaining + timer_state.initial_count - 1) / timer_state.initial_count;
+    }
+
+    apic_set_timer(TIMER_VECTOR, timer_state.initial_count, true);
+    tc->tickless = false;
+    tc->ticks_skipped += elapsed;
+    if (cpu == 0) {
+        timer_state.ticks += elapsed;
+    }
+
+    // Wall time only advances on the BSP; if it is asleep, wake it to keep time
+    __sync_fetch_and_or(&timer_state.ticking_mask, 1u << cpu);
+    if (cpu != 0 && timer_state.cpus[0].tickless) {
+        smp_send_reschedule(0);
+    }
+}
+
+static void timer_handler(struct registers* r) {
+    (void)r;
+    uint32_t cpu = smp_cpu_index();
+    timer_cpu_t* tc = &timer_state.cpus[cpu];
+
+    // Every CPU's APIC timer lands here; only the BSP advances wall time
+    if (tc->tickless) {
+        timer_tick_restart(tc, cpu);
+    } else if (cpu == 0) {
+        timer_state.ticks++;
+    }
+
+    if (cpu == 0) {
+        timer_wake_sleepers();
+        if (timer_state.worker && timer_sources_due()) {
+            timer_state.expire_pending = true;
+            scheduler_wake(timer_state.worker);
+        }
     }
 
+    // Acknowledge first: the callback may switch tasks and not return here
     apic_eoi();
+
+    if (timer_state.callback) {
+        timer_state.callback(timer_state.ticks);
+    }
 }
 
 bool timer_init(void) {
@@ -34,7 +278,7 @@ bool timer_init(void) {
     }
 
     // Register interrupt handler
-    interrupt_register_handler(TIMER_VECTOR, timer_handler);
+    register_interrupt_handler(TIMER_VECTOR, timer_handler);
 
     // Calculate APIC timer initial count for desired frequency
     uint32_t bus_frequency = 200000000; // 200MHz (example, should be detected)
@@ -43,13 +287,131 @@ bool timer_init(void) {
     // Configure APIC timer
     apic_set_timer(TIMER_VECTOR, initial_count, true);
 
+    timer_state.initial_count = initial_count;
     timer_state.ticks = 0;
     timer_state.callback = NULL;
+    timer_state.source_count = 0;
+    for (uint32_t cpu = 0; cpu < SMP_MAX_CPUS; cpu++) {
+        timer_state.cpus[cpu].sleep_deadline = TIMER_NO_DEADLINE;
+    }
+    timer_state.ticking_mask = 1;
+    sleep_queue.count = 0;
+    spinlock_init(&sleep_queue.lock);
     timer_state.initialized = true;
 
     return true;
 }
 
+/**
+ * timer_start_worker – Create the task that runs expired deadline sources.
+ * Needs the scheduler; sources that fall due before it exists wait for it.
+ */
+bool timer_start_worker(void) {
+    if (!timer_state.initialized) {
+        return false;
+    }
+    if (timer_state.worker) {
+        return true;
+    }
+
+    process_t* worker = process_create("timer", timer_worker);
+    if (!worker || !scheduler_add_task(worker, worker->base_priority)) {
+        return false;
+    }
+    timer_state.expire_pending = true;
+    timer_state.worker = worker;
+    return true;
+}
+
+// Start the calling AP's local APIC timer at the BSP's rate
+void timer_init_ap(void) {
+    if (!timer_state.initialized) {
+        return;
+    }
+    apic_set_timer(TIMER_VECTOR, timer_state.initial_count, true);
+    __sync_fetch_and_or(&timer_state.ticking_mask, 1u << smp_cpu_index());
+}
+
+/*
+ * Called by the idle loop with interrupts disabled, right before halting.
+ * Replaces the periodic tick with a one-shot for the nearest deadline. The
+ * BSP keeps ticking while any other CPU does, since it alone keeps time.
+ */
+void timer_idle_enter(void) {
+    if (!timer_state.initialized) {
+        return;
+    }
+
+    uint32_t cpu = smp_cpu_index();
+    timer_cpu_t* tc = &timer_state.cpus[cpu];
+    if (tc->tickless) {
+        return;
+    }
+
+    // Publish first so a CPU restarting its tick concurrently sees us asleep
+    uint32_t others = __sync_and_and_fetch(&timer_state.ticking_mask, ~(1u << cpu));
+    if (cpu == 0 && others) {
+        __sync_fetch_and_or(&timer_state.ticking_mask, 1u);
+        return;
+    }
+
+    uint32_t max_ticks = 0xFFFFFFFF / timer_state.initial_count;
+    uint32_t ticks = max_ticks;
+    uint32_t deadline = timer_next_deadline();
+    if (deadline != TIMER_NO_DEADLINE) {
+        ticks = deadline - timer_state.ticks;
+        if (timer_before(deadline, timer_state.ticks + TIMER_MIN_IDLE_TICKS)) {
+            __sync_fetch_and_or(&timer_state.ticking_mask, 1u << cpu);
+            return;
+        }
+        if (ticks > max_ticks) {
+            ticks = max_ticks;
+        }
+    }
+
+    tc->tickless = true;
+    tc->programmed_ticks = ticks;
+    tc->oneshots++;
+    apic_set_timer(TIMER_VECTOR, ticks * timer_state.initial_count, false);
+}
+
+/*
+ * Called with interrupts disabled once the CPU has work again, or after a
+ * wakeup that did not come from its own timer.
+ */
+void timer_idle_exit(void) {
+    if (!timer_state.initialized) {
+        return;
+    }
+
+    uint32_t cpu = smp_cpu_index();
+    timer_cpu_t* tc = &timer_state.cpus[cpu];
+    if (tc->tickless) {
+        timer_tick_restart(tc, cpu);
+    }
+}
+
+bool timer_register_deadline(timer_deadline_fn_t next, timer_expire_fn_t expire) {
+    if (!timer_state.initialized || !next || !expire ||
+        timer_state.source_count >= TIMER_MAX_DEADLINE_SOURCES) {
+        return false;
+    }
+    timer_state.sources[timer_state.source_count].next = next;
+    timer_state.sources[timer_state.source_count].expire = expire;
+    timer_state.source_count++;
+    return true;
+}
+
+bool timer_get_idle_stats(uint32_t cpu, timer_idle_stats_t* stats) {
+    if (!timer_state.initialized || cpu >= SMP_MAX_CPUS || !stats) {
+        return false;
+    }
+    stats->oneshots = timer_state.cpus[cpu].oneshots;
+    stats->ticks_skipped = timer_state.cpus[cpu].ticks_skipped;
+    stats->tickless = timer_state.cpus[cpu].tickless;
+    return true;
+}
+
 void timer_set_callback(timer_callback_t callback) {
     if (!timer_state.initialized) {
         return;
@@ -69,9 +431,58 @@ void timer_sleep(uint32_t milliseconds) {
     uint32_t target_ticks = timer_state.ticks + 
                            (milliseconds * TIMER_FREQUENCY) / 1000;
 
-    while (timer_state.ticks < target_ticks) {
+    // Tasks park on the sleep queue, off every run queue, until their tick
+    process_t* current = scheduler_get_current_process();
+    if (current && scheduler_is_initialized()) {
+        while (timer_before(timer_state.ticks, target_ticks)) {
+            spinlock_acquire(&sleep_queue.lock);
+            current->wake_pending = false;
+            bool queued = sleep_heap_push(current, target_ticks);
+            spinlock_release(&sleep_queue.lock);
+            if (!queued) {
+                break;
+            }
+
+            bool slept = scheduler_block(current);
+
+            // Woken by something else before the deadline
+            spinlock_acquire(&sleep_queue.lock);
+            if (current->sleep_slot != PROCESS_NOT_SLEEPING) {
+                sleep_heap_remove(current);
+            }
+            spinlock_release(&sleep_queue.lock);
+
+            // Killed: cut the sleep short so the task gets to exit
+            if (!slept) {
+                return;
+            }
+        }
+        if (!timer_before(timer_state.ticks, target_ticks)) {
+            return;
+        }
+    }
+
+    // Boot code, or a full sleep queue: wait in place. Publish the wakeup
+    // so a tickless BSP still arms its timer for it.
+    timer_cpu_t* tc = &timer_state.cpus[smp_cpu_index()];
+    tc->sleep_deadline = target_ticks;
+    while (timer_before(timer_state.ticks, target_ticks)) {
         __asm__ volatile("hlt");
     }
+    tc->sleep_deadline = TIMER_NO_DEADLINE;
+}
+
+// Drop a dying task from the sleep queue
+void timer_cancel_sleep(process_t* process) {
+    if (!timer_state.initialized || !process) {
+        return;
+    }
+
+    spinlock_acquire(&sleep_queue.lock);
+    if (process->sleep_slot != PROCESS_NOT_SLEEPING) {
+        sleep_heap_remove(process);
+    }
+    spinlock_release(&sleep_queue.lock);
 }
 
 uint64_t timer_get_uptime(void) {
@@ -105,6 +516,7 @@ void timer_calibrate(void) {
 
     // Reconfigure timer with calibrated frequency
     uint32_t initial_count = bus_frequency / (16 * TIMER_FREQUENCY);
+    timer_state.initial_count = initial_count;
     apic_set_timer(TIMER_VECTOR, initial_count, true);
 }
 
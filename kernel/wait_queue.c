@@ -0,0 +1,136 @@
+/**
+ * Maya OS Wait Queues
+ * Author: AmanNagtodeOfficial
+ *
+ * A waiter is blocked in the scheduler, off every run queue, until a waker
+ * unlinks its entry and calls scheduler_wake(). The entry's `queued` flag,
+ * not the wakeup itself, says whether it was woken: a stray wakeup from
+ * elsewhere just sends the task back to sleep.
+ */
+
+#include "kernel/wait_queue.h"
+#include "kernel/scheduler.h"
+
+// Caller holds wq->lock
+static void wait_queue_unlink(wait_queue_t* wq, wait_entry_t* entry) {
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        wq->head = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    } else {
+        wq->tail = entry->prev;
+    }
+    entry->next = NULL;
+    entry->prev = NULL;
+}
+
+void wait_queue_init(wait_queue_t* wq) {
+    if (!wq) {
+        return;
+    }
+
+    spinlock_init(&wq->lock);
+    wq->head = NULL;
+    wq->tail = NULL;
+}
+
+void wait_entry_init(wait_entry_t* entry) {
+    entry->process = process_get_current();
+    entry->wq = NULL;
+    entry->queued = false;
+    entry->next = NULL;
+    entry->prev = NULL;
+}
+
+void wait_queue_prepare(wait_queue_t* wq, wait_entry_t* entry) {
+    spinlock_acquire(&wq->lock);
+    entry->wq = wq;
+    if (!entry->queued) {
+        entry->prev = wq->tail;
+        entry->next = NULL;
+        if (wq->tail) {
+            wq->tail->next = entry;
+        } else {
+            wq->head = entry;
+        }
+        wq->tail = entry;
+        entry->queued = true;
+    }
+
+    // Any wakeup from here on must not be slept through
+    if (entry->process) {
+        entry->process->waiting = true;
+        entry->process->wake_pending = false;
+    }
+    spinlock_release(&wq->lock);
+}
+
+void wait_queue_sleep(wait_entry_t* entry) {
+    while (entry->queued) {
+        // Boot code has no task to block; its waker runs on another CPU
+        if (entry->process) {
+            // Killed: out of the queue, and never back to the caller
+            if (!scheduler_block(entry->process)) {
+                wait_queue_finish(entry->wq, entry);
+                process_exit();
+            }
+        } else {
+            __asm__ volatile("pause");
+        }
+    }
+    if (entry->process) {
+        entry->process->waiting = false;
+    }
+}
+
+void wait_queue_finish(wait_queue_t* wq, wait_entry_t* entry) {
+    spinlock_acquire(&wq->lock);
+    if (entry->queued) {
+        wait_queue_unlink(wq, entry);
+        entry->queued = false;
+    }
+    if (entry->process) {
+        entry->process->waiting = false;
+    }
+    spinlock_release(&wq->lock);
+}
+
+void wait_queue_sleep_locked(wait_queue_t* wq, spinlock_t* lock) {
+    wait_entry_t entry;
+    wait_entry_init(&entry);
+    wait_queue_prepare(wq, &entry);
+    spinlock_release(lock);
+    wait_queue_sleep(&entry);
+    spinlock_acquire(lock);
+}
+
+uint32_t wait_queue_wake(wait_queue_t* wq, uint32_t count) {
+    if (!wq) {
+        return 0;
+    }
+
+    uint32_t woken = 0;
+    spinlock_acquire(&wq->lock);
+    while (wq->head && woken < count) {
+        wait_entry_t* entry = wq->head;
+        process_t* process = entry->process;
+        wait_queue_unlink(wq, entry);
+
+        // The entry lives on the waiter's stack: hands off once it is released
+        __sync_synchronize();
+        entry->queued = false;
+        if (process) {
+            scheduler_wake(process);
+        }
+        woken++;
+    }
+    spinlock_release(&wq->lock);
+    return woken;
+}
+
+bool wait_queue_empty(wait_queue_t* wq) {
+    return !wq || !wq->head;
+}
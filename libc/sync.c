@@ -0,0 +1,91 @@
+/**
+ * Maya OS User-Space Synchronisation
+ * Author: AmanNagtodeOfficial
+ *
+ * The mutex word is 0 when free, 1 when held and 2 when held with
+ * possible sleepers. Only a transition involving 2 makes a system call:
+ * a locker that finds it held marks it 2 and sleeps in futex_wait, and
+ * an unlocker that finds 2 wakes one sleeper.
+ */
+
+#include "libc/sync.h"
+#include "kernel/futex.h"
+
+static inline uint32_t futex_syscall(uint32_t num, volatile uint32_t *addr, uint32_t value) {
+    uint32_t ret;
+    __asm__ volatile("int $0x80"
+                     : "=a"(ret)
+                     : "a"(num), "b"(addr), "c"(value)
+                     : "memory");
+    return ret;
+}
+
+static inline void sys_futex_wait(volatile uint32_t *addr, uint32_t expected) {
+    futex_syscall(SYS_FUTEX_WAIT, addr, expected);
+}
+
+static inline void sys_futex_wake(volatile uint32_t *addr, uint32_t count) {
+    futex_syscall(SYS_FUTEX_WAKE, addr, count);
+}
+
+/* ─── mutex ────────────────────────────────────────────────────── */
+
+void sync_mutex_init(sync_mutex_t *mutex) {
+    mutex->state = 0;
+}
+
+void sync_mutex_lock(sync_mutex_t *mutex) {
+    uint32_t state = __sync_val_compare_and_swap(&mutex->state, 0, 1);
+    if (state == 0) {
+        return;
+    }
+
+    // Announce a sleeper before sleeping; whoever swaps 0 out owns it
+    if (state != 2) {
+        state = __sync_lock_test_and_set(&mutex->state, 2);
+    }
+    while (state != 0) {
+        sys_futex_wait(&mutex->state, 2);
+        state = __sync_lock_test_and_set(&mutex->state, 2);
+    }
+}
+
+bool sync_mutex_trylock(sync_mutex_t *mutex) {
+    return __sync_bool_compare_and_swap(&mutex->state, 0, 1);
+}
+
+void sync_mutex_unlock(sync_mutex_t *mutex) {
+    if (__sync_fetch_and_sub(&mutex->state, 1) != 1) {
+        mutex->state = 0;
+        sys_futex_wake(&mutex->state, 1);
+    }
+}
+
+/* ─── condition variable ───────────────────────────────────────── */
+
+void sync_cond_init(sync_cond_t *cond) {
+    cond->seq = 0;
+}
+
+void sync_cond_wait(sync_cond_t *cond, sync_mutex_t *mutex) {
+    uint32_t seq = cond->seq;
+    sync_mutex_unlock(mutex);
+
+    // A signal after the unlock changes seq, so the wait returns at once
+    sys_futex_wait(&cond->seq, seq);
+
+    // Other waiters may have been woken with us: relock as contended
+    while (__sync_lock_test_and_set(&mutex->state, 2) != 0) {
+        sys_futex_wait(&mutex->state, 2);
+    }
+}
+
+void sync_cond_signal(sync_cond_t *cond) {
+    __sync_fetch_and_add(&cond->seq, 1);
+    sys_futex_wake(&cond->seq, 1);
+}
+
+void sync_cond_broadcast(sync_cond_t *cond) {
+    __sync_fetch_and_add(&cond->seq, 1);
+    sys_futex_wake(&cond->seq, FUTEX_WAKE_ALL);
+}
@@ -7,6 +7,7 @@
 #include "net/dns.h"
 #include "net/udp.h"
 #include "kernel/memory.h"
+#include "kernel/timer.h"
 #include "libc/string.h"
 
 #define DNS_PORT 53
@@ -48,6 +49,8 @@ static struct {
     uint32_t dns_server;
     uint16_t query_id;
     dns_callback_t callback;
+    char pending[DNS_MAX_NAME_LENGTH];  // Domain of the outstanding query
+    uint32_t deadline;                  // Tick it times out at
     dns_cache_entry_t cache[DNS_CACHE_SIZE];
     bool initialized;
 } dns_state;
@@ -74,6 +77,19 @@ static uint32_t dns_cache_lookup(const char* domain) {
 
 // ... (encode/decode functions)
 
+static uint32_t dns_next_deadline(void) {
+    return dns_state.callback ? dns_state.deadline : TIMER_NO_DEADLINE;
+}
+
+// No answer in time: fail the outstanding query with a zero address
+static void dns_timeout(void) {
+    dns_callback_t callback = dns_state.callback;
+    dns_state.callback = NULL;
+    if (callback) {
+        callback(dns_state.pending, 0);
+    }
+}
+
 bool dns_init(uint32_t dns_server) {
     if (dns_state.initialized) {
         return true;
@@ -90,6 +106,9 @@ bool dns_init(uint32_t dns_server) {
     dns_state.callback = NULL;
     dns_state.initialized = true;
 
+    // Query timeouts must wake a tickless CPU
+    timer_register_deadline(dns_next_deadline, dns_timeout);
+
     return true;
 }
 
@@ -129,6 +148,8 @@ bool dns_resolve(const char* domain, dns_callback_t callback) {
     question->class = 0x0100; // IN class
     offset += sizeof(dns_question_t);
 
+    strncpy(dns_state.pending, domain, DNS_MAX_NAME_LENGTH - 1);
+    dns_state.deadline = timer_get_ticks() + DNS_TIMEOUT;
     dns_state.callback = callback;
 
     // Send query
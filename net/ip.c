@@ -7,6 +7,7 @@
 #include "net/ip.h"
 #include "net/arp.h"
 #include "kernel/memory.h"
+#include "kernel/slab.h"
 #include "libc/string.h"
 
 #define IP_VERSION 4
@@ -15,6 +16,7 @@
 #define IP_TYPE_ICMP 1
 #define IP_TYPE_TCP 6
 #define IP_TYPE_UDP 17
+#define IP_PACKET_CACHE_SIZE 1536 // Full Ethernet MTU plus headroom
 
 typedef struct {
     uint8_t header_length:4;
@@ -36,6 +38,7 @@ static struct {
     uint32_t gateway;
     uint16_t id_counter;
     ip_rx_callback_t protocol_handlers[256];
+    kmem_cache_t* packet_cache;
     bool initialized;
 } ip_state;
 
@@ -69,6 +72,11 @@ bool ip_init(uint32_t ip_address, uint32_t subnet_mask, uint32_t gateway) {
     ip_state.gateway = gateway;
     ip_state.id_counter = 0;
 
+    ip_state.packet_cache = kmem_cache_create("ip_packet", IP_PACKET_CACHE_SIZE, 0, NULL);
+    if (!ip_state.packet_cache) {
+        return false;
+    }
+
     memset(ip_state.protocol_handlers, 0, sizeof(ip_state.protocol_handlers));
     ip_state.initialized = true;
 
@@ -95,8 +103,10 @@ bool ip_send_packet(uint32_t dest_ip, uint8_t protocol, const void* data, size_t
         return false;
     }
 
-    // Allocate packet buffer
-    uint8_t* packet = kmalloc(total_length);
+    // Allocate packet buffer; oversized datagrams fall back to the heap
+    bool cached = total_length <= IP_PACKET_CACHE_SIZE;
+    uint8_t* packet = cached ? kmem_cache_alloc(ip_state.packet_cache)
+                             : kmalloc(total_length);
     if (!packet) {
         return false;
     }
@@ -134,7 +144,11 @@ bool ip_send_packet(uint32_t dest_ip, uint8_t protocol, const void* data, size_t
     bool result = ethernet_send_frame(dest_mac, 0x0800, packet, total_length);
 
     
-    kfree(packet);
+    if (cached) {
+        kmem_cache_free(ip_state.packet_cache, packet);
+    } else {
+        kfree(packet);
+    }
     ip_state.id_counter++;
 
     return result;
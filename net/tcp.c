@@ -7,6 +7,7 @@
 #include "net/tcp.h"
 #include "net/ip.h"
 #include "kernel/memory.h"
+#include "kernel/slab.h"
 #include "kernel/timer.h"
 #include "libc/string.h"
 
@@ -62,6 +63,7 @@ typedef struct tcp_socket {
 
 static struct {
     tcp_socket_t* sockets;
+    kmem_cache_t* socket_cache;
     uint16_t next_port;
     bool initialized;
 } tcp_state;
@@ -157,15 +159,39 @@ static void tcp_send_packet(tcp_socket_t* socket, uint8_t flags,
     kfree(packet);
 }
 
+// Tick at which tcp_periodic_check() next has a socket to retransmit on
+static uint32_t tcp_next_deadline(void) {
+    uint32_t now = timer_get_ticks();
+    uint32_t nearest = TIMER_NO_DEADLINE;
+
+    for (tcp_socket_t* socket = tcp_state.sockets; socket; socket = socket->next) {
+        if (socket->state == TCP_STATE_ESTABLISHED && socket->retries > 0) {
+            uint32_t deadline = socket->timeout + TCP_TIMEOUT + 1;
+            if (nearest == TIMER_NO_DEADLINE || deadline - now < nearest - now) {
+                nearest = deadline;
+            }
+        }
+    }
+    return nearest;
+}
+
 bool tcp_init(void) {
     if (tcp_state.initialized) {
         return true;
     }
 
+    tcp_state.socket_cache = kmem_cache_create("tcp_socket_t", sizeof(tcp_socket_t), 0, NULL);
+    if (!tcp_state.socket_cache) {
+        return false;
+    }
+
     tcp_state.sockets = NULL;
     tcp_state.next_port = 49152; // Dynamic port range start
     tcp_state.initialized = true;
 
+    // Retransmit timeouts must wake a tickless CPU
+    timer_register_deadline(tcp_next_deadline, tcp_periodic_check);
+
     // Register with IP protocol handler
     return ip_register_protocol(IP_PROTOCOL_TCP, tcp_handle_packet);
 }
@@ -176,7 +202,7 @@ tcp_socket_t* tcp_create_socket(tcp_callback_t callback) {
     }
 
     // Allocate socket structure
-    tcp_socket_t* socket = kmalloc(sizeof(tcp_socket_t));
+    tcp_socket_t* socket = kmem_cache_alloc(tcp_state.socket_cache);
     if (!socket) {
         return NULL;
     }
@@ -232,7 +258,7 @@ void tcp_close(tcp_socket_t* socket) {
             prev->next = socket->next;
         }
 
-        kfree(socket);
+        kmem_cache_free(tcp_state.socket_cache, socket);
     }
 }
 